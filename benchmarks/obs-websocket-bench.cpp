@@ -0,0 +1,589 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <functional>
+#include <benchmark/benchmark.h>
+
+#include <util/platform.h>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QVector>
+#include <QtWebSockets/QWebSocket>
+#include <QtNetwork/QLocalSocket>
+#include <QtCore/QtEndian>
+
+#include "obs-websocket.h"
+#include "Config.h"
+#include "MsgPack.h"
+#include "Utils.h"
+#include "WSServer.h"
+#include "WSFrameCodec.h"
+#include "WSRequestHandler.h"
+
+// Fixed port so that runs are comparable between machines and over time
+#define BENCH_SERVER_PORT 44440
+#define BENCH_LOCAL_SOCKET "obs-websocket-bench"
+
+namespace {
+
+// Request shapes as sent by the most common clients, from the smallest
+// control request to a full scene item update
+const char* requestShapes[] = {
+    "{\"request-type\":\"GetVersion\",\"message-id\":\"1\"}",
+
+    "{\"request-type\":\"SetCurrentScene\",\"message-id\":\"2\","
+    "\"scene-name\":\"Scene 2\"}",
+
+    "{\"request-type\":\"SetVolume\",\"message-id\":\"3\","
+    "\"source\":\"Mic/Aux\",\"volume\":0.75}",
+
+    "{\"request-type\":\"SetSceneItemProperties\",\"message-id\":\"4\","
+    "\"scene-name\":\"Scene\",\"item\":\"Camera\","
+    "\"position\":{\"x\":128.0,\"y\":72.0,\"alignment\":5},"
+    "\"rotation\":90.0,\"scale\":{\"x\":1.5,\"y\":1.5},"
+    "\"crop\":{\"top\":0,\"bottom\":0,\"left\":16,\"right\":16},"
+    "\"visible\":true,\"locked\":false,"
+    "\"bounds\":{\"type\":\"OBS_BOUNDS_NONE\",\"alignment\":0,"
+    "\"x\":0.0,\"y\":0.0}}"
+};
+
+// Values of the ServerBackend setting, by benchmark argument
+const char* backendNames[] = {
+    "qt",
+    "epoll"
+};
+
+const char* lookupNames[] = {
+    "GetVersion",
+    "SetCurrentScene",
+    "GetSceneList",
+    "SetSceneItemProperties",
+    "GetStreamingStatus",
+    "TransitionToProgram",
+    "SetVolume",
+    "GetSourceTypesList"
+};
+
+obs_scene_t* CreateBenchScene(int itemCount) {
+    obs_scene_t* scene = obs_scene_create_private("Bench Scene");
+
+    for (int i = 0; i < itemCount; i++) {
+        QString name = QString("Source %1").arg(i);
+        obs_scene_t* child = obs_scene_create_private(name.toUtf8());
+
+        obs_sceneitem_t* item = obs_scene_add(scene, obs_scene_get_source(child));
+        vec2 pos;
+        vec2_set(&pos, float(i % 16) * 120.0f, float(i / 16) * 68.0f);
+        obs_sceneitem_set_pos(item, &pos);
+
+        // The scene item holds its own reference on the child source
+        obs_scene_release(child);
+    }
+
+    return scene;
+}
+
+obs_data_t* CreateSwitchScenesUpdate(obs_scene_t* scene) {
+    obs_source_t* sceneSource = obs_scene_get_source(scene);
+    OBSDataArrayAutoRelease sceneItems = Utils::GetSceneItems(sceneSource);
+
+    obs_data_t* update = obs_data_create();
+    obs_data_set_string(update, "update-type", "SwitchScenes");
+    obs_data_set_string(update, "scene-name", obs_source_get_name(sceneSource));
+    obs_data_set_array(update, "sources", sceneItems);
+    return update;
+}
+
+bool WaitFor(std::function<bool()> predicate, int timeoutMs = 5000) {
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!predicate()) {
+        if (timer.elapsed() > timeoutMs)
+            return false;
+
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return true;
+}
+
+// Incremented each time the bench server (re)starts, which drops all the
+// clients : fixtures reconnect when it changed
+int serverStarts = 0;
+
+void UseBackend(int backend) {
+    Config* config = Config::Current();
+    if (WSServer::Instance && config->ServerBackend == backendNames[backend])
+        return;
+
+    config->LocalSocketPath = BENCH_LOCAL_SOCKET;
+    config->ServerBackend = backendNames[backend];
+
+    if (!WSServer::Instance)
+        WSServer::Instance = new WSServer();
+    WSServer::Instance->Start(BENCH_SERVER_PORT);
+    serverStarts++;
+}
+
+class BroadcastFixture {
+  public:
+    static bool Prepare(int clientCount, int backend) {
+        UseBackend(backend);
+
+        if (_clients.size() == clientCount && _serverStarts == serverStarts)
+            return true;
+
+        Release();
+        _serverStarts = serverStarts;
+
+        _received.fill(0, clientCount);
+        for (int i = 0; i < clientCount; i++) {
+            QWebSocket* client = new QWebSocket();
+            QObject::connect(client, &QWebSocket::textMessageReceived,
+                [i](const QString&) {
+                    _received[i]++;
+                });
+
+            client->open(QUrl(QString("ws://127.0.0.1:%1")
+                .arg(BENCH_SERVER_PORT)));
+            _clients << client;
+        }
+
+        bool connected = WaitFor([]() {
+            for (QWebSocket* client : _clients) {
+                if (client->state() != QAbstractSocket::ConnectedState)
+                    return false;
+            }
+            return true;
+        });
+        if (!connected)
+            return false;
+
+        // The server registers a client only once it has processed the
+        // new connection, so broadcast until everyone hears it
+        OBSDataAutoRelease ping = obs_data_create();
+        return WaitFor([&ping]() {
+            WSServer::Instance->broadcast(ping);
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+            for (int count : _received) {
+                if (count == 0)
+                    return false;
+            }
+            return true;
+        });
+    }
+
+    static void Drain(int expected) {
+        WaitFor([expected]() {
+            for (int count : _received) {
+                if (count < expected)
+                    return false;
+            }
+            return true;
+        });
+    }
+
+    static void ResetCounters() {
+        _received.fill(0);
+    }
+
+    static void Release() {
+        for (QWebSocket* client : _clients)
+            client->close();
+
+        WaitFor([]() {
+            for (QWebSocket* client : _clients) {
+                if (client->state() != QAbstractSocket::UnconnectedState)
+                    return false;
+            }
+            return true;
+        });
+
+        // Let the server process the matching disconnections
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < 100)
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+
+        qDeleteAll(_clients);
+        _clients.clear();
+        _received.clear();
+    }
+
+    static void Shutdown() {
+        Release();
+        delete WSServer::Instance;
+        WSServer::Instance = nullptr;
+    }
+
+  private:
+    static QList<QWebSocket*> _clients;
+    static QVector<int> _received;
+    static int _serverStarts;
+};
+
+QList<QWebSocket*> BroadcastFixture::_clients;
+QVector<int> BroadcastFixture::_received;
+int BroadcastFixture::_serverStarts = 0;
+
+// One client per transport, sending the same request and waiting for its
+// response : measures transport overhead on top of request handling
+class RoundTripFixture {
+  public:
+    static bool Prepare(int backend) {
+        UseBackend(backend);
+        if (_webSocket && _serverStarts == serverStarts)
+            return true;
+
+        Release();
+        _serverStarts = serverStarts;
+
+        _webSocket = new QWebSocket();
+        QObject::connect(_webSocket, &QWebSocket::textMessageReceived,
+            [](const QString&) {
+                _responses++;
+            });
+        _webSocket->open(QUrl(QString("ws://127.0.0.1:%1")
+            .arg(BENCH_SERVER_PORT)));
+
+        _localSocket = new QLocalSocket();
+        QObject::connect(_localSocket, &QLocalSocket::readyRead, []() {
+            while (_localSocket->bytesAvailable() >= 4) {
+                uchar header[4];
+                _localSocket->peek((char*)header, sizeof(header));
+
+                quint32 length = qFromBigEndian<quint32>(header);
+                if (_localSocket->bytesAvailable() < (qint64)length + 4)
+                    return;
+
+                _localSocket->read(length + 4);
+                _responses++;
+            }
+        });
+        _localSocket->connectToServer(BENCH_LOCAL_SOCKET);
+
+        return WaitFor([]() {
+            return _webSocket->state() == QAbstractSocket::ConnectedState
+                && _localSocket->state() == QLocalSocket::ConnectedState;
+        });
+    }
+
+    static bool RoundTrip(bool local) {
+        static const QByteArray request =
+            "{\"request-type\":\"GetAuthRequired\",\"message-id\":\"1\"}";
+
+        int expected = _responses + 1;
+        if (local) {
+            uchar header[4];
+            qToBigEndian<quint32>((quint32)request.size(), header);
+            _localSocket->write((const char*)header, sizeof(header));
+            _localSocket->write(request);
+            _localSocket->flush();
+        }
+        else {
+            _webSocket->sendTextMessage(QString::fromUtf8(request));
+        }
+
+        return WaitFor([expected]() {
+            return _responses >= expected;
+        });
+    }
+
+    static void Release() {
+        if (!_webSocket)
+            return;
+
+        _webSocket->close();
+        _localSocket->disconnectFromServer();
+        WaitFor([]() {
+            return _webSocket->state() == QAbstractSocket::UnconnectedState
+                && _localSocket->state() == QLocalSocket::UnconnectedState;
+        });
+
+        delete _webSocket;
+        delete _localSocket;
+        _webSocket = nullptr;
+        _localSocket = nullptr;
+    }
+
+  private:
+    static QWebSocket* _webSocket;
+    static QLocalSocket* _localSocket;
+    static int _responses;
+    static int _serverStarts;
+};
+
+QWebSocket* RoundTripFixture::_webSocket = nullptr;
+QLocalSocket* RoundTripFixture::_localSocket = nullptr;
+int RoundTripFixture::_responses = 0;
+int RoundTripFixture::_serverStarts = 0;
+
+} // namespace
+
+static void BM_ParseRequest(benchmark::State& state) {
+    const char* json = requestShapes[state.range(0)];
+    size_t length = strlen(json);
+
+    for (auto _ : state) {
+        OBSDataAutoRelease data = obs_data_create_from_json(json);
+        benchmark::DoNotOptimize(data.Get());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * length);
+}
+BENCHMARK(BM_ParseRequest)->DenseRange(0, 3);
+
+static void BM_MessageMapLookup(benchmark::State& state) {
+    size_t nameCount = sizeof(lookupNames) / sizeof(lookupNames[0]);
+    size_t i = 0;
+
+    for (auto _ : state) {
+        // Same conversion as processIncomingMessage: const char* to QString
+        const char* requestType = lookupNames[i++ % nameCount];
+        void (*handlerFunc)(WSRequestHandler*) =
+            WSRequestHandler::messageMap.value(requestType);
+        benchmark::DoNotOptimize(handlerFunc);
+    }
+}
+BENCHMARK(BM_MessageMapLookup);
+
+static void BM_GetSceneItems(benchmark::State& state) {
+    obs_scene_t* scene = CreateBenchScene(state.range(0));
+    obs_source_t* sceneSource = obs_scene_get_source(scene);
+
+    for (auto _ : state) {
+        OBSDataArrayAutoRelease items = Utils::GetSceneItems(sceneSource);
+        benchmark::DoNotOptimize(items.Get());
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+    obs_scene_release(scene);
+}
+BENCHMARK(BM_GetSceneItems)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_SerializeSwitchScenes(benchmark::State& state) {
+    obs_scene_t* scene = CreateBenchScene(state.range(0));
+    OBSDataAutoRelease update = CreateSwitchScenesUpdate(scene);
+
+    size_t length = 0;
+    for (auto _ : state) {
+        const char* json = obs_data_get_json(update);
+        length = strlen(json);
+        benchmark::DoNotOptimize(json);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * length);
+    state.counters["json_bytes"] = length;
+    obs_scene_release(scene);
+}
+BENCHMARK(BM_SerializeSwitchScenes)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_SerializeSwitchScenesMsgPack(benchmark::State& state) {
+    obs_scene_t* scene = CreateBenchScene(state.range(0));
+    OBSDataAutoRelease update = CreateSwitchScenesUpdate(scene);
+
+    size_t length = 0;
+    for (auto _ : state) {
+        QByteArray msgpack = MsgPack::FromData(update);
+        length = msgpack.size();
+        benchmark::DoNotOptimize(msgpack.constData());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * length);
+    state.counters["msgpack_bytes"] = length;
+    obs_scene_release(scene);
+}
+BENCHMARK(BM_SerializeSwitchScenesMsgPack)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_ParseSwitchScenesMsgPack(benchmark::State& state) {
+    obs_scene_t* scene = CreateBenchScene(state.range(0));
+    OBSDataAutoRelease update = CreateSwitchScenesUpdate(scene);
+    QByteArray msgpack = MsgPack::FromData(update);
+
+    for (auto _ : state) {
+        OBSDataAutoRelease data =
+            MsgPack::ToData(msgpack.constData(), msgpack.size());
+        benchmark::DoNotOptimize(data.Get());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * msgpack.size());
+    obs_scene_release(scene);
+}
+BENCHMARK(BM_ParseSwitchScenesMsgPack)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_NsToTimestamp(benchmark::State& state) {
+    // 1h02m03.004s, a realistic stream uptime
+    uint64_t elapsed = 3723004000000ULL;
+
+    for (auto _ : state) {
+        const char* ts = Utils::nsToTimestamp(elapsed);
+        benchmark::DoNotOptimize(ts);
+        bfree((void*)ts);
+    }
+}
+BENCHMARK(BM_NsToTimestamp);
+
+static void BM_BroadcastTimecodes(benchmark::State& state) {
+    // Mirrors WSEvents::broadcastUpdate with streaming and recording active
+    uint64_t startTime = os_gettime_ns() - 3723004000000ULL;
+
+    for (auto _ : state) {
+        OBSDataAutoRelease update = obs_data_create();
+        obs_data_set_string(update, "update-type", "StreamStatus");
+
+        const char* ts = Utils::nsToTimestamp(os_gettime_ns() - startTime);
+        obs_data_set_string(update, "stream-timecode", ts);
+        bfree((void*)ts);
+
+        ts = Utils::nsToTimestamp(os_gettime_ns() - startTime);
+        obs_data_set_string(update, "rec-timecode", ts);
+        bfree((void*)ts);
+
+        benchmark::DoNotOptimize(update.Get());
+    }
+}
+BENCHMARK(BM_BroadcastTimecodes);
+
+static void BM_BroadcastFanOut(benchmark::State& state) {
+    int backend = state.range(1);
+    if (!BroadcastFixture::Prepare(state.range(0), backend)) {
+        state.SkipWithError("clients failed to connect to the bench server");
+        return;
+    }
+    BroadcastFixture::ResetCounters();
+    state.SetLabel(backendNames[backend]);
+
+    obs_scene_t* scene = CreateBenchScene(10);
+    OBSDataAutoRelease update = CreateSwitchScenesUpdate(scene);
+
+    // The epoll backend writes from its own thread : the timed part only
+    // covers queuing, so delivery to every client is reported separately
+    QElapsedTimer delivery;
+    int64_t deliveryTime = 0;
+
+    int sent = 0;
+    for (auto _ : state) {
+        delivery.start();
+        WSServer::Instance->broadcast(update);
+
+        state.PauseTiming();
+        BroadcastFixture::Drain(++sent);
+        deliveryTime += delivery.nsecsElapsed();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+    if (sent > 0)
+        state.counters["delivery_us"] = (double)deliveryTime / sent / 1000.0;
+    obs_scene_release(scene);
+}
+
+static void FanOutArguments(benchmark::internal::Benchmark* b) {
+    for (int backend = 0; backend <= 1; backend++) {
+        for (int clients : { 1, 10, 100, 250 })
+            b->Args({ clients, backend });
+    }
+}
+BENCHMARK(BM_BroadcastFanOut)->Apply(FanOutArguments)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_RequestRoundTrip(benchmark::State& state) {
+    int backend = state.range(1);
+    if (!RoundTripFixture::Prepare(backend)) {
+        state.SkipWithError("clients failed to connect to the bench server");
+        return;
+    }
+
+    bool local = (state.range(0) == 1);
+    state.SetLabel(local ? "local socket"
+        : QString("loopback TCP, %1").arg(backendNames[backend])
+            .toStdString());
+
+    for (auto _ : state) {
+        if (!RoundTripFixture::RoundTrip(local)) {
+            state.SkipWithError("no response from the bench server");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_RequestRoundTrip)->Args({ 0, 0 })->Args({ 0, 1 })->Args({ 1, 0 })
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_Unmask(benchmark::State& state) {
+    QByteArray payload(state.range(0), 'x');
+    const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+    for (auto _ : state) {
+        WSFrameCodec::Unmask(payload.data(), payload.size(), mask);
+        benchmark::DoNotOptimize(payload.constData());
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * payload.size());
+}
+BENCHMARK(BM_Unmask)->Arg(64)->Arg(1024)->Arg(65536);
+
+static void BM_ValidateUtf8(benchmark::State& state) {
+    obs_scene_t* scene = CreateBenchScene(100);
+    OBSDataAutoRelease update = CreateSwitchScenesUpdate(scene);
+
+    // Scene and source names are where non-ASCII text shows up
+    QByteArray text = obs_data_get_json(update);
+    if (state.range(0) == 1)
+        text.replace("Source", "Sc\xc3\xa8ne \xe6\x97\xa5\xe6\x9c\xac");
+
+    for (auto _ : state) {
+        bool valid = WSFrameCodec::IsValidUtf8(text.constData(), text.size());
+        benchmark::DoNotOptimize(valid);
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+    state.SetLabel(state.range(0) == 1 ? "mixed" : "ASCII");
+    obs_scene_release(scene);
+}
+BENCHMARK(BM_ValidateUtf8)->Arg(0)->Arg(1);
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    if (!obs_startup("en-US", nullptr, nullptr)) {
+        fprintf(stderr, "failed to initialize libobs\n");
+        return 1;
+    }
+
+    // No frontend in this process: keep the server away from tray alerts
+    Config::Current()->AlertsEnabled = false;
+    Config::Current()->AuthRequired = false;
+
+    // Fixtures open hundreds of connections from 127.0.0.1 and send
+    // requests in a tight loop: no admission limits
+    Config::Current()->MaxClients = 0;
+    Config::Current()->ConnectionRate = 0;
+    Config::Current()->RequestRate = 0;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+
+    RoundTripFixture::Release();
+    BroadcastFixture::Shutdown();
+    obs_shutdown();
+    return 0;
+}
@@ -25,8 +25,34 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #define SECTION_NAME "WebsocketAPI"
 #define PARAM_ENABLE "ServerEnabled"
 #define PARAM_PORT "ServerPort"
+#define PARAM_BACKEND "ServerBackend"
+#define PARAM_BATCH_DELAY "WriteBatchDelay"
+#define PARAM_MAX_CLIENTS "MaxClients"
+#define PARAM_CONNECTION_RATE "ConnectionRate"
+#define PARAM_CONNECTION_BURST "ConnectionBurst"
+#define PARAM_REQUEST_RATE "RequestRate"
+#define PARAM_REQUEST_BURST "RequestBurst"
+#define PARAM_PING_INTERVAL "PingInterval"
+#define PARAM_PONG_TIMEOUT "PongTimeout"
+#define PARAM_AUTH_TIMEOUT "AuthTimeout"
 #define PARAM_DEBUG "DebugEnabled"
+#define PARAM_DEBUG_MAXLENGTH "DebugMaxLength"
+#define PARAM_DEBUG_SAMPLING "DebugSampling"
 #define PARAM_ALERT "AlertsEnabled"
+#define PARAM_CAPTURE "CaptureEnabled"
+#define PARAM_CAPTURE_DIR "CaptureDirectory"
+#define PARAM_COMPRESSION "CompressionEnabled"
+#define PARAM_COMPRESSION_THRESHOLD "CompressionThreshold"
+#define PARAM_COMPRESSION_LEVEL "CompressionLevel"
+#define PARAM_LOCAL_SOCKET "LocalSocketPath"
+#define PARAM_EVENTRING "EventRingEnabled"
+#define PARAM_EVENTRING_NAME "EventRingName"
+#define PARAM_EVENTRING_SIZE "EventRingSize"
+#define PARAM_TLS "TlsEnabled"
+#define PARAM_TLS_CERTIFICATE "TlsCertificate"
+#define PARAM_TLS_PRIVATEKEY "TlsPrivateKey"
+#define PARAM_WATCHDOG "WatchdogEnabled"
+#define PARAM_WATCHDOG_THRESHOLD "WatchdogThreshold"
 #define PARAM_AUTHREQUIRED "AuthRequired"
 #define PARAM_SECRET "AuthSecret"
 #define PARAM_SALT "AuthSalt"
@@ -41,8 +67,34 @@ Config* Config::_instance = new Config();
 Config::Config() :
     ServerEnabled(true),
     ServerPort(4444),
+    ServerBackend("qt"),
+    WriteBatchDelay(2),
+    MaxClients(64),
+    ConnectionRate(2),
+    ConnectionBurst(10),
+    RequestRate(200),
+    RequestBurst(400),
+    PingInterval(10000),
+    PongTimeout(10000),
+    AuthTimeout(30000),
     DebugEnabled(false),
+    DebugMaxLength(4096),
+    DebugSampling(""),
     AlertsEnabled(true),
+    CaptureEnabled(false),
+    CaptureDirectory(""),
+    CompressionEnabled(true),
+    CompressionThreshold(1024),
+    CompressionLevel(6),
+    LocalSocketPath(""),
+    EventRingEnabled(false),
+    EventRingName("obs-websocket-events"),
+    EventRingSize(4 * 1024 * 1024),
+    TlsEnabled(false),
+    TlsCertificate(""),
+    TlsPrivateKey(""),
+    WatchdogEnabled(true),
+    WatchdogThreshold(250),
     AuthRequired(false),
     Secret(""),
     Salt(""),
@@ -55,12 +107,70 @@ Config::Config() :
             SECTION_NAME, PARAM_ENABLE, ServerEnabled);
         config_set_default_uint(obsConfig,
             SECTION_NAME, PARAM_PORT, ServerPort);
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_BACKEND, QT_TO_UTF8(ServerBackend));
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_BATCH_DELAY, WriteBatchDelay);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_MAX_CLIENTS, MaxClients);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_CONNECTION_RATE, ConnectionRate);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_CONNECTION_BURST, ConnectionBurst);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_REQUEST_RATE, RequestRate);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_REQUEST_BURST, RequestBurst);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_PING_INTERVAL, PingInterval);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_PONG_TIMEOUT, PongTimeout);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_AUTH_TIMEOUT, AuthTimeout);
 
         config_set_default_bool(obsConfig,
             SECTION_NAME, PARAM_DEBUG, DebugEnabled);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_DEBUG_MAXLENGTH, DebugMaxLength);
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_DEBUG_SAMPLING, QT_TO_UTF8(DebugSampling));
         config_set_default_bool(obsConfig,
             SECTION_NAME, PARAM_ALERT, AlertsEnabled);
 
+        config_set_default_bool(obsConfig,
+            SECTION_NAME, PARAM_CAPTURE, CaptureEnabled);
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_CAPTURE_DIR, QT_TO_UTF8(CaptureDirectory));
+
+        config_set_default_bool(obsConfig,
+            SECTION_NAME, PARAM_COMPRESSION, CompressionEnabled);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_COMPRESSION_THRESHOLD, CompressionThreshold);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_COMPRESSION_LEVEL, CompressionLevel);
+
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_LOCAL_SOCKET, QT_TO_UTF8(LocalSocketPath));
+
+        config_set_default_bool(obsConfig,
+            SECTION_NAME, PARAM_EVENTRING, EventRingEnabled);
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_EVENTRING_NAME, QT_TO_UTF8(EventRingName));
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_EVENTRING_SIZE, EventRingSize);
+
+        config_set_default_bool(obsConfig,
+            SECTION_NAME, PARAM_TLS, TlsEnabled);
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_TLS_CERTIFICATE, QT_TO_UTF8(TlsCertificate));
+        config_set_default_string(obsConfig,
+            SECTION_NAME, PARAM_TLS_PRIVATEKEY, QT_TO_UTF8(TlsPrivateKey));
+
+        config_set_default_bool(obsConfig,
+            SECTION_NAME, PARAM_WATCHDOG, WatchdogEnabled);
+        config_set_default_uint(obsConfig,
+            SECTION_NAME, PARAM_WATCHDOG_THRESHOLD, WatchdogThreshold);
+
         config_set_default_bool(obsConfig,
             SECTION_NAME, PARAM_AUTHREQUIRED, AuthRequired);
         config_set_default_string(obsConfig,
@@ -86,10 +196,62 @@ void Config::Load() {
 
     ServerEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_ENABLE);
     ServerPort = config_get_uint(obsConfig, SECTION_NAME, PARAM_PORT);
+    ServerBackend = config_get_string(obsConfig, SECTION_NAME, PARAM_BACKEND);
+    WriteBatchDelay = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_BATCH_DELAY);
+    MaxClients = config_get_uint(obsConfig, SECTION_NAME, PARAM_MAX_CLIENTS);
+    ConnectionRate = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_CONNECTION_RATE);
+    ConnectionBurst = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_CONNECTION_BURST);
+    RequestRate = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_REQUEST_RATE);
+    RequestBurst = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_REQUEST_BURST);
+    PingInterval = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_PING_INTERVAL);
+    PongTimeout = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_PONG_TIMEOUT);
+    AuthTimeout = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_AUTH_TIMEOUT);
 
     DebugEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_DEBUG);
+    DebugMaxLength = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_DEBUG_MAXLENGTH);
+    DebugSampling = config_get_string(obsConfig,
+        SECTION_NAME, PARAM_DEBUG_SAMPLING);
     AlertsEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_ALERT);
 
+    CaptureEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_CAPTURE);
+    CaptureDirectory = config_get_string(obsConfig, SECTION_NAME, PARAM_CAPTURE_DIR);
+
+    CompressionEnabled = config_get_bool(obsConfig,
+        SECTION_NAME, PARAM_COMPRESSION);
+    CompressionThreshold = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_COMPRESSION_THRESHOLD);
+    CompressionLevel = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_COMPRESSION_LEVEL);
+
+    LocalSocketPath = config_get_string(obsConfig,
+        SECTION_NAME, PARAM_LOCAL_SOCKET);
+
+    EventRingEnabled = config_get_bool(obsConfig,
+        SECTION_NAME, PARAM_EVENTRING);
+    EventRingName = config_get_string(obsConfig,
+        SECTION_NAME, PARAM_EVENTRING_NAME);
+    EventRingSize = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_EVENTRING_SIZE);
+
+    TlsEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_TLS);
+    TlsCertificate = config_get_string(obsConfig,
+        SECTION_NAME, PARAM_TLS_CERTIFICATE);
+    TlsPrivateKey = config_get_string(obsConfig,
+        SECTION_NAME, PARAM_TLS_PRIVATEKEY);
+
+    WatchdogEnabled = config_get_bool(obsConfig, SECTION_NAME, PARAM_WATCHDOG);
+    WatchdogThreshold = config_get_uint(obsConfig,
+        SECTION_NAME, PARAM_WATCHDOG_THRESHOLD);
+
     AuthRequired = config_get_bool(obsConfig, SECTION_NAME, PARAM_AUTHREQUIRED);
     Secret = config_get_string(obsConfig, SECTION_NAME, PARAM_SECRET);
     Salt = config_get_string(obsConfig, SECTION_NAME, PARAM_SALT);
@@ -100,10 +262,64 @@ void Config::Save() {
 
     config_set_bool(obsConfig, SECTION_NAME, PARAM_ENABLE, ServerEnabled);
     config_set_uint(obsConfig, SECTION_NAME, PARAM_PORT, ServerPort);
+    config_set_string(obsConfig, SECTION_NAME, PARAM_BACKEND,
+        QT_TO_UTF8(ServerBackend));
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_BATCH_DELAY,
+        WriteBatchDelay);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_MAX_CLIENTS, MaxClients);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_CONNECTION_RATE,
+        ConnectionRate);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_CONNECTION_BURST,
+        ConnectionBurst);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_REQUEST_RATE,
+        RequestRate);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_REQUEST_BURST,
+        RequestBurst);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_PING_INTERVAL,
+        PingInterval);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_PONG_TIMEOUT,
+        PongTimeout);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_AUTH_TIMEOUT,
+        AuthTimeout);
 
     config_set_bool(obsConfig, SECTION_NAME, PARAM_DEBUG, DebugEnabled);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_DEBUG_MAXLENGTH,
+        DebugMaxLength);
+    config_set_string(obsConfig, SECTION_NAME, PARAM_DEBUG_SAMPLING,
+        QT_TO_UTF8(DebugSampling));
     config_set_bool(obsConfig, SECTION_NAME, PARAM_ALERT, AlertsEnabled);
 
+    config_set_bool(obsConfig, SECTION_NAME, PARAM_CAPTURE, CaptureEnabled);
+    config_set_string(obsConfig, SECTION_NAME, PARAM_CAPTURE_DIR,
+        QT_TO_UTF8(CaptureDirectory));
+
+    config_set_bool(obsConfig, SECTION_NAME, PARAM_COMPRESSION,
+        CompressionEnabled);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_COMPRESSION_THRESHOLD,
+        CompressionThreshold);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_COMPRESSION_LEVEL,
+        CompressionLevel);
+
+    config_set_string(obsConfig, SECTION_NAME, PARAM_LOCAL_SOCKET,
+        QT_TO_UTF8(LocalSocketPath));
+
+    config_set_bool(obsConfig, SECTION_NAME, PARAM_EVENTRING,
+        EventRingEnabled);
+    config_set_string(obsConfig, SECTION_NAME, PARAM_EVENTRING_NAME,
+        QT_TO_UTF8(EventRingName));
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_EVENTRING_SIZE,
+        EventRingSize);
+
+    config_set_bool(obsConfig, SECTION_NAME, PARAM_TLS, TlsEnabled);
+    config_set_string(obsConfig, SECTION_NAME, PARAM_TLS_CERTIFICATE,
+        QT_TO_UTF8(TlsCertificate));
+    config_set_string(obsConfig, SECTION_NAME, PARAM_TLS_PRIVATEKEY,
+        QT_TO_UTF8(TlsPrivateKey));
+
+    config_set_bool(obsConfig, SECTION_NAME, PARAM_WATCHDOG, WatchdogEnabled);
+    config_set_uint(obsConfig, SECTION_NAME, PARAM_WATCHDOG_THRESHOLD,
+        WatchdogThreshold);
+
     config_set_bool(obsConfig, SECTION_NAME, PARAM_AUTHREQUIRED, AuthRequired);
     config_set_string(obsConfig, SECTION_NAME, PARAM_SECRET,
         QT_TO_UTF8(Secret));
@@ -39,10 +39,45 @@ class Config {
 
     bool ServerEnabled;
     uint64_t ServerPort;
+    QString ServerBackend;
+    uint64_t WriteBatchDelay;
+
+    uint64_t MaxClients;
+    uint64_t ConnectionRate;
+    uint64_t ConnectionBurst;
+    uint64_t RequestRate;
+    uint64_t RequestBurst;
+
+    uint64_t PingInterval;
+    uint64_t PongTimeout;
+    uint64_t AuthTimeout;
 
     bool DebugEnabled;
+    uint64_t DebugMaxLength;
+    QString DebugSampling;
     bool AlertsEnabled;
 
+    bool CaptureEnabled;
+    QString CaptureDirectory;
+
+    // permessage-deflate : only the epoll backend negotiates it
+    bool CompressionEnabled;
+    uint64_t CompressionThreshold;
+    uint64_t CompressionLevel;
+
+    QString LocalSocketPath;
+
+    bool EventRingEnabled;
+    QString EventRingName;
+    uint64_t EventRingSize;
+
+    bool TlsEnabled;
+    QString TlsCertificate;
+    QString TlsPrivateKey;
+
+    bool WatchdogEnabled;
+    uint64_t WatchdogThreshold;
+
     bool AuthRequired;
     QString Secret;
     QString Salt;
@@ -0,0 +1,180 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef EVENTRING_H
+#define EVENTRING_H
+
+// Layout of the shared memory event ring, and a reader for it. This
+// header doesn't depend on Qt or libobs so that local consumers can
+// include it as is.
+
+#include <atomic>
+#include <stdint.h>
+
+#define EVENTRING_MAGIC 0x5253574fu // "OWSR"
+#define EVENTRING_VERSION 1
+#define EVENTRING_ALIGNMENT 16
+
+// Record length marking the unused end of the data area : the next
+// record starts at the beginning of the data area
+#define EVENTRING_PADDING 0xffffffffu
+
+// Positions are byte counts since the ring was created. They only grow :
+// a position's offset in the data area is `position & (capacity - 1)`.
+struct EventRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity; // Size of the data area, a power of two
+    uint64_t dataOffset; // Start of the data area, from the header
+
+    // End of the area the writer is about to overwrite. Readers check it
+    // after using a record : if it is more than `capacity` bytes past
+    // the record's position, the record was overwritten meanwhile.
+    alignas(64) std::atomic<uint64_t> reserved;
+
+    // End of the last complete record, and its sequence number
+    alignas(64) std::atomic<uint64_t> published;
+    std::atomic<uint64_t> lastSequence;
+
+    // Incremented after each record, for FUTEX_WAIT. The writer only
+    // calls FUTEX_WAKE when `waiters` is not zero. `open` is cleared
+    // when the server stops.
+    alignas(64) std::atomic<uint32_t> futexWord;
+    std::atomic<uint32_t> waiters;
+    std::atomic<uint32_t> open;
+};
+
+// Records start on EVENTRING_ALIGNMENT boundaries and never wrap around
+struct EventRingRecord {
+    uint64_t sequence; // Starts at 1, one per event
+    uint32_t length; // Payload length, or EVENTRING_PADDING
+    uint32_t reserved;
+    // Followed by the payload : the event's JSON, not null-terminated
+};
+
+inline uint64_t EventRingRecordSize(uint32_t payloadLength) {
+    uint64_t size = sizeof(EventRingRecord) + payloadLength;
+    return (size + EVENTRING_ALIGNMENT - 1) & ~(uint64_t)(EVENTRING_ALIGNMENT - 1);
+}
+
+// Follows the ring from the newest record on. Payloads are handed out
+// in place (no copy) : since the writer never waits for readers, a
+// payload must be considered garbage if the next call to Next() reports
+// an overrun.
+class EventRingReader {
+  public:
+    enum Result {
+        Event, // `payload` points to the next event. `lost` events were
+               // skipped before it, if not zero.
+        Empty, // No new event
+        Overrun, // The reader fell behind and `lost` events were skipped,
+                 // including the one previously returned
+        Closed // The server stopped writing to this ring
+    };
+
+    explicit EventRingReader(EventRingHeader* header)
+        : _header(header),
+          _data((const char*)header + header->dataOffset),
+          _position(0),
+          _expected(0),
+          _current(0)
+    {
+        uint64_t lost;
+        Resync(0, lost);
+    }
+
+    Result Next(const char*& payload, uint32_t& length, uint64_t& lost) {
+        lost = 0;
+
+        // Validate the previously returned event before moving past it
+        if (_current) {
+            if (!StillValid(_position))
+                return Resync(_expected - 1, lost);
+
+            _position += _current;
+            _current = 0;
+        }
+
+        for (;;) {
+            if (_position == _header->published.load(std::memory_order_acquire)) {
+                return _header->open.load(std::memory_order_acquire)
+                    ? Empty : Closed;
+            }
+
+            uint64_t offset = _position & (_header->capacity - 1);
+            const EventRingRecord* record =
+                (const EventRingRecord*)(_data + offset);
+            uint64_t sequence = record->sequence;
+            uint32_t recordLength = record->length;
+
+            if (!StillValid(_position))
+                return Resync(_expected, lost);
+
+            if (recordLength == EVENTRING_PADDING) {
+                _position += _header->capacity - offset;
+                continue;
+            }
+
+            // Sequence numbers reveal the records skipped by a resync
+            if (sequence > _expected)
+                lost = sequence - _expected;
+
+            payload = (const char*)(record + 1);
+            length = recordLength;
+            _expected = sequence + 1;
+            _current = EventRingRecordSize(recordLength);
+            return Event;
+        }
+    }
+
+    // Futex word to wait on after Empty : read it before calling Next()
+    std::atomic<uint32_t>* WaitWord() {
+        return &_header->futexWord;
+    }
+
+    std::atomic<uint32_t>* Waiters() {
+        return &_header->waiters;
+    }
+
+  private:
+    bool StillValid(uint64_t position) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _header->reserved.load(std::memory_order_relaxed) - position
+            <= _header->capacity;
+    }
+
+    // Jumps to the newest record. The sequence number is read before the
+    // position, so that records published in between count as lost.
+    Result Resync(uint64_t firstLost, uint64_t& lost) {
+        uint64_t last = _header->lastSequence.load(std::memory_order_acquire);
+        lost = (last >= firstLost) ? last - firstLost + 1 : 0;
+
+        _expected = last + 1;
+        _position = _header->published.load(std::memory_order_acquire);
+        _current = 0;
+        return Overrun;
+    }
+
+    EventRingHeader* _header;
+    const char* _data;
+    uint64_t _position;
+    uint64_t _expected;
+    uint64_t _current;
+};
+
+#endif // EVENTRING_H
@@ -0,0 +1,447 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "MsgPack.h"
+#include "obs-websocket.h"
+
+// Deepest nesting accepted from clients
+#define MSGPACK_MAX_DEPTH 32
+
+static void writeBigEndian(QByteArray& out, uint64_t value, int size) {
+    for (int shift = (size - 1) * 8; shift >= 0; shift -= 8)
+        out.append((char)((value >> shift) & 0xff));
+}
+
+static void writeHeader(QByteArray& out, uint32_t count,
+    uint8_t fixType, uint32_t fixMax, uint8_t type16, uint8_t type32)
+{
+    if (count <= fixMax) {
+        out.append((char)(fixType | count));
+    }
+    else if (count <= 0xffff) {
+        out.append((char)type16);
+        writeBigEndian(out, count, 2);
+    }
+    else {
+        out.append((char)type32);
+        writeBigEndian(out, count, 4);
+    }
+}
+
+static void writeString(QByteArray& out, const char* str) {
+    if (!str)
+        str = "";
+
+    uint32_t length = (uint32_t)strlen(str);
+    if (length < 32) {
+        out.append((char)(0xa0 | length));
+    }
+    else if (length <= 0xff) {
+        out.append((char)0xd9);
+        writeBigEndian(out, length, 1);
+    }
+    else if (length <= 0xffff) {
+        out.append((char)0xda);
+        writeBigEndian(out, length, 2);
+    }
+    else {
+        out.append((char)0xdb);
+        writeBigEndian(out, length, 4);
+    }
+    out.append(str, (int)length);
+}
+
+static void writeInt(QByteArray& out, long long value) {
+    if (value >= 0) {
+        if (value < 128) {
+            out.append((char)value);
+        }
+        else if (value <= 0xff) {
+            out.append((char)0xcc);
+            writeBigEndian(out, value, 1);
+        }
+        else if (value <= 0xffff) {
+            out.append((char)0xcd);
+            writeBigEndian(out, value, 2);
+        }
+        else if (value <= 0xffffffffLL) {
+            out.append((char)0xce);
+            writeBigEndian(out, value, 4);
+        }
+        else {
+            out.append((char)0xcf);
+            writeBigEndian(out, value, 8);
+        }
+    }
+    else {
+        if (value >= -32) {
+            out.append((char)value);
+        }
+        else if (value >= INT8_MIN) {
+            out.append((char)0xd0);
+            writeBigEndian(out, (uint64_t)value, 1);
+        }
+        else if (value >= INT16_MIN) {
+            out.append((char)0xd1);
+            writeBigEndian(out, (uint64_t)value, 2);
+        }
+        else if (value >= INT32_MIN) {
+            out.append((char)0xd2);
+            writeBigEndian(out, (uint64_t)value, 4);
+        }
+        else {
+            out.append((char)0xd3);
+            writeBigEndian(out, (uint64_t)value, 8);
+        }
+    }
+}
+
+static void writeDouble(QByteArray& out, double value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+
+    out.append((char)0xcb);
+    writeBigEndian(out, bits, 8);
+}
+
+static void writeData(QByteArray& out, obs_data_t* data) {
+    // Like obs_data_get_json, only items with a user value are written
+    uint32_t count = 0;
+    obs_data_item_t* item = nullptr;
+    for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
+        if (obs_data_item_has_user_value(item))
+            count++;
+    }
+    writeHeader(out, count, 0x80, 15, 0xde, 0xdf);
+
+    for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
+        if (!obs_data_item_has_user_value(item))
+            continue;
+
+        writeString(out, obs_data_item_get_name(item));
+
+        switch (obs_data_item_gettype(item)) {
+            case OBS_DATA_STRING:
+                writeString(out, obs_data_item_get_string(item));
+                break;
+
+            case OBS_DATA_NUMBER:
+                if (obs_data_item_numtype(item) == OBS_DATA_NUM_DOUBLE)
+                    writeDouble(out, obs_data_item_get_double(item));
+                else
+                    writeInt(out, obs_data_item_get_int(item));
+                break;
+
+            case OBS_DATA_BOOLEAN:
+                out.append((char)(obs_data_item_get_bool(item) ? 0xc3 : 0xc2));
+                break;
+
+            case OBS_DATA_OBJECT: {
+                OBSDataAutoRelease obj = obs_data_item_get_obj(item);
+                writeData(out, obj);
+                break;
+            }
+
+            case OBS_DATA_ARRAY: {
+                OBSDataArrayAutoRelease array = obs_data_item_get_array(item);
+                size_t arrayCount = obs_data_array_count(array);
+                writeHeader(out, (uint32_t)arrayCount, 0x90, 15, 0xdc, 0xdd);
+
+                for (size_t i = 0; i < arrayCount; i++) {
+                    OBSDataAutoRelease element = obs_data_array_item(array, i);
+                    writeData(out, element);
+                }
+                break;
+            }
+
+            default:
+                out.append((char)0xc0);
+                break;
+        }
+    }
+}
+
+QByteArray MsgPack::FromData(obs_data_t* data) {
+    QByteArray out;
+    out.reserve(256);
+    writeData(out, data);
+    return out;
+}
+
+void MsgPack::WriteMapHeader(QByteArray& out, uint32_t count) {
+    writeHeader(out, count, 0x80, 15, 0xde, 0xdf);
+}
+
+void MsgPack::WriteArrayHeader(QByteArray& out, uint32_t count) {
+    writeHeader(out, count, 0x90, 15, 0xdc, 0xdd);
+}
+
+void MsgPack::WriteString(QByteArray& out, const char* str) {
+    writeString(out, str);
+}
+
+void MsgPack::WriteInt(QByteArray& out, long long value) {
+    writeInt(out, value);
+}
+
+struct Cursor {
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    bool read(uint64_t& value, int size) {
+        if (end - pos < size)
+            return false;
+
+        value = 0;
+        for (int i = 0; i < size; i++)
+            value = (value << 8) | *pos++;
+        return true;
+    }
+
+    bool readBytes(QByteArray& value, uint64_t size) {
+        if ((uint64_t)(end - pos) < size)
+            return false;
+
+        value = QByteArray((const char*)pos, (int)size);
+        pos += size;
+        return true;
+    }
+
+    bool skip(uint64_t size) {
+        if ((uint64_t)(end - pos) < size)
+            return false;
+
+        pos += size;
+        return true;
+    }
+};
+
+static bool readString(Cursor& c, uint8_t type, QByteArray& value) {
+    uint64_t length = 0;
+    if ((type & 0xe0) == 0xa0)
+        length = type & 0x1f;
+    else if (type == 0xd9 && !c.read(length, 1))
+        return false;
+    else if (type == 0xda && !c.read(length, 2))
+        return false;
+    else if (type == 0xdb && !c.read(length, 4))
+        return false;
+    else if (type != 0xd9 && type != 0xda && type != 0xdb)
+        return false;
+
+    return c.readBytes(value, length);
+}
+
+// Reads one value and stores it under `key` in `parent`, or appends it
+// to `array` if it is a map. Values are parsed and discarded when both
+// are null, or when obs_data cannot represent them.
+static bool readValue(Cursor& c, obs_data_t* parent, const char* key,
+    obs_data_array_t* array, int depth)
+{
+    if (depth > MSGPACK_MAX_DEPTH)
+        return false;
+
+    uint64_t type = 0;
+    if (!c.read(type, 1))
+        return false;
+
+    uint64_t count = 0;
+    uint64_t raw = 0;
+
+    // Maps
+    if ((type & 0xf0) == 0x80 || type == 0xde || type == 0xdf) {
+        if (type == 0xde && !c.read(count, 2))
+            return false;
+        else if (type == 0xdf && !c.read(count, 4))
+            return false;
+        else if ((type & 0xf0) == 0x80)
+            count = type & 0x0f;
+
+        OBSDataAutoRelease obj = (parent || array) ? obs_data_create() : nullptr;
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t keyType = 0;
+            QByteArray name;
+            if (!c.read(keyType, 1) || !readString(c, (uint8_t)keyType, name))
+                return false;
+
+            if (!readValue(c, obj, name.constData(), nullptr, depth + 1))
+                return false;
+        }
+
+        if (parent)
+            obs_data_set_obj(parent, key, obj);
+        else if (array)
+            obs_data_array_push_back(array, obj);
+        return true;
+    }
+
+    // Arrays : only arrays of maps exist in obs_data
+    if ((type & 0xf0) == 0x90 || type == 0xdc || type == 0xdd) {
+        if (type == 0xdc && !c.read(count, 2))
+            return false;
+        else if (type == 0xdd && !c.read(count, 4))
+            return false;
+        else if ((type & 0xf0) == 0x90)
+            count = type & 0x0f;
+
+        OBSDataArrayAutoRelease elements =
+            parent ? obs_data_array_create() : nullptr;
+        for (uint64_t i = 0; i < count; i++) {
+            if (!readValue(c, nullptr, nullptr, elements, depth + 1))
+                return false;
+        }
+
+        if (parent)
+            obs_data_set_array(parent, key, elements);
+        return true;
+    }
+
+    // Strings
+    if ((type & 0xe0) == 0xa0 || type == 0xd9 || type == 0xda || type == 0xdb) {
+        QByteArray value;
+        if (!readString(c, (uint8_t)type, value))
+            return false;
+
+        if (parent)
+            obs_data_set_string(parent, key, value.constData());
+        return true;
+    }
+
+    // Integers
+    if (type <= 0x7f || type >= 0xe0) {
+        if (parent)
+            obs_data_set_int(parent, key, (int8_t)type);
+        return true;
+    }
+
+    switch (type) {
+        case 0xc0: // nil
+            return true;
+
+        case 0xc2:
+        case 0xc3:
+            if (parent)
+                obs_data_set_bool(parent, key, type == 0xc3);
+            return true;
+
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            if (!c.read(raw, 1 << (type - 0xcc)))
+                return false;
+            if (parent)
+                obs_data_set_int(parent, key, (long long)raw);
+            return true;
+
+        case 0xd0:
+            if (!c.read(raw, 1))
+                return false;
+            if (parent)
+                obs_data_set_int(parent, key, (int8_t)raw);
+            return true;
+
+        case 0xd1:
+            if (!c.read(raw, 2))
+                return false;
+            if (parent)
+                obs_data_set_int(parent, key, (int16_t)raw);
+            return true;
+
+        case 0xd2:
+            if (!c.read(raw, 4))
+                return false;
+            if (parent)
+                obs_data_set_int(parent, key, (int32_t)raw);
+            return true;
+
+        case 0xd3:
+            if (!c.read(raw, 8))
+                return false;
+            if (parent)
+                obs_data_set_int(parent, key, (int64_t)raw);
+            return true;
+
+        case 0xca: {
+            if (!c.read(raw, 4))
+                return false;
+
+            uint32_t bits = (uint32_t)raw;
+            float value = 0.0f;
+            memcpy(&value, &bits, sizeof(value));
+            if (parent)
+                obs_data_set_double(parent, key, value);
+            return true;
+        }
+
+        case 0xcb: {
+            if (!c.read(raw, 8))
+                return false;
+
+            double value = 0.0;
+            memcpy(&value, &raw, sizeof(value));
+            if (parent)
+                obs_data_set_double(parent, key, value);
+            return true;
+        }
+
+        // bin 8/16/32 and ext 8/16/32 : skipped
+        case 0xc4:
+        case 0xc5:
+        case 0xc6:
+            return c.read(count, 1 << (type - 0xc4)) && c.skip(count);
+
+        case 0xc7:
+        case 0xc8:
+        case 0xc9:
+            return c.read(count, 1 << (type - 0xc7)) && c.skip(count + 1);
+
+        // fixext 1/2/4/8/16
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+            return c.skip(1 + (1 << (type - 0xd4)));
+
+        default:
+            return false;
+    }
+}
+
+obs_data_t* MsgPack::ToData(const char* buffer, size_t length) {
+    Cursor c;
+    c.pos = (const uint8_t*)buffer;
+    c.end = c.pos + length;
+
+    // Messages are maps : read the root into a wrapper, then unwrap it
+    OBSDataAutoRelease wrapper = obs_data_create();
+    if (length == 0 || ((c.pos[0] & 0xf0) != 0x80 && c.pos[0] != 0xde
+        && c.pos[0] != 0xdf))
+    {
+        return nullptr;
+    }
+
+    if (!readValue(c, wrapper, "root", nullptr, 0) || c.pos != c.end)
+        return nullptr;
+
+    return obs_data_get_obj(wrapper, "root");
+}
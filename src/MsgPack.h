@@ -0,0 +1,43 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef MSGPACK_H
+#define MSGPACK_H
+
+#include <QByteArray>
+
+#include <obs.hpp>
+
+#define MSGPACK_SUBPROTOCOL "obswebsocket.msgpack"
+
+// MessagePack encoding of obs_data objects, carrying the same schema as
+// their JSON form : maps with string keys, strings, numbers, booleans,
+// and arrays of maps.
+class MsgPack {
+  public:
+    static QByteArray FromData(obs_data_t* data);
+    static obs_data_t* ToData(const char* buffer, size_t length);
+
+    // For messages assembled around already encoded parts
+    static void WriteMapHeader(QByteArray& out, uint32_t count);
+    static void WriteArrayHeader(QByteArray& out, uint32_t count);
+    static void WriteString(QByteArray& out, const char* str);
+    static void WriteInt(QByteArray& out, long long value);
+};
+
+#endif // MSGPACK_H
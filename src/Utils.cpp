@@ -377,13 +377,32 @@ void Utils::SysTrayNotify(QString &text,
         trayIcon->showMessage(title, text, icon);
 }
 
-QString Utils::FormatIPAddress(QHostAddress &addr) {
-    QRegExp v4regex("(::ffff:)(((\\d).){3})", Qt::CaseInsensitive);
-    QString addrString = addr.toString();
-    if (addrString.contains(v4regex)) {
-        addrString = QHostAddress(addr.toIPv4Address()).toString();
-    }
-    return addrString;
+const char* Utils::nsToTimestamp(uint64_t ns) {
+    uint64_t ms = ns / (1000 * 1000);
+    uint64_t secs = ms / 1000;
+    uint64_t minutes = secs / 60;
+
+    uint64_t hoursPart = minutes / 60;
+    uint64_t minutesPart = minutes % 60;
+    uint64_t secsPart = secs % 60;
+    uint64_t msPart = ms % 1000;
+
+    char* ts = (char*)bmalloc(64);
+    sprintf(ts, "%02d:%02d:%02d.%03d",
+        hoursPart, minutesPart, secsPart, msPart);
+
+    return ts;
+}
+
+QString Utils::FormatIPAddress(const QHostAddress &addr) {
+    // IPv4 addresses, including IPv4-mapped IPv6 ones (::ffff:a.b.c.d),
+    // are shown as IPv4
+    bool isIPv4 = false;
+    quint32 ipv4 = addr.toIPv4Address(&isIPv4);
+    if (isIPv4)
+        return QHostAddress(ipv4).toString();
+
+    return addr.toString();
 }
 
 const char* Utils::GetRecordingFolder() {
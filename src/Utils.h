@@ -70,7 +70,8 @@ class Utils {
         QSystemTrayIcon::MessageIcon n,
         QString title = QString("obs-websocket"));
 
-    static QString FormatIPAddress(QHostAddress &addr);
+    static QString FormatIPAddress(const QHostAddress &addr);
+    static const char* nsToTimestamp(uint64_t ns);
 
     static const char* GetRecordingFolder();
     static bool SetRecordingFolder(const char* path);
@@ -0,0 +1,155 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <util/platform.h>
+#include <QDateTime>
+#include <QDir>
+
+#include "WSCapture.h"
+#include "obs-websocket.h"
+
+// Pending records above this size are dropped rather than buffered,
+// so that a stalled disk never grows the plugin's memory usage
+#define CAPTURE_MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+WSCapture::WSCapture(QObject* parent)
+    : QThread(parent),
+      _pendingBytes(0),
+      _droppedRecords(0),
+      _startTime(0),
+      _stopping(false),
+      _active(0)
+{
+}
+
+WSCapture::~WSCapture() {
+    Stop();
+}
+
+bool WSCapture::Start(QString directory) {
+    if (IsActive())
+        return true;
+
+    QDir dir(directory);
+    if (!dir.exists())
+        dir.mkpath(".");
+
+    QString fileName = QString("obs-websocket-%1.owscap")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
+
+    _file.setFileName(dir.filePath(fileName));
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        blog(LOG_ERROR, "capture: failed to open %s: %s",
+            _file.fileName().toUtf8().constData(),
+            _file.errorString().toUtf8().constData());
+        return false;
+    }
+
+    _startTime = os_gettime_ns();
+
+    QDataStream out(&_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(CAPTURE_MAGIC, 8);
+    out << (quint32)CAPTURE_VERSION
+        << (quint64)QDateTime::currentMSecsSinceEpoch();
+
+    _pending.clear();
+    _pendingBytes = 0;
+    _droppedRecords = 0;
+    _stopping = false;
+    _active = 1;
+    start(QThread::LowPriority);
+
+    blog(LOG_INFO, "capture: recording traffic to %s",
+        _file.fileName().toUtf8().constData());
+    return true;
+}
+
+void WSCapture::Stop() {
+    if (!IsActive())
+        return;
+
+    _active = 0;
+
+    QMutexLocker locker(&_mutex);
+    _stopping = true;
+    _wakeUp.wakeOne();
+    locker.unlock();
+
+    wait();
+    _file.close();
+
+    if (_droppedRecords > 0) {
+        blog(LOG_WARNING, "capture: %llu records dropped (disk too slow)",
+            (unsigned long long)_droppedRecords);
+    }
+    blog(LOG_INFO, "capture: stopped");
+}
+
+bool WSCapture::IsActive() {
+    return _active.load() != 0;
+}
+
+void WSCapture::Record(CaptureRecord::Type type, quint32 connectionId,
+    const QByteArray& payload)
+{
+    if (!IsActive())
+        return;
+
+    CaptureRecord record;
+    record.type = type;
+    record.timestamp = os_gettime_ns() - _startTime;
+    record.connectionId = connectionId;
+    record.payload = payload;
+
+    QMutexLocker locker(&_mutex);
+    if (_pendingBytes + payload.size() > CAPTURE_MAX_PENDING_BYTES) {
+        _droppedRecords++;
+        return;
+    }
+
+    _pending.append(record);
+    _pendingBytes += payload.size();
+    _wakeUp.wakeOne();
+}
+
+void WSCapture::run() {
+    QDataStream out(&_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    QVector<CaptureRecord> batch;
+    bool stopping = false;
+
+    while (!stopping) {
+        QMutexLocker locker(&_mutex);
+        while (_pending.isEmpty() && !_stopping)
+            _wakeUp.wait(&_mutex);
+
+        // Swap the queue out so that producers never wait on disk writes
+        batch.swap(_pending);
+        _pendingBytes = 0;
+        stopping = _stopping;
+        locker.unlock();
+
+        for (const CaptureRecord& record : batch)
+            record.write(out);
+
+        batch.clear();
+        _file.flush();
+    }
+}
@@ -0,0 +1,110 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSCAPTURE_H
+#define WSCAPTURE_H
+
+#include <string.h>
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// Capture file layout (little-endian) :
+// - header : "OBSWSCAP" magic, quint32 version, quint64 wall clock
+//   start time in ms since epoch
+// - records : quint8 type, quint64 ns since capture start,
+//   quint32 connection id, quint32 payload size, payload bytes
+#define CAPTURE_MAGIC "OBSWSCAP"
+#define CAPTURE_VERSION 1
+
+struct CaptureRecord {
+    enum Type : quint8 {
+        Connected = 1,   // payload : peer address
+        Disconnected = 2,
+        Inbound = 3,     // payload : request frame
+        Outbound = 4,    // payload : response frame
+        Broadcast = 5    // payload : event frame, connection id is 0
+    };
+
+    quint8 type;
+    quint64 timestamp;
+    quint32 connectionId;
+    QByteArray payload;
+
+    static bool readHeader(QDataStream& in, quint64& startTime) {
+        char magic[8];
+        quint32 version = 0;
+        if (in.readRawData(magic, 8) != 8
+            || memcmp(magic, CAPTURE_MAGIC, 8) != 0)
+        {
+            return false;
+        }
+
+        in >> version >> startTime;
+        return (in.status() == QDataStream::Ok
+            && version == CAPTURE_VERSION);
+    }
+
+    bool read(QDataStream& in) {
+        quint32 size = 0;
+        in >> type >> timestamp >> connectionId >> size;
+        if (in.status() != QDataStream::Ok)
+            return false;
+
+        payload.resize(size);
+        return (in.readRawData(payload.data(), size) == (int)size);
+    }
+
+    void write(QDataStream& out) const {
+        out << type << timestamp << connectionId << (quint32)payload.size();
+        out.writeRawData(payload.constData(), payload.size());
+    }
+};
+
+class WSCapture : public QThread {
+  public:
+    explicit WSCapture(QObject* parent = Q_NULLPTR);
+    ~WSCapture();
+    bool Start(QString directory);
+    void Stop();
+    bool IsActive();
+    void Record(CaptureRecord::Type type, quint32 connectionId,
+        const QByteArray& payload = QByteArray());
+
+  protected:
+    void run() override;
+
+  private:
+    QFile _file;
+    QMutex _mutex;
+    QWaitCondition _wakeUp;
+    QVector<CaptureRecord> _pending;
+    qint64 _pendingBytes;
+    quint64 _droppedRecords;
+    quint64 _startTime;
+    bool _stopping;
+    QAtomicInt _active;
+};
+
+#endif // WSCAPTURE_H
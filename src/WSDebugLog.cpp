@@ -0,0 +1,277 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <util/bmem.h>
+
+#include <QRegExp>
+#include <QStringList>
+
+#include "WSDebugLog.h"
+#include "obs-websocket.h"
+
+// Ring size (must be a power of two) and largest line a cell can hold.
+// The arena is allocated once, the first time debug logging starts.
+#define DEBUG_LOG_CAPACITY 512
+#define DEBUG_LOG_CELL_SIZE 4096
+
+// Drain interval of the writer thread, in ms
+#define DEBUG_LOG_DRAIN_INTERVAL 10
+
+WSDebugLog* WSDebugLog::_instance = nullptr;
+
+WSDebugLog::WSDebugLog()
+    : _cells(nullptr),
+      _arena(nullptr),
+      _mask(DEBUG_LOG_CAPACITY - 1),
+      _maxLength(DEBUG_LOG_CELL_SIZE),
+      _enqueuePos(0),
+      _dequeuePos(0),
+      _sampling(nullptr),
+      _dropped(0),
+      _active(false),
+      _stopping(false)
+{
+}
+
+WSDebugLog::~WSDebugLog() {
+    Stop();
+
+    delete[] _cells;
+    bfree(_arena);
+
+    SamplingRules* rules = _sampling.load();
+    if (rules)
+        _retiredSampling.append(rules);
+
+    for (SamplingRules* retired : _retiredSampling) {
+        qDeleteAll(*retired);
+        delete retired;
+    }
+}
+
+void WSDebugLog::Start(int maxLength, QString samplingRules) {
+    Stop();
+
+    if (!_cells) {
+        _arena = (char*)bmalloc(DEBUG_LOG_CAPACITY * DEBUG_LOG_CELL_SIZE);
+        _cells = new Cell[DEBUG_LOG_CAPACITY];
+        for (size_t i = 0; i < DEBUG_LOG_CAPACITY; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+            _cells[i].text = _arena + (i * DEBUG_LOG_CELL_SIZE);
+        }
+    }
+
+    if (maxLength <= 0 || maxLength > DEBUG_LOG_CELL_SIZE)
+        maxLength = DEBUG_LOG_CELL_SIZE;
+    _maxLength = maxLength;
+
+    SetSamplingRules(samplingRules);
+
+    _stopping = false;
+    _active = true;
+    start(QThread::LowestPriority);
+}
+
+void WSDebugLog::Stop() {
+    if (!_active)
+        return;
+
+    _active = false;
+    _stopping = true;
+    wait();
+}
+
+bool WSDebugLog::IsActive() {
+    return _active.load(std::memory_order_relaxed);
+}
+
+bool WSDebugLog::ShouldSample(const char* type) {
+    if (!IsActive())
+        return false;
+
+    SamplingRules* rules = _sampling.load(std::memory_order_acquire);
+    if (!rules || rules->isEmpty() || !type)
+        return true;
+
+    SamplingRule* rule =
+        rules->value(QByteArray::fromRawData(type, (int)strlen(type)));
+    if (!rule)
+        return true;
+
+    if (rule->period == 0)
+        return false;
+
+    uint32_t count = rule->counter.fetch_add(1, std::memory_order_relaxed);
+    return (count % rule->period) == 0;
+}
+
+void WSDebugLog::Log(Direction direction, const char* text, size_t length) {
+    if (!IsActive())
+        return;
+
+    // Bounded MPMC queue (D. Vyukov) : producers never take a lock
+    Cell* cell = nullptr;
+    size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t copyLength = (length < _maxLength) ? length : _maxLength;
+    memcpy(cell->text, text, copyLength);
+    cell->direction = direction;
+    cell->length = copyLength;
+    cell->totalLength = length;
+
+    cell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+uint64_t WSDebugLog::DroppedLines() {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+WSDebugLog* WSDebugLog::Current() {
+    if (!_instance)
+        _instance = new WSDebugLog();
+
+    return _instance;
+}
+
+void WSDebugLog::run() {
+    QByteArray line;
+    Direction direction;
+    size_t totalLength = 0;
+    uint64_t reportedDrops = _dropped.load();
+
+    for (;;) {
+        bool stopping = _stopping.load();
+
+        while (Dequeue(direction, line, totalLength)) {
+            const char* prefix = "Update <<";
+            if (direction == Request)
+                prefix = "Request >>";
+            else if (direction == Response)
+                prefix = "Response <<";
+
+            if ((size_t)line.size() < totalLength) {
+                blog(LOG_DEBUG, "%s '%s' (truncated, %llu bytes)",
+                    prefix, line.constData(),
+                    (unsigned long long)totalLength);
+            }
+            else {
+                blog(LOG_DEBUG, "%s '%s'", prefix, line.constData());
+            }
+        }
+
+        uint64_t drops = _dropped.load();
+        if (drops != reportedDrops) {
+            blog(LOG_WARNING, "debug logging: %llu lines dropped",
+                (unsigned long long)(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+
+        if (stopping)
+            break;
+
+        QThread::msleep(DEBUG_LOG_DRAIN_INTERVAL);
+    }
+}
+
+void WSDebugLog::SetSamplingRules(QString rules) {
+    // Format : "RequestOrUpdateType=rate,..." with rate between 0 and 1
+    SamplingRules* parsed = new SamplingRules();
+
+    QStringList entries = rules.split(QRegExp("[,;\\s]+"),
+        QString::SkipEmptyParts);
+    for (QString entry : entries) {
+        QStringList parts = entry.split('=');
+        bool ok = false;
+        double rate = (parts.size() == 2) ? parts[1].toDouble(&ok) : 0.0;
+
+        if (!ok || rate < 0.0 || rate > 1.0) {
+            blog(LOG_WARNING, "debug logging: invalid sampling rule '%s'",
+                entry.toUtf8().constData());
+            continue;
+        }
+
+        SamplingRule* rule = new SamplingRule();
+        rule->period = (rate > 0.0) ? (uint32_t)qRound(1.0 / rate) : 0;
+        rule->counter.store(0);
+
+        QByteArray type = parts[0].trimmed().toUtf8();
+        delete parsed->value(type);
+        parsed->insert(type, rule);
+    }
+
+    // Callers may still be reading the previous rules : retire them
+    // instead of freeing them
+    SamplingRules* previous = _sampling.exchange(parsed);
+    if (previous)
+        _retiredSampling.append(previous);
+}
+
+bool WSDebugLog::Dequeue(Direction& direction, QByteArray& line,
+    size_t& totalLength)
+{
+    Cell* cell = nullptr;
+    size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = _dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    direction = cell->direction;
+    line = QByteArray(cell->text, (int)cell->length);
+    totalLength = cell->totalLength;
+
+    cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSDEBUGLOG_H
+#define WSDEBUGLOG_H
+
+#include <atomic>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QThread>
+
+// Protocol debug logging, kept off the hot path : lines are copied
+// (and truncated) into a fixed lock-free ring, and a background thread
+// hands them to blog(). When the ring is full, lines are dropped and
+// counted instead of blocking the caller.
+class WSDebugLog : public QThread {
+  public:
+    enum Direction {
+        Request,
+        Response,
+        Update
+    };
+
+    WSDebugLog();
+    ~WSDebugLog();
+    void Start(int maxLength, QString samplingRules);
+    void Stop();
+    bool IsActive();
+
+    bool ShouldSample(const char* type);
+    void Log(Direction direction, const char* text, size_t length);
+    uint64_t DroppedLines();
+
+    static WSDebugLog* Current();
+
+  protected:
+    void run() override;
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Direction direction;
+        size_t length;
+        size_t totalLength;
+        char* text;
+    };
+
+    struct SamplingRule {
+        uint32_t period;
+        std::atomic<uint32_t> counter;
+    };
+    typedef QHash<QByteArray, SamplingRule*> SamplingRules;
+
+    void SetSamplingRules(QString rules);
+    bool Dequeue(Direction& direction, QByteArray& line, size_t& totalLength);
+
+    Cell* _cells;
+    char* _arena;
+    size_t _mask;
+    size_t _maxLength;
+    std::atomic<size_t> _enqueuePos;
+    std::atomic<size_t> _dequeuePos;
+
+    std::atomic<SamplingRules*> _sampling;
+    QList<SamplingRules*> _retiredSampling;
+
+    std::atomic<uint64_t> _dropped;
+    std::atomic<bool> _active;
+    std::atomic<bool> _stopping;
+
+    static WSDebugLog* _instance;
+};
+
+#endif // WSDEBUGLOG_H
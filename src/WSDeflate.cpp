@@ -0,0 +1,297 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include <util/platform.h>
+
+#include <QList>
+#include <QSet>
+
+#include "Config.h"
+#include "WSDeflate.h"
+#include "obs-websocket.h"
+
+// Empty stored block ending every sync-flushed message. It is removed
+// from outgoing messages and appended to incoming ones (RFC 7692 7.2)
+static const char deflateTail[4] = { 0x00, 0x00, (char)0xff, (char)0xff };
+
+QMutex WSDeflate::_statsMutex;
+QHash<QByteArray, WSDeflate::MessageStats> WSDeflate::_stats;
+
+WSDeflate::WSDeflate(const DeflateParams& params, int level)
+    : _params(params),
+      _deflaterReady(false),
+      _inflaterReady(false)
+{
+    if (level < Z_BEST_SPEED || level > Z_BEST_COMPRESSION)
+        level = Z_DEFAULT_COMPRESSION;
+
+    memset(&_deflater, 0, sizeof(_deflater));
+    memset(&_inflater, 0, sizeof(_inflater));
+
+    // Negative window bits select raw deflate data, without zlib header
+    _deflaterReady = (deflateInit2(&_deflater, level, Z_DEFLATED,
+        -_params.serverMaxWindowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+    // A 32K window decodes data compressed with any smaller window
+    _inflaterReady = (inflateInit2(&_inflater, -15) == Z_OK);
+
+    if (!_deflaterReady || !_inflaterReady)
+        blog(LOG_ERROR, "compression: failed to initialize zlib");
+}
+
+WSDeflate::~WSDeflate() {
+    if (_deflaterReady)
+        deflateEnd(&_deflater);
+
+    if (_inflaterReady)
+        inflateEnd(&_inflater);
+}
+
+bool WSDeflate::Compress(const char* data, size_t length, QByteArray& output,
+    const char* messageType)
+{
+    if (!_deflaterReady)
+        return false;
+
+    uint64_t startTime = os_gettime_ns();
+
+    output.resize((int)deflateBound(&_deflater, (uLong)length) + 16);
+    _deflater.next_in = (Bytef*)data;
+    _deflater.avail_in = (uInt)length;
+
+    size_t produced = 0;
+    for (;;) {
+        _deflater.next_out = (Bytef*)output.data() + produced;
+        _deflater.avail_out = (uInt)(output.size() - produced);
+
+        if (deflate(&_deflater, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            return false;
+
+        produced = output.size() - _deflater.avail_out;
+        if (_deflater.avail_out != 0)
+            break;
+
+        output.resize(output.size() * 2);
+    }
+
+    if (produced >= sizeof(deflateTail)
+        && memcmp(output.constData() + produced - sizeof(deflateTail),
+            deflateTail, sizeof(deflateTail)) == 0)
+    {
+        produced -= sizeof(deflateTail);
+    }
+
+    // Nothing left to flush (empty message) : send an empty stored block
+    if (produced == 0)
+        output[produced++] = 0x00;
+    output.resize((int)produced);
+
+    if (_params.serverNoContextTakeover)
+        deflateReset(&_deflater);
+
+    uint64_t elapsed = os_gettime_ns() - startTime;
+
+    QMutexLocker locker(&_statsMutex);
+    MessageStats& stats = _stats[QByteArray(messageType ? messageType : "")];
+    stats.count++;
+    stats.inputBytes += length;
+    stats.outputBytes += produced;
+    stats.totalTime += elapsed;
+
+    return true;
+}
+
+bool WSDeflate::Decompress(const char* data, size_t length, QByteArray& output,
+    size_t maxLength)
+{
+    if (!_inflaterReady)
+        return false;
+
+    size_t initialSize = qMax(length * 4, (size_t)256);
+    output.resize((int)qMin(initialSize, maxLength));
+    size_t produced = 0;
+
+    const char* inputs[2] = { data, deflateTail };
+    size_t inputLengths[2] = { length, sizeof(deflateTail) };
+
+    for (int i = 0; i < 2; i++) {
+        _inflater.next_in = (Bytef*)inputs[i];
+        _inflater.avail_in = (uInt)inputLengths[i];
+
+        for (;;) {
+            if (produced == (size_t)output.size()) {
+                // Refuse decompression bombs rather than growing forever
+                if ((size_t)output.size() >= maxLength)
+                    return false;
+
+                output.resize((int)qMin((size_t)output.size() * 2, maxLength));
+            }
+
+            _inflater.next_out = (Bytef*)output.data() + produced;
+            _inflater.avail_out = (uInt)(output.size() - produced);
+
+            int ret = inflate(&_inflater, Z_SYNC_FLUSH);
+            produced = output.size() - _inflater.avail_out;
+
+            if (ret == Z_STREAM_END) {
+                // The peer closed the deflate stream (BFINAL) : start over
+                inflateReset(&_inflater);
+                if (_inflater.avail_in == 0)
+                    break;
+                continue;
+            }
+
+            if (ret == Z_BUF_ERROR) {
+                if (_inflater.avail_in == 0)
+                    break;
+                if (_inflater.avail_out == 0)
+                    continue;
+                return false;
+            }
+
+            if (ret != Z_OK)
+                return false;
+
+            if (_inflater.avail_in == 0 && _inflater.avail_out != 0)
+                break;
+        }
+    }
+
+    output.resize((int)produced);
+
+    if (_params.clientNoContextTakeover)
+        inflateReset(&_inflater);
+
+    return true;
+}
+
+bool WSDeflate::Negotiate(const QByteArray& offers, DeflateParams& params,
+    QByteArray& response)
+{
+    // The client lists offers by order of preference : accept the first
+    // one we can honor (RFC 7692, section 5)
+    for (QByteArray offer : offers.split(',')) {
+        QList<QByteArray> parts = offer.split(';');
+        if (parts.takeFirst().trimmed() != "permessage-deflate")
+            continue;
+
+        DeflateParams candidate = { false, false, 15, 15 };
+        QByteArray accepted = "permessage-deflate";
+        QSet<QByteArray> seen;
+        bool valid = true;
+
+        for (QByteArray part : parts) {
+            part = part.trimmed();
+            if (part.isEmpty())
+                continue;
+
+            int separator = part.indexOf('=');
+            QByteArray name = (separator < 0 ? part : part.left(separator))
+                .trimmed();
+            QByteArray value = (separator < 0 ? QByteArray()
+                : part.mid(separator + 1).trimmed());
+
+            if (value.size() >= 2 && value.startsWith('"')
+                && value.endsWith('"'))
+            {
+                value = value.mid(1, value.size() - 2);
+            }
+
+            if (seen.contains(name)) {
+                valid = false;
+                break;
+            }
+            seen.insert(name);
+
+            bool ok = true;
+            if (name == "server_no_context_takeover" && value.isEmpty()) {
+                candidate.serverNoContextTakeover = true;
+                accepted += "; server_no_context_takeover";
+            }
+            else if (name == "client_no_context_takeover" && value.isEmpty()) {
+                candidate.clientNoContextTakeover = true;
+                accepted += "; client_no_context_takeover";
+            }
+            else if (name == "server_max_window_bits") {
+                // zlib cannot produce raw deflate data with a 256 bytes
+                // window, so 8 is declined
+                int bits = value.toInt(&ok);
+                if (!ok || bits < 9 || bits > 15) {
+                    valid = false;
+                    break;
+                }
+
+                candidate.serverMaxWindowBits = bits;
+                accepted += "; server_max_window_bits=" +
+                    QByteArray::number(bits);
+            }
+            else if (name == "client_max_window_bits") {
+                if (!value.isEmpty()) {
+                    int bits = value.toInt(&ok);
+                    if (!ok || bits < 8 || bits > 15) {
+                        valid = false;
+                        break;
+                    }
+                    candidate.clientMaxWindowBits = bits;
+                }
+            }
+            else {
+                valid = false;
+                break;
+            }
+        }
+
+        if (valid) {
+            params = candidate;
+            response = accepted;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WSDeflate::ShouldCompress(size_t length) {
+    Config* config = Config::Current();
+    return config->CompressionEnabled
+        && length >= config->CompressionThreshold;
+}
+
+obs_data_array_t* WSDeflate::GetStats() {
+    obs_data_array_t* result = obs_data_array_create();
+
+    QMutexLocker locker(&_statsMutex);
+    QHash<QByteArray, MessageStats>::const_iterator it;
+    for (it = _stats.constBegin(); it != _stats.constEnd(); ++it) {
+        const MessageStats& stats = it.value();
+
+        OBSDataAutoRelease item = obs_data_create();
+        obs_data_set_string(item, "message-type", it.key().constData());
+        obs_data_set_int(item, "count", stats.count);
+        obs_data_set_int(item, "input-bytes", stats.inputBytes);
+        obs_data_set_int(item, "output-bytes", stats.outputBytes);
+        obs_data_set_double(item, "ratio", stats.inputBytes ?
+            (double)stats.outputBytes / stats.inputBytes : 1.0);
+        obs_data_set_double(item, "total-time-ms",
+            (double)stats.totalTime / 1000000.0);
+        obs_data_array_push_back(result, item);
+    }
+
+    return result;
+}
@@ -0,0 +1,73 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSDEFLATE_H
+#define WSDEFLATE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include <zlib.h>
+#include <obs.hpp>
+
+// Parameters agreed on during the handshake (RFC 7692, section 7.1)
+struct DeflateParams {
+    bool serverNoContextTakeover;
+    bool clientNoContextTakeover;
+    int serverMaxWindowBits;
+    int clientMaxWindowBits;
+};
+
+// permessage-deflate codec for one connection. A connection owns one
+// instance, since the compression contexts carry over between messages
+// unless no_context_takeover was negotiated.
+class WSDeflate {
+  public:
+    WSDeflate(const DeflateParams& params, int level);
+    ~WSDeflate();
+
+    bool Compress(const char* data, size_t length, QByteArray& output,
+        const char* messageType);
+    bool Decompress(const char* data, size_t length, QByteArray& output,
+        size_t maxLength);
+
+    static bool Negotiate(const QByteArray& offers, DeflateParams& params,
+        QByteArray& response);
+    static bool ShouldCompress(size_t length);
+    static obs_data_array_t* GetStats();
+
+  private:
+    struct MessageStats {
+        uint64_t count;
+        uint64_t inputBytes;
+        uint64_t outputBytes;
+        uint64_t totalTime;
+    };
+
+    DeflateParams _params;
+    z_stream _deflater;
+    z_stream _inflater;
+    bool _deflaterReady;
+    bool _inflaterReady;
+
+    static QMutex _statsMutex;
+    static QHash<QByteArray, MessageStats> _stats;
+};
+
+#endif // WSDEFLATE_H
@@ -0,0 +1,228 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <new>
+
+#include "WSEventRing.h"
+#include "obs-websocket.h"
+
+#define EVENTRING_MIN_CAPACITY (64 * 1024ULL)
+#define EVENTRING_MAX_CAPACITY (1024 * 1024 * 1024ULL)
+
+// The data area starts on its own page, after the header
+#define EVENTRING_HEADER_SIZE 4096
+
+WSEventRing* WSEventRing::Instance = nullptr;
+
+static uint64_t roundCapacity(uint64_t capacity) {
+    uint64_t rounded = EVENTRING_MIN_CAPACITY;
+    while (rounded < capacity && rounded < EVENTRING_MAX_CAPACITY)
+        rounded <<= 1;
+    return rounded;
+}
+
+WSEventRing::WSEventRing()
+    : _header(nullptr),
+      _data(nullptr),
+      _mappingSize(0),
+      _position(0),
+      _sequence(0),
+      _oversized(0),
+      _wakes(0)
+{
+}
+
+WSEventRing::~WSEventRing() {
+    Stop();
+}
+
+#ifdef __linux__
+
+bool WSEventRing::Start(QString name, uint64_t capacity) {
+    Stop();
+
+    // Shared memory object names are a single path component
+    _name = "/" + name.toUtf8().replace('/', '_');
+    capacity = roundCapacity(capacity);
+
+    // Readers from a previous run keep their own (now unlinked) mapping
+    shm_unlink(_name.constData());
+
+    int fd = shm_open(_name.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        blog(LOG_ERROR, "event ring: shm_open(%s) failed: %s",
+            _name.constData(), strerror(errno));
+        return false;
+    }
+
+    _mappingSize = EVENTRING_HEADER_SIZE + capacity;
+    if (ftruncate(fd, _mappingSize) != 0) {
+        blog(LOG_ERROR, "event ring: cannot allocate %llu bytes: %s",
+            (unsigned long long)_mappingSize, strerror(errno));
+        close(fd);
+        shm_unlink(_name.constData());
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, _mappingSize,
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        blog(LOG_ERROR, "event ring: mmap failed: %s", strerror(errno));
+        shm_unlink(_name.constData());
+        return false;
+    }
+
+    // The object is zero-filled : construct the header in place, and
+    // only then make it recognizable to readers
+    _header = new (mapping) EventRingHeader();
+    _header->capacity = capacity;
+    _header->dataOffset = EVENTRING_HEADER_SIZE;
+    _header->version = EVENTRING_VERSION;
+    _header->open.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = EVENTRING_MAGIC;
+
+    _data = (char*)mapping + EVENTRING_HEADER_SIZE;
+    _position = 0;
+    _sequence = 0;
+    _oversized = 0;
+    _wakes = 0;
+
+    blog(LOG_INFO, "event ring: publishing events to /dev/shm%s (%llu KiB)",
+        _name.constData(), (unsigned long long)(capacity / 1024));
+    return true;
+}
+
+void WSEventRing::Stop() {
+    if (!_header)
+        return;
+
+    _header->open.store(0, std::memory_order_release);
+    _header->futexWord.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, &_header->futexWord, FUTEX_WAKE,
+        INT_MAX, nullptr, nullptr, 0);
+
+    munmap(_header, _mappingSize);
+    shm_unlink(_name.constData());
+
+    _header = nullptr;
+    _data = nullptr;
+}
+
+void WSEventRing::Publish(const char* payload, size_t length) {
+    if (!_header)
+        return;
+
+    // A record must leave room for the others, and for the padding
+    // needed to wrap around
+    uint64_t capacity = _header->capacity;
+    if (length > capacity / 4) {
+        _oversized++;
+        return;
+    }
+    uint64_t recordSize = EventRingRecordSize((uint32_t)length);
+
+    uint64_t offset = _position & (capacity - 1);
+    uint64_t padding = 0;
+    if (offset + recordSize > capacity)
+        padding = capacity - offset;
+
+    // Announce the overwrite before touching the data (seqlock-style)
+    _header->reserved.store(_position + padding + recordSize,
+        std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (padding) {
+        // Alignment guarantees room for a record header
+        EventRingRecord* marker = (EventRingRecord*)(_data + offset);
+        marker->sequence = 0;
+        marker->length = EVENTRING_PADDING;
+        marker->reserved = 0;
+
+        _position += padding;
+        offset = 0;
+    }
+
+    EventRingRecord* record = (EventRingRecord*)(_data + offset);
+    record->sequence = ++_sequence;
+    record->length = (uint32_t)length;
+    record->reserved = 0;
+    memcpy(record + 1, payload, length);
+
+    _position += recordSize;
+    _header->lastSequence.store(_sequence, std::memory_order_relaxed);
+    _header->published.store(_position, std::memory_order_release);
+
+    _header->futexWord.fetch_add(1, std::memory_order_release);
+    if (_header->waiters.load(std::memory_order_acquire) > 0) {
+        syscall(SYS_futex, &_header->futexWord, FUTEX_WAKE,
+            INT_MAX, nullptr, nullptr, 0);
+        _wakes++;
+    }
+}
+
+#else
+
+bool WSEventRing::Start(QString name, uint64_t capacity) {
+    Q_UNUSED(name);
+    Q_UNUSED(capacity);
+
+    blog(LOG_WARNING, "event ring: not supported on this platform");
+    return false;
+}
+
+void WSEventRing::Stop() {
+}
+
+void WSEventRing::Publish(const char* payload, size_t length) {
+    Q_UNUSED(payload);
+    Q_UNUSED(length);
+}
+
+#endif
+
+bool WSEventRing::IsActive() {
+    return (_header != nullptr);
+}
+
+obs_data_t* WSEventRing::GetStats() {
+    obs_data_t* stats = obs_data_create();
+    obs_data_set_bool(stats, "active", IsActive());
+    if (IsActive()) {
+        obs_data_set_string(stats, "name", _name.constData());
+        obs_data_set_int(stats, "capacity", _header->capacity);
+        obs_data_set_int(stats, "published", _sequence);
+        obs_data_set_int(stats, "oversized", _oversized);
+        obs_data_set_int(stats, "wakes", _wakes);
+    }
+    return stats;
+}
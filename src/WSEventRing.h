@@ -0,0 +1,56 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSEVENTRING_H
+#define WSEVENTRING_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <obs.hpp>
+
+#include "EventRing.h"
+
+// Publishes events to a shared memory ring (see EventRing.h) for local
+// consumers. There is a single writer, the main thread, and it never
+// waits for readers : slow readers detect that they were overrun.
+// Only available on Linux.
+class WSEventRing {
+  public:
+    WSEventRing();
+    ~WSEventRing();
+    bool Start(QString name, uint64_t capacity);
+    void Stop();
+    bool IsActive();
+    void Publish(const char* payload, size_t length);
+    obs_data_t* GetStats();
+
+    static WSEventRing* Instance;
+
+  private:
+    QByteArray _name;
+    EventRingHeader* _header;
+    char* _data;
+    size_t _mappingSize;
+    uint64_t _position;
+    uint64_t _sequence;
+    uint64_t _oversized;
+    uint64_t _wakes;
+};
+
+#endif // WSEVENTRING_H
@@ -18,6 +18,7 @@
  */
 
 #include <util/platform.h>
+#include <string.h>
 
 #include <QTimer>
 #include <QPushButton>
@@ -25,6 +26,9 @@
 #include "Config.h"
 #include "Utils.h"
 #include "WSEvents.h"
+#include "WSDebugLog.h"
+#include "WSWatchdog.h"
+#include "WSEventRing.h"
 
 #include "obs-websocket.h"
 
@@ -39,23 +43,6 @@ bool transitionIsCut(obs_source_t* transition) {
     return false;
 }
 
-const char* nsToTimestamp(uint64_t ns) {
-    uint64_t ms = ns / (1000 * 1000);
-    uint64_t secs = ms / 1000;
-    uint64_t minutes = secs / 60;
-
-    uint64_t hoursPart = minutes / 60;
-    uint64_t minutesPart = minutes % 60;
-    uint64_t secsPart = secs % 60;
-    uint64_t msPart = ms % 1000;
-
-    char* ts = (char*)bmalloc(64);
-    sprintf(ts, "%02d:%02d:%02d.%03d",
-        hoursPart, minutesPart, secsPart, msPart);
-
-    return ts;
-}
-
 void* calldata_get_ptr(const calldata_t* data, const char* name) {
     void* ptr = nullptr;
     calldata_get_ptr(data, name, &ptr);
@@ -67,6 +54,8 @@ WSEvents* WSEvents::Instance = nullptr;
 WSEvents::WSEvents(WSServer* srv) {
     _srv = srv;
     obs_frontend_add_event_callback(WSEvents::FrontendEventHandler, this);
+    signal_handler_connect(obs_get_signal_handler(),
+        "source_rename", OnSourceRename, this);
 
     QSpinBox* durationControl = Utils::GetTransitionDurationControl();
     connect(durationControl, SIGNAL(valueChanged(int)),
@@ -75,11 +64,19 @@ WSEvents::WSEvents(WSServer* srv) {
     QTimer* statusTimer = new QTimer();
     connect(statusTimer, SIGNAL(timeout()),
         this, SLOT(StreamStatus()));
-    pulse = false;
-    connect(statusTimer, SIGNAL(timeout()),
-        this, SLOT(Heartbeat()));
     statusTimer->start(2000); // equal to frontend's constant BITRATE_UPDATE_SECONDS
 
+    // Each client has its own heartbeat interval, a multiple of the tick
+    QTimer* heartbeatTimer = new QTimer(this);
+    connect(heartbeatTimer, SIGNAL(timeout()),
+        this, SLOT(Heartbeat()));
+    heartbeatTimer->start(HEARTBEAT_TICK);
+
+    if (WSWatchdog::Instance) {
+        connect(WSWatchdog::Instance, SIGNAL(stallDetected(quint64, QStringList)),
+            this, SLOT(MainThreadStall(quint64, QStringList)));
+    }
+
     QListWidget* sceneList = Utils::GetSceneListControl();
     connect(sceneList, SIGNAL(currentItemChanged(QListWidgetItem*, QListWidgetItem*)),
         this, SLOT(SelectedSceneChanged(QListWidgetItem*, QListWidgetItem*)));
@@ -89,7 +86,6 @@ WSEvents::WSEvents(WSServer* srv) {
 
     QTimer::singleShot(1000, this, SLOT(deferredInitOperations()));
 
-    HeartbeatIsActive = false;
 
     _streamingActive = false;
     _recordingActive = false;
@@ -100,6 +96,8 @@ WSEvents::WSEvents(WSServer* srv) {
 
 WSEvents::~WSEvents() {
     obs_frontend_remove_event_callback(WSEvents::FrontendEventHandler, this);
+    signal_handler_disconnect(obs_get_signal_handler(),
+        "source_rename", OnSourceRename, this);
 }
 
 void WSEvents::deferredInitOperations() {
@@ -116,6 +114,8 @@ void WSEvents::FrontendEventHandler(enum obs_frontend_event event, void* private
     if (!owner->_srv)
         return;
 
+    WSActivityScope activity("FrontendEventHandler");
+
     if (event == OBS_FRONTEND_EVENT_SCENE_CHANGED) {
         owner->OnSceneChange();
     }
@@ -196,18 +196,30 @@ void WSEvents::FrontendEventHandler(enum obs_frontend_event event, void* private
 void WSEvents::broadcastUpdate(const char* updateType,
     obs_data_t* additionalFields = nullptr)
 {
-    OBSDataAutoRelease update = obs_data_create();
+    WSActivityScope activity(updateType);
+    uint64_t startTime = os_gettime_ns();
+
+    OBSDataAutoRelease update = createUpdate(updateType, additionalFields);
+    uint64_t sentBytes = _srv->broadcast(update);
+
+    recordUpdate(updateType, update, startTime, sentBytes);
+}
+
+obs_data_t* WSEvents::createUpdate(const char* updateType,
+    obs_data_t* additionalFields)
+{
+    obs_data_t* update = obs_data_create();
     obs_data_set_string(update, "update-type", updateType);
 
     const char* ts = nullptr;
     if (_streamingActive) {
-        ts = nsToTimestamp(os_gettime_ns() - _streamStarttime);
+        ts = Utils::nsToTimestamp(os_gettime_ns() - _streamStarttime);
         obs_data_set_string(update, "stream-timecode", ts);
         bfree((void*)ts);
     }
 
     if (_recordingActive) {
-        ts = nsToTimestamp(os_gettime_ns() - _recStarttime);
+        ts = Utils::nsToTimestamp(os_gettime_ns() - _recStarttime);
         obs_data_set_string(update, "rec-timecode", ts);
         bfree((void*)ts);
     }
@@ -215,11 +227,50 @@ void WSEvents::broadcastUpdate(const char* updateType,
     if (additionalFields)
         obs_data_apply(update, additionalFields);
 
-    QString json = obs_data_get_json(update);
-    _srv->broadcast(json);
+    return update;
+}
 
-    if (Config::Current()->DebugEnabled)
-        blog(LOG_DEBUG, "Update << '%s'", json.toUtf8().constData());
+// Publishes a sent update to the event ring and the debug log, and counts
+// it in the broadcast stats
+void WSEvents::recordUpdate(const char* updateType, obs_data_t* update,
+    uint64_t startTime, uint64_t sentBytes)
+{
+    WSEventRing* eventRing = WSEventRing::Instance;
+    if (eventRing && eventRing->IsActive()) {
+        const char* json = obs_data_get_json(update);
+        eventRing->Publish(json, strlen(json));
+    }
+
+    uint64_t elapsed = os_gettime_ns() - startTime;
+
+    QMutexLocker locker(&_broadcastStatsMutex);
+    WSBroadcastStats& stats = _broadcastStats[updateType];
+    stats.count++;
+    stats.totalTime += elapsed;
+    stats.totalBytes += sentBytes;
+    locker.unlock();
+
+    if (Config::Current()->DebugEnabled) {
+        WSDebugLog* debugLog = WSDebugLog::Current();
+        if (debugLog->ShouldSample(updateType)) {
+            const char* json = obs_data_get_json(update);
+            debugLog->Log(WSDebugLog::Update, json, strlen(json));
+        }
+    }
+}
+
+QHash<QString, WSBroadcastStats> WSEvents::GetBroadcastStats() {
+    QHash<QString, WSBroadcastStats> result;
+
+    QMutexLocker locker(&_broadcastStatsMutex);
+    QHash<const char*, WSBroadcastStats>::const_iterator it;
+    for (it = _broadcastStats.constBegin();
+        it != _broadcastStats.constEnd(); ++it)
+    {
+        result.insert(it.key(), it.value());
+    }
+
+    return result;
 }
 
 void WSEvents::connectTransitionSignals(obs_source_t* transition) {
@@ -287,7 +338,7 @@ uint64_t WSEvents::GetStreamingTime() {
 }
 
 const char* WSEvents::GetStreamingTimecode() {
-    return nsToTimestamp(GetStreamingTime());
+    return Utils::nsToTimestamp(GetStreamingTime());
 }
 
 uint64_t WSEvents::GetRecordingTime() {
@@ -298,7 +349,7 @@ uint64_t WSEvents::GetRecordingTime() {
 }
 
 const char* WSEvents::GetRecordingTimecode() {
-    return nsToTimestamp(GetRecordingTime());
+    return Utils::nsToTimestamp(GetRecordingTime());
 }
 
  /**
@@ -626,6 +677,8 @@ void WSEvents::OnExit() {
  * @since 0.3
  */
 void WSEvents::StreamStatus() {
+    WSActivityScope activity("StreamStatus");
+
     bool streamingActive = obs_frontend_streaming_active();
     bool recordingActive = obs_frontend_recording_active();
 
@@ -677,16 +730,18 @@ void WSEvents::StreamStatus() {
 }
 
 /**
- * Emitted every 2 seconds after enabling it by calling SetHeartbeat.
+ * Emitted to the clients that enabled it by calling SetHeartbeat, at the
+ * interval they chose (every 2 seconds by default). Optional fields are
+ * only included when the client asked for their group.
  * 
  * @return {boolean} `pulse` Toggles between every JSON meassage as an "I am alive" indicator.
- * @return {string (optional)} `current-profile` Current active profile.
- * @return {string (optional)} `current-scene` Current active scene.
- * @return {boolean (optional)} `streaming` Current streaming state.
+ * @return {string (optional)} `current-profile` Current active profile (`profile` group).
+ * @return {string (optional)} `current-scene` Current active scene (`scene` group).
+ * @return {boolean (optional)} `streaming` Current streaming state (`streaming` group).
  * @return {int (optional)} `total-stream-time` Total time (in seconds) since the stream started.
  * @return {int (optional)} `total-stream-bytes` Total bytes sent since the stream started.
  * @return {int (optional)} `total-stream-frames` Total frames streamed since the stream started.
- * @return {boolean (optional)} `recording` Current recording state.
+ * @return {boolean (optional)} `recording` Current recording state (`recording` group).
  * @return {int (optional)} `total-record-time` Total time (in seconds) since recording started.
  * @return {int (optional)} `total-record-bytes` Total bytes recorded since the recording started.
  * @return {int (optional)} `total-record-frames` Total frames recorded since the recording started.
@@ -696,41 +751,69 @@ void WSEvents::StreamStatus() {
  * @category general
  */
 void WSEvents::Heartbeat() {
+    uint64_t startTime = os_gettime_ns();
 
-    if (!HeartbeatIsActive) return;
+    // One sampling pass for all the clients due on this tick, limited to
+    // the fields they asked for
+    int fields = _srv->dueHeartbeats(startTime);
+    if (!fields) return;
 
-    bool streamingActive = obs_frontend_streaming_active();
-    bool recordingActive = obs_frontend_recording_active();
+    WSActivityScope activity("Heartbeat");
 
-    OBSDataAutoRelease data = obs_data_create();
-    OBSOutputAutoRelease recordOutput = obs_frontend_get_recording_output();
-    OBSOutputAutoRelease streamOutput = obs_frontend_get_streaming_output();
-
-    pulse = !pulse;
-    obs_data_set_bool(data, "pulse", pulse);
+    OBSDataAutoRelease groups[HEARTBEAT_FIELD_GROUPS];
+    for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++) {
+        if (fields & (1 << i))
+            groups[i] = obs_data_create();
+    }
 
-    obs_data_set_string(data, "current-profile", obs_frontend_get_current_profile());
+    if (fields & HeartbeatProfile) {
+        obs_data_set_string(groups[0], "current-profile",
+            obs_frontend_get_current_profile());
+    }
 
-    OBSSourceAutoRelease currentScene = obs_frontend_get_current_scene();
-    obs_data_set_string(data, "current-scene", obs_source_get_name(currentScene));
+    if (fields & HeartbeatScene) {
+        OBSSourceAutoRelease currentScene = obs_frontend_get_current_scene();
+        obs_data_set_string(groups[1], "current-scene",
+            obs_source_get_name(currentScene));
+    }
 
-    obs_data_set_bool(data, "streaming", streamingActive);
-    if (streamingActive) {
-        uint64_t totalStreamTime = (os_gettime_ns() - _streamStarttime) / 1000000000;
-        obs_data_set_int(data, "total-stream-time", totalStreamTime);
-        obs_data_set_int(data, "total-stream-bytes", (uint64_t)obs_output_get_total_bytes(streamOutput));
-        obs_data_set_int(data, "total-stream-frames", obs_output_get_total_frames(streamOutput));
+    if (fields & HeartbeatStreaming) {
+        bool streamingActive = obs_frontend_streaming_active();
+        obs_data_set_bool(groups[2], "streaming", streamingActive);
+        if (streamingActive) {
+            OBSOutputAutoRelease streamOutput = obs_frontend_get_streaming_output();
+            uint64_t totalStreamTime = (os_gettime_ns() - _streamStarttime) / 1000000000;
+            obs_data_set_int(groups[2], "total-stream-time", totalStreamTime);
+            obs_data_set_int(groups[2], "total-stream-bytes", (uint64_t)obs_output_get_total_bytes(streamOutput));
+            obs_data_set_int(groups[2], "total-stream-frames", obs_output_get_total_frames(streamOutput));
+        }
     }
 
-    obs_data_set_bool(data, "recording", recordingActive);
-    if (recordingActive) {
-        uint64_t totalRecordTime = (os_gettime_ns() - _recStarttime) / 1000000000;
-        obs_data_set_int(data, "total-record-time", totalRecordTime);
-        obs_data_set_int(data, "total-record-bytes", (uint64_t)obs_output_get_total_bytes(recordOutput));
-        obs_data_set_int(data, "total-record-frames", obs_output_get_total_frames(recordOutput));
+    if (fields & HeartbeatRecording) {
+        bool recordingActive = obs_frontend_recording_active();
+        obs_data_set_bool(groups[3], "recording", recordingActive);
+        if (recordingActive) {
+            OBSOutputAutoRelease recordOutput = obs_frontend_get_recording_output();
+            uint64_t totalRecordTime = (os_gettime_ns() - _recStarttime) / 1000000000;
+            obs_data_set_int(groups[3], "total-record-time", totalRecordTime);
+            obs_data_set_int(groups[3], "total-record-bytes", (uint64_t)obs_output_get_total_bytes(recordOutput));
+            obs_data_set_int(groups[3], "total-record-frames", obs_output_get_total_frames(recordOutput));
+        }
     }
 
-    broadcastUpdate("Heartbeat", data);
+    OBSDataAutoRelease update = createUpdate("Heartbeat", nullptr);
+
+    obs_data_t* sampled[HEARTBEAT_FIELD_GROUPS];
+    for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++)
+        sampled[i] = groups[i];
+    uint64_t sentBytes = _srv->sendHeartbeats(startTime, update, sampled);
+
+    // The event ring and the debug log see every sampled field
+    for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++) {
+        if (groups[i])
+            obs_data_apply(update, groups[i]);
+    }
+    recordUpdate("Heartbeat", update, startTime, sentBytes);
 }
 
 /**
@@ -762,6 +845,8 @@ void WSEvents::TransitionDurationChanged(int ms) {
  * @since 4.0.0
  */
 void WSEvents::OnTransitionBegin(void* param, calldata_t* data) {
+    WSActivityScope activity("OnTransitionBegin");
+
     UNUSED_PARAMETER(data);
     WSEvents* instance = static_cast<WSEvents*>(param);
 
@@ -786,6 +871,8 @@ void WSEvents::OnTransitionBegin(void* param, calldata_t* data) {
  * @since 4.0.0
  */
 void WSEvents::OnSceneReordered(void* param, calldata_t* data) {
+    WSActivityScope activity("OnSceneReordered");
+
     WSEvents* instance = static_cast<WSEvents*>(param);
 
     obs_scene_t* scene = nullptr;
@@ -810,6 +897,8 @@ void WSEvents::OnSceneReordered(void* param, calldata_t* data) {
  * @since 4.0.0
  */
 void WSEvents::OnSceneItemAdd(void* param, calldata_t* data) {
+    WSActivityScope activity("OnSceneItemAdd");
+
     WSEvents* instance = static_cast<WSEvents*>(param);
 
     obs_scene_t* scene = nullptr;
@@ -842,6 +931,8 @@ void WSEvents::OnSceneItemAdd(void* param, calldata_t* data) {
  * @since 4.0.0
  */
 void WSEvents::OnSceneItemDelete(void* param, calldata_t* data) {
+    WSActivityScope activity("OnSceneItemDelete");
+
     WSEvents* instance = static_cast<WSEvents*>(param);
 
     obs_scene_t* scene = nullptr;
@@ -875,6 +966,8 @@ void WSEvents::OnSceneItemDelete(void* param, calldata_t* data) {
  * @since 4.0.0
  */
 void WSEvents::OnSceneItemVisibilityChanged(void* param, calldata_t* data) {
+    WSActivityScope activity("OnSceneItemVisibilityChanged");
+
     WSEvents* instance = static_cast<WSEvents*>(param);
 
     obs_scene_t* scene = nullptr;
@@ -943,3 +1036,40 @@ void WSEvents::OnStudioModeSwitched(bool checked) {
 
     broadcastUpdate("StudioModeSwitched", data);
 }
+
+/**
+ * The OBS main thread, which runs requests, events and the OBS user interface,
+ * has been unresponsive for longer than the configured threshold. Emitted once
+ * the main thread is responsive again.
+ *
+ * @return {int} `lag-ms` How long the main thread was unresponsive (in milliseconds).
+ * @return {String} `activities` What obs-websocket was executing on the main thread during the stall (request types, update types or callbacks), formatted as a comma-separated list string. Empty if the stall happened outside of obs-websocket.
+ *
+ * @api events
+ * @name MainThreadStall
+ * @category other
+ * @since 5.0.0
+ */
+void WSEvents::MainThreadStall(quint64 lagMs, QStringList activities) {
+    OBSDataAutoRelease fields = obs_data_create();
+    obs_data_set_int(fields, "lag-ms", lagMs);
+    obs_data_set_string(fields, "activities",
+        activities.join(",").toUtf8().constData());
+
+    broadcastUpdate("MainThreadStall", fields);
+}
+
+void WSEvents::OnSourceRename(void* param, calldata_t* data) {
+    WSActivityScope activity("OnSourceRename");
+
+    WSEvents* instance = static_cast<WSEvents*>(param);
+
+    const char* newName = calldata_string(data, "new_name");
+    const char* previousName = calldata_string(data, "prev_name");
+    if (!instance->_srv || !newName || !previousName)
+        return;
+
+    // Clients interning names are sent the handle's new name
+    instance->_srv->renameInterned(QString::fromUtf8(previousName),
+        QString::fromUtf8(newName));
+}
@@ -22,9 +22,18 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include <obs.hpp>
 #include <obs-frontend-api.h>
+#include <QHash>
 #include <QListWidgetItem>
+#include <QMutex>
+#include <QStringList>
 #include "WSServer.h"
 
+struct WSBroadcastStats {
+    uint64_t count;
+    uint64_t totalTime;
+    uint64_t totalBytes;
+};
+
 class WSEvents : public QObject {
   Q_OBJECT
   public:
@@ -41,7 +50,7 @@ class WSEvents : public QObject {
     uint64_t GetRecordingTime();
     const char* GetRecordingTimecode();
 
-    bool HeartbeatIsActive;
+    QHash<QString, WSBroadcastStats> GetBroadcastStats();
 
   private slots:
     void deferredInitOperations();
@@ -50,14 +59,13 @@ class WSEvents : public QObject {
     void TransitionDurationChanged(int ms);
     void SelectedSceneChanged(
         QListWidgetItem* current, QListWidgetItem* prev);
+    void MainThreadStall(quint64 lagMs, QStringList activities);
 
   private:
     WSServer* _srv;
     OBSSource currentScene;
     OBSSource currentTransition;
 
-    bool pulse;
-
     bool _streamingActive;
     bool _recordingActive;
 
@@ -67,8 +75,16 @@ class WSEvents : public QObject {
     uint64_t _lastBytesSent;
     uint64_t _lastBytesSentTime;
 
+    // Keyed by update type literal
+    QHash<const char*, WSBroadcastStats> _broadcastStats;
+    QMutex _broadcastStatsMutex;
+
     void broadcastUpdate(const char* updateType,
         obs_data_t* additionalFields);
+    obs_data_t* createUpdate(const char* updateType,
+        obs_data_t* additionalFields);
+    void recordUpdate(const char* updateType, obs_data_t* update,
+        uint64_t startTime, uint64_t sentBytes);
 
     void OnSceneChange();
     void OnSceneListChange();
@@ -106,6 +122,8 @@ class WSEvents : public QObject {
     static void OnSceneItemAdd(void* param, calldata_t* data);
     static void OnSceneItemDelete(void* param, calldata_t* data);
     static void OnSceneItemVisibilityChanged(void* param, calldata_t* data);
+
+    static void OnSourceRename(void* param, calldata_t* data);
 };
 
 #endif // WSEVENTS_H
\ No newline at end of file
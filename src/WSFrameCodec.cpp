@@ -0,0 +1,208 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WS_CODEC_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WS_CODEC_NEON
+#endif
+
+#include "WSFrameCodec.h"
+
+size_t WSFrameCodec::ParseHeader(const char* data, size_t length,
+    WSFrameHeader& header)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (length < 2)
+        return 0;
+
+    header.fin = (bytes[0] & 0x80) != 0;
+    header.rsv1 = (bytes[0] & 0x40) != 0;
+    header.rsv2 = (bytes[0] & 0x20) != 0;
+    header.rsv3 = (bytes[0] & 0x10) != 0;
+    header.opcode = bytes[0] & 0x0f;
+    header.masked = (bytes[1] & 0x80) != 0;
+
+    size_t size = 2;
+    uint64_t payloadLength = bytes[1] & 0x7f;
+    if (payloadLength == 126) {
+        if (length < 4)
+            return 0;
+        payloadLength = ((uint64_t)bytes[2] << 8) | bytes[3];
+        size = 4;
+    }
+    else if (payloadLength == 127) {
+        if (length < 10)
+            return 0;
+        payloadLength = 0;
+        for (int i = 2; i < 10; i++)
+            payloadLength = (payloadLength << 8) | bytes[i];
+        size = 10;
+    }
+    header.length = payloadLength;
+
+    if (header.masked) {
+        if (length < size + 4)
+            return 0;
+        memcpy(header.mask, bytes + size, 4);
+        size += 4;
+    }
+
+    return size;
+}
+
+size_t WSFrameCodec::WriteHeader(char* output, uint8_t opcode,
+    bool compressed, uint64_t payloadLength)
+{
+    uint8_t* bytes = (uint8_t*)output;
+    bytes[0] = 0x80 | (compressed ? 0x40 : 0x00) | (opcode & 0x0f);
+
+    if (payloadLength < 126) {
+        bytes[1] = (uint8_t)payloadLength;
+        return 2;
+    }
+
+    if (payloadLength <= 0xffff) {
+        bytes[1] = 126;
+        bytes[2] = (uint8_t)(payloadLength >> 8);
+        bytes[3] = (uint8_t)payloadLength;
+        return 4;
+    }
+
+    bytes[1] = 127;
+    for (int i = 0; i < 8; i++)
+        bytes[2 + i] = (uint8_t)(payloadLength >> (56 - i * 8));
+    return 10;
+}
+
+void WSFrameCodec::Unmask(char* data, size_t length, const uint8_t mask[4]) {
+    uint8_t* bytes = (uint8_t*)data;
+    size_t i = 0;
+
+    // The mask repeats every 4 bytes, so any multiple of 4 can be xored
+    // at once with the mask repeated to the same width
+    uint8_t wideMask[16];
+    for (int j = 0; j < 16; j++)
+        wideMask[j] = mask[j & 3];
+
+#if defined(WS_CODEC_SSE2)
+    __m128i maskVector = _mm_loadu_si128((const __m128i*)wideMask);
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(bytes + i));
+        _mm_storeu_si128((__m128i*)(bytes + i),
+            _mm_xor_si128(chunk, maskVector));
+    }
+#elif defined(WS_CODEC_NEON)
+    uint8x16_t maskVector = vld1q_u8(wideMask);
+    for (; i + 16 <= length; i += 16)
+        vst1q_u8(bytes + i, veorq_u8(vld1q_u8(bytes + i), maskVector));
+#endif
+
+    uint64_t maskWord;
+    memcpy(&maskWord, wideMask, sizeof(maskWord));
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        word ^= maskWord;
+        memcpy(bytes + i, &word, sizeof(word));
+    }
+
+    for (; i < length; i++)
+        bytes[i] ^= mask[i & 3];
+}
+
+bool WSFrameCodec::IsValidUtf8(const char* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + length;
+
+    while (p < end) {
+        // Messages are mostly ASCII : skip it 16 bytes at a time
+#if defined(WS_CODEC_SSE2)
+        while (end - p >= 16
+            && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p)) == 0)
+        {
+            p += 16;
+        }
+#elif defined(WS_CODEC_NEON) && defined(__aarch64__)
+        while (end - p >= 16 && vmaxvq_u8(vld1q_u8(p)) < 0x80)
+            p += 16;
+#endif
+
+        // 8 bytes at a time for the rest
+        while (end - p >= 8) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            if (word & 0x8080808080808080ULL)
+                break;
+            p += 8;
+        }
+
+        if (p >= end)
+            break;
+
+        uint8_t lead = *p;
+        if (lead < 0x80) {
+            p++;
+            continue;
+        }
+
+        // Well-formed sequences, from the Unicode standard (table 3-7) :
+        // no overlong forms, no surrogates, nothing above U+10FFFF
+        int continuations;
+        uint8_t low = 0x80, high = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            continuations = 1;
+        }
+        else if (lead >= 0xe0 && lead <= 0xef) {
+            continuations = 2;
+            if (lead == 0xe0)
+                low = 0xa0;
+            else if (lead == 0xed)
+                high = 0x9f;
+        }
+        else if (lead >= 0xf0 && lead <= 0xf4) {
+            continuations = 3;
+            if (lead == 0xf0)
+                low = 0x90;
+            else if (lead == 0xf4)
+                high = 0x8f;
+        }
+        else {
+            return false;
+        }
+
+        if (end - p <= continuations)
+            return false;
+
+        // Only the first continuation byte has a narrower range
+        if (p[1] < low || p[1] > high)
+            return false;
+        for (int i = 2; i <= continuations; i++) {
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+        }
+
+        p += continuations + 1;
+    }
+
+    return true;
+}
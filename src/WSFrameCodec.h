@@ -0,0 +1,64 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSFRAMECODEC_H
+#define WSFRAMECODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest header of a server (unmasked) frame
+#define WS_MAX_SERVER_HEADER 10
+
+struct WSFrameHeader {
+    bool fin;
+    bool rsv1;
+    bool rsv2;
+    bool rsv3;
+    uint8_t opcode;
+    bool masked;
+    uint8_t mask[4];
+    uint64_t length;
+};
+
+// WebSocket frame encoding and decoding (RFC 6455, section 5), for
+// transports that own the framing
+class WSFrameCodec {
+  public:
+    enum Opcode {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xA
+    };
+
+    // Returns the size of the header, or 0 if more data is needed
+    static size_t ParseHeader(const char* data, size_t length,
+        WSFrameHeader& header);
+
+    // Writes the header of an unmasked frame, returns its size
+    static size_t WriteHeader(char* output, uint8_t opcode, bool compressed,
+        uint64_t payloadLength);
+
+    static void Unmask(char* data, size_t length, const uint8_t mask[4]);
+    static bool IsValidUtf8(const char* data, size_t length);
+};
+
+#endif // WSFRAMECODEC_H
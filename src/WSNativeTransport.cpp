@@ -0,0 +1,1556 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "WSNativeTransport.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QHostAddress>
+#include <QtWebSockets/QWebSocketProtocol>
+#include <mbedtls/sha1.h>
+
+#include "WSFrameCodec.h"
+#include "WSDeflate.h"
+#include "WSTls.h"
+#include "MsgPack.h"
+#include "Config.h"
+#include "Utils.h"
+#include "obs-websocket.h"
+
+#define NATIVE_MAX_HANDSHAKE 8192
+#define NATIVE_MAX_MESSAGE (16 * 1024 * 1024)
+#define NATIVE_MAX_EVENTS 256
+#define NATIVE_MAX_IOVECS 128
+#define NATIVE_READ_SIZE (64 * 1024)
+
+// Time (in milliseconds) a connection has to complete its TLS and HTTP
+// upgrade handshakes, before it is closed
+#define NATIVE_HANDSHAKE_TIMEOUT 5000
+
+// epoll tags of the two fixed descriptors. Connection ids come after.
+#define NATIVE_TAG_LISTEN 0
+#define NATIVE_TAG_WAKEUP 1
+
+static const char websocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+struct NativeCommand {
+    enum Type {
+        Send,
+        Close,
+        Ping,
+        Abort
+    };
+
+    Type type;
+    quint64 connection;
+    QByteArray payload; // Message, or close reason
+    QByteArray messageType; // Request or event type of a message
+    bool binary;
+    bool deferrable;
+    quint16 closeCode;
+};
+
+struct NativeChunk {
+    QByteArray data;
+
+    // Released from the connection's queued bytes once written
+    uint64_t accounted;
+};
+
+struct NativeConnection {
+    int fd;
+    quint64 id;
+    QString ip;
+    quint16 port;
+    int encoding;
+
+    bool upgraded;
+    bool closing; // Close frame sent : input is ignored
+    bool closed;
+    bool writable; // Until a write hits EAGAIN
+    bool dirty; // Has output to flush this iteration
+    bool deferred; // Has output held back until the batch deadline
+
+    QByteArray input;
+    std::deque<NativeChunk> output;
+    size_t outputOffset;
+
+    // Message being reassembled from fragments
+    int messageOpcode;
+    bool messageCompressed;
+    QByteArray message;
+
+    std::unique_ptr<WSDeflate> deflate;
+    std::shared_ptr<std::atomic<uint64_t>> queued;
+
+    // Output is encrypted as soon as it is flushed : its queued bytes are
+    // only released once the ciphertext is written
+    std::unique_ptr<WSTlsSession> tls;
+    uint64_t tlsAccounted;
+};
+
+class WSNativeLoop : public QThread {
+  public:
+    WSNativeLoop(WSNativeTransport* transport,
+        const std::shared_ptr<WSTlsContext>& tls);
+    ~WSNativeLoop();
+
+    bool Bind(quint16 port, QString& error);
+    void Post(const NativeCommand& command);
+    void Stop();
+    void GetStats(obs_data_t* stats);
+    void GetTlsStats(WSTlsStats& stats);
+
+  protected:
+    void run() override;
+
+  private:
+    void acceptConnections();
+    void expireHandshakes(uint64_t now);
+    void readConnection(NativeConnection* c, bool hangup);
+    bool receiveTls(NativeConnection* c, const char* data, size_t size);
+    void tlsFailed(NativeConnection* c);
+    void processHandshake(NativeConnection* c);
+    void rejectHandshake(NativeConnection* c, const char* status,
+        const char* extraHeaders = "");
+    void processFrames(NativeConnection* c);
+    void handleFrame(NativeConnection* c, const WSFrameHeader& header,
+        const char* payload);
+    void finishMessage(NativeConnection* c);
+    void processCommands(bool release);
+    void sendMessage(NativeConnection* c, const QByteArray& payload,
+        bool binary, const QByteArray& messageType, bool deferred);
+    void queueRaw(NativeConnection* c, const QByteArray& data,
+        uint64_t accounted, bool deferred = false);
+    void queueFrame(NativeConnection* c, uint8_t opcode,
+        const QByteArray& payload, bool compressed, uint64_t accounted,
+        bool deferred = false);
+    void queueClose(NativeConnection* c, quint16 code,
+        const QByteArray& reason);
+    void markDirty(NativeConnection* c);
+    void markDeferred(NativeConnection* c);
+    void releaseDeferred();
+    void flush(NativeConnection* c);
+    void flushTls(NativeConnection* c);
+    void flushDirty();
+    void closeConnection(NativeConnection* c);
+
+    WSNativeTransport* _transport;
+    std::shared_ptr<WSTlsContext> _tls;
+    int _listenFd;
+    int _epollFd;
+    int _wakeFd;
+    std::atomic<bool> _stopping;
+
+    QMutex _commandsMutex;
+    std::vector<NativeCommand> _commands;
+    bool _wakePending;
+
+    // Set while a batch deadline is pending : deferrable sends don't
+    // wake the loop, they are picked up at the deadline
+    bool _batchArmed;
+
+    QHash<quint64, NativeConnection*> _connections;
+    std::vector<NativeConnection*> _dirty;
+    std::vector<NativeConnection*> _deferred;
+    uint64_t _flushDeadline; // 0 when nothing is deferred
+    std::vector<NativeConnection*> _graveyard;
+
+    // Connections not upgraded yet, in the order they were accepted, with
+    // their handshake deadline
+    std::deque<std::pair<quint64, uint64_t>> _handshakes;
+    QVector<WSNativeEvent> _pendingEvents;
+    std::vector<char> _readBuffer;
+    quint64 _nextId;
+
+    // Read from the main thread's config once, when listening starts
+    uint64_t _maxConnections; // 0 if unlimited
+    bool _compression;
+    uint64_t _compressionThreshold;
+    int _compressionLevel;
+    uint64_t _batchDelay; // ns
+
+    std::atomic<uint64_t> _connectionCount;
+    std::atomic<uint64_t> _accepted;
+    std::atomic<uint64_t> _refused;
+    std::atomic<uint64_t> _handshakeTimeouts;
+    std::atomic<uint64_t> _wakeups;
+    std::atomic<uint64_t> _reads;
+    std::atomic<uint64_t> _writes;
+    std::atomic<uint64_t> _framesIn;
+    std::atomic<uint64_t> _framesOut;
+    std::atomic<uint64_t> _bytesIn;
+    std::atomic<uint64_t> _bytesOut;
+    std::atomic<uint64_t> _messagesIn;
+    std::atomic<uint64_t> _messagesOut;
+    std::atomic<uint64_t> _syscalls;
+
+    std::atomic<uint64_t> _tlsHandshakes;
+    std::atomic<uint64_t> _tlsResumed;
+    std::atomic<uint64_t> _tlsErrors;
+    QMutex _tlsMutex;
+    QString _tlsLastError;
+    QHash<QString, uint64_t> _tlsProtocols;
+};
+
+static QByteArray acceptKey(const QByteArray& key) {
+    QByteArray input = key + websocketGuid;
+
+    unsigned char digest[20];
+    mbedtls_sha1((const unsigned char*)input.constData(), input.size(),
+        digest);
+
+    return QByteArray((const char*)digest, sizeof(digest)).toBase64();
+}
+
+// True if a comma-separated header value has the token (case-insensitive)
+static bool hasToken(const QByteArray& value, const char* token) {
+    for (QByteArray item : value.split(',')) {
+        if (item.trimmed().toLower() == token)
+            return true;
+    }
+    return false;
+}
+
+WSNativeLoop::WSNativeLoop(WSNativeTransport* transport,
+    const std::shared_ptr<WSTlsContext>& tls)
+    : _transport(transport),
+      _tls(tls),
+      _listenFd(-1),
+      _epollFd(-1),
+      _wakeFd(-1),
+      _stopping(false),
+      _wakePending(false),
+      _batchArmed(false),
+      _flushDeadline(0),
+      _readBuffer(NATIVE_READ_SIZE),
+      _nextId(NATIVE_TAG_WAKEUP + 1),
+      _maxConnections(0),
+      _compression(false),
+      _compressionThreshold(0),
+      _compressionLevel(0),
+      _batchDelay(0),
+      _connectionCount(0),
+      _accepted(0),
+      _refused(0),
+      _handshakeTimeouts(0),
+      _wakeups(0),
+      _reads(0),
+      _writes(0),
+      _framesIn(0),
+      _framesOut(0),
+      _bytesIn(0),
+      _bytesOut(0),
+      _messagesIn(0),
+      _messagesOut(0),
+      _syscalls(0),
+      _tlsHandshakes(0),
+      _tlsResumed(0),
+      _tlsErrors(0)
+{
+}
+
+WSNativeLoop::~WSNativeLoop() {
+    for (NativeConnection* c : _connections) {
+        ::close(c->fd);
+        delete c;
+    }
+
+    if (_listenFd >= 0)
+        ::close(_listenFd);
+    if (_epollFd >= 0)
+        ::close(_epollFd);
+    if (_wakeFd >= 0)
+        ::close(_wakeFd);
+}
+
+bool WSNativeLoop::Bind(quint16 port, QString& error) {
+    Config* config = Config::Current();
+    _maxConnections = config->MaxClients;
+    _compression = config->CompressionEnabled;
+    _compressionThreshold = config->CompressionThreshold;
+    _compressionLevel = (int)config->CompressionLevel;
+    _batchDelay = config->WriteBatchDelay * 1000000;
+
+    // Dual-stack, like QHostAddress::Any, unless IPv6 is unavailable
+    bool ipv6 = true;
+    _listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+        ipv6 = false;
+        _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (_listenFd < 0) {
+        error = QString("socket: %1").arg(strerror(errno));
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int bound;
+    if (ipv6) {
+        int zero = 0;
+        setsockopt(_listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        bound = bind(_listenFd, (struct sockaddr*)&address, sizeof(address));
+    }
+    else {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        bound = bind(_listenFd, (struct sockaddr*)&address, sizeof(address));
+    }
+
+    if (bound != 0 || listen(_listenFd, SOMAXCONN) != 0) {
+        error = QString("cannot listen on port %1: %2")
+            .arg(port).arg(strerror(errno));
+        return false;
+    }
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epollFd < 0 || _wakeFd < 0) {
+        error = QString("epoll: %1").arg(strerror(errno));
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = NATIVE_TAG_LISTEN;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event);
+
+    event.data.u64 = NATIVE_TAG_WAKEUP;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &event);
+
+    return true;
+}
+
+void WSNativeLoop::Post(const NativeCommand& command) {
+    QMutexLocker locker(&_commandsMutex);
+    _commands.push_back(command);
+
+    // One wakeup for a whole broadcast, and none for events that would
+    // be held back anyway
+    bool wake = !_wakePending && !(command.deferrable && _batchArmed);
+    if (wake)
+        _wakePending = true;
+    locker.unlock();
+
+    if (wake) {
+        uint64_t value = 1;
+        ssize_t written = ::write(_wakeFd, &value, sizeof(value));
+        Q_UNUSED(written);
+    }
+}
+
+void WSNativeLoop::Stop() {
+    _stopping = true;
+
+    uint64_t value = 1;
+    ssize_t written = ::write(_wakeFd, &value, sizeof(value));
+    Q_UNUSED(written);
+
+    wait();
+}
+
+void WSNativeLoop::GetStats(obs_data_t* stats) {
+    obs_data_set_bool(stats, "compression", _compression);
+    obs_data_set_int(stats, "connections", _connectionCount.load());
+    obs_data_set_int(stats, "accepted", _accepted.load());
+    obs_data_set_int(stats, "refused", _refused.load());
+    obs_data_set_int(stats, "handshake-timeouts", _handshakeTimeouts.load());
+    obs_data_set_int(stats, "wakeups", _wakeups.load());
+    obs_data_set_int(stats, "reads", _reads.load());
+    obs_data_set_int(stats, "writes", _writes.load());
+    obs_data_set_int(stats, "frames-in", _framesIn.load());
+    obs_data_set_int(stats, "frames-out", _framesOut.load());
+    obs_data_set_int(stats, "bytes-in", _bytesIn.load());
+    obs_data_set_int(stats, "bytes-out", _bytesOut.load());
+    obs_data_set_int(stats, "messages-in", _messagesIn.load());
+    obs_data_set_int(stats, "messages-out", _messagesOut.load());
+    obs_data_set_int(stats, "syscalls", _syscalls.load());
+
+    uint64_t messagesOut = _messagesOut.load();
+    uint64_t messages = _messagesIn.load() + messagesOut;
+    obs_data_set_double(stats, "writes-per-message", messagesOut
+        ? (double)_writes.load() / messagesOut : 0.0);
+    obs_data_set_double(stats, "syscalls-per-message", messages
+        ? (double)_syscalls.load() / messages : 0.0);
+}
+
+void WSNativeLoop::GetTlsStats(WSTlsStats& stats) {
+    stats.handshakes = _tlsHandshakes.load();
+    stats.resumed = _tlsResumed.load();
+    stats.handshakeErrors = _tlsErrors.load();
+
+    QMutexLocker locker(&_tlsMutex);
+    stats.lastError = _tlsLastError;
+    stats.protocols = _tlsProtocols;
+}
+
+void WSNativeLoop::run() {
+    struct epoll_event events[NATIVE_MAX_EVENTS];
+
+    while (!_stopping) {
+        uint64_t deadline = _flushDeadline;
+        if (!_handshakes.empty()
+            && (!deadline || _handshakes.front().second < deadline))
+        {
+            deadline = _handshakes.front().second;
+        }
+
+        int timeout = -1;
+        if (deadline) {
+            uint64_t now = os_gettime_ns();
+            timeout = (now >= deadline) ? 0
+                : (int)((deadline - now + 999999) / 1000000);
+        }
+
+        int count = epoll_wait(_epollFd, events, NATIVE_MAX_EVENTS, timeout);
+        _wakeups++;
+        _syscalls++;
+
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            blog(LOG_ERROR, "epoll backend: epoll_wait failed: %s",
+                strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == NATIVE_TAG_LISTEN) {
+                acceptConnections();
+                continue;
+            }
+
+            if (tag == NATIVE_TAG_WAKEUP) {
+                uint64_t value;
+                ssize_t result = ::read(_wakeFd, &value, sizeof(value));
+                Q_UNUSED(result);
+                _syscalls++;
+
+                processCommands(false);
+                continue;
+            }
+
+            NativeConnection* c = _connections.value(tag);
+            if (!c)
+                continue;
+
+            if (events[i].events & EPOLLOUT) {
+                c->writable = true;
+                markDirty(c);
+            }
+
+            uint32_t hangup = events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+            if ((events[i].events & EPOLLIN) || hangup)
+                readConnection(c, hangup != 0);
+        }
+
+        uint64_t now = os_gettime_ns();
+        if (_flushDeadline && now >= _flushDeadline) {
+            processCommands(true);
+            releaseDeferred();
+        }
+        expireHandshakes(now);
+
+        // Everything queued during this iteration goes out in one
+        // gathered write per connection
+        flushDirty();
+
+        if (!_pendingEvents.isEmpty())
+            _transport->PostEvents(_pendingEvents);
+    }
+
+    // Best effort for the close frames sent by WSServer::Stop()
+    processCommands(true);
+    releaseDeferred();
+    flushDirty();
+}
+
+void WSNativeLoop::acceptConnections() {
+    for (;;) {
+        struct sockaddr_storage address;
+        socklen_t addressLength = sizeof(address);
+
+        int fd = accept4(_listenFd, (struct sockaddr*)&address,
+            &addressLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        _syscalls++;
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                blog(LOG_WARNING, "epoll backend: accept failed: %s",
+                    strerror(errno));
+            }
+            return;
+        }
+
+        // Connections still in their handshake count too : they aren't
+        // clients of WSServer yet, which can't refuse them
+        if (_maxConnections
+            && (uint64_t)_connections.size() >= _maxConnections)
+        {
+            ::close(fd);
+            _refused++;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        NativeConnection* c = new NativeConnection();
+        c->fd = fd;
+        c->id = _nextId++;
+        c->encoding = EncodingJson;
+        c->upgraded = false;
+        c->closing = false;
+        c->closed = false;
+        c->writable = true;
+        c->dirty = false;
+        c->deferred = false;
+        c->outputOffset = 0;
+        c->messageOpcode = 0;
+        c->messageCompressed = false;
+        c->queued = std::make_shared<std::atomic<uint64_t>>(0);
+        c->tlsAccounted = 0;
+
+        QHostAddress peer((struct sockaddr*)&address);
+        c->ip = Utils::FormatIPAddress(peer);
+        c->port = ntohs(address.ss_family == AF_INET6
+            ? ((struct sockaddr_in6*)&address)->sin6_port
+            : ((struct sockaddr_in*)&address)->sin_port);
+
+        if (_tls) {
+            c->tls.reset(new WSTlsSession(_tls.get()));
+            if (!c->tls->Setup()) {
+                tlsFailed(c);
+                ::close(fd);
+                delete c;
+                continue;
+            }
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = c->id;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            delete c;
+            continue;
+        }
+
+        _connections.insert(c->id, c);
+        _handshakes.push_back(std::make_pair(c->id,
+            os_gettime_ns() + (uint64_t)NATIVE_HANDSHAKE_TIMEOUT * 1000000));
+        _accepted++;
+        _connectionCount++;
+    }
+}
+
+// Closes the connections that didn't complete their handshakes in time,
+// so that idle or slow clients can't hold sockets and buffers forever
+void WSNativeLoop::expireHandshakes(uint64_t now) {
+    while (!_handshakes.empty() && _handshakes.front().second <= now) {
+        NativeConnection* c = _connections.value(_handshakes.front().first);
+        _handshakes.pop_front();
+
+        if (c && !c->upgraded && !c->closed) {
+            _handshakeTimeouts++;
+            closeConnection(c);
+        }
+    }
+}
+
+void WSNativeLoop::readConnection(NativeConnection* c, bool hangup) {
+    for (;;) {
+        ssize_t count = ::read(c->fd, _readBuffer.data(), _readBuffer.size());
+        _reads++;
+        _syscalls++;
+
+        if (count == 0) {
+            closeConnection(c);
+            return;
+        }
+
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                closeConnection(c);
+            return;
+        }
+
+        _bytesIn += count;
+        if (!c->closing) {
+            if (c->tls) {
+                if (!receiveTls(c, _readBuffer.data(), count))
+                    return;
+            }
+            else {
+                c->input.append(_readBuffer.data(), (int)count);
+            }
+
+            if (c->upgraded)
+                processFrames(c);
+            else
+                processHandshake(c);
+
+            if (c->closed)
+                return;
+        }
+
+        // A short read drained the socket : more data is another edge,
+        // no need to read until EAGAIN. A hangup has no further edge.
+        if (!hangup && (size_t)count < _readBuffer.size())
+            return;
+    }
+}
+
+// Decrypts into the connection's input. Returns false once the connection
+// is closed.
+bool WSNativeLoop::receiveTls(NativeConnection* c, const char* data,
+    size_t size)
+{
+    bool established = c->tls->IsEstablished();
+    QByteArray plaintext;
+    bool open = c->tls->Receive(data, size, plaintext);
+
+    // Handshake messages, or an alert
+    if (c->tls->PendingSize())
+        markDirty(c);
+
+    if (!established && c->tls->IsEstablished()) {
+        _tlsHandshakes++;
+        if (c->tls->IsResumed())
+            _tlsResumed++;
+
+        QMutexLocker locker(&_tlsMutex);
+        _tlsProtocols[c->tls->Protocol()]++;
+    }
+
+    if (!open) {
+        if (!c->tls->LastError().isEmpty())
+            tlsFailed(c);
+
+        flush(c);
+        closeConnection(c);
+        return false;
+    }
+
+    c->input.append(plaintext);
+    return true;
+}
+
+void WSNativeLoop::tlsFailed(NativeConnection* c) {
+    QString error = c->tls->LastError();
+    blog(LOG_WARNING, "TLS error from %s: %s",
+        c->ip.toUtf8().constData(), error.toUtf8().constData());
+
+    _tlsErrors++;
+    QMutexLocker locker(&_tlsMutex);
+    _tlsLastError = error;
+}
+
+void WSNativeLoop::processHandshake(NativeConnection* c) {
+    int end = c->input.indexOf("\r\n\r\n");
+    if (end < 0) {
+        if (c->input.size() > NATIVE_MAX_HANDSHAKE)
+            rejectHandshake(c, "431 Request Header Fields Too Large");
+        return;
+    }
+    if (end > NATIVE_MAX_HANDSHAKE) {
+        rejectHandshake(c, "431 Request Header Fields Too Large");
+        return;
+    }
+
+    QList<QByteArray> lines = c->input.left(end).split('\n');
+    QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+    if (requestLine.size() != 3 || requestLine[0] != "GET"
+        || !requestLine[2].startsWith("HTTP/1."))
+    {
+        rejectHandshake(c, "400 Bad Request");
+        return;
+    }
+
+    // Repeated headers are combined, as per RFC 7230 section 3.2.2
+    QHash<QByteArray, QByteArray> headers;
+    for (const QByteArray& line : lines) {
+        int separator = line.indexOf(':');
+        if (separator <= 0)
+            continue;
+
+        QByteArray name = line.left(separator).trimmed().toLower();
+        QByteArray value = line.mid(separator + 1).trimmed();
+        if (headers.contains(name))
+            headers[name] += ", " + value;
+        else
+            headers.insert(name, value);
+    }
+
+    if (!hasToken(headers.value("upgrade"), "websocket")
+        || !hasToken(headers.value("connection"), "upgrade"))
+    {
+        rejectHandshake(c, "400 Bad Request");
+        return;
+    }
+
+    if (headers.value("sec-websocket-version") != "13") {
+        rejectHandshake(c, "426 Upgrade Required",
+            "Sec-WebSocket-Version: 13\r\n");
+        return;
+    }
+
+    QByteArray key = headers.value("sec-websocket-key");
+    if (QByteArray::fromBase64(key).size() != 16) {
+        rejectHandshake(c, "400 Bad Request");
+        return;
+    }
+
+    QByteArray response =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n";
+
+    // Unlike QWebSocketServer, the subprotocol can be confirmed : the
+    // query parameter stays supported for consistency
+    if (hasToken(headers.value("sec-websocket-protocol"), MSGPACK_SUBPROTOCOL)) {
+        c->encoding = EncodingMsgPack;
+        response += "Sec-WebSocket-Protocol: " MSGPACK_SUBPROTOCOL "\r\n";
+    }
+    else {
+        QUrlQuery query(QUrl::fromEncoded(requestLine[1]).query());
+        if (query.queryItemValue("encoding") == "msgpack")
+            c->encoding = EncodingMsgPack;
+    }
+
+    DeflateParams params;
+    QByteArray extensionResponse;
+    if (_compression && WSDeflate::Negotiate(
+        headers.value("sec-websocket-extensions"), params, extensionResponse))
+    {
+        c->deflate.reset(new WSDeflate(params, _compressionLevel));
+        response += "Sec-WebSocket-Extensions: " + extensionResponse + "\r\n";
+    }
+
+    response += "\r\n";
+    queueRaw(c, response, 0);
+
+    c->upgraded = true;
+    c->input.remove(0, end + 4);
+
+    WSNativeEvent event;
+    event.type = WSNativeEvent::Opened;
+    event.connection = c->id;
+    event.binary = false;
+    event.ip = c->ip;
+    event.port = c->port;
+    event.encoding = c->encoding;
+    event.queued = c->queued;
+    _pendingEvents.append(event);
+
+    // Frames sent right after the handshake
+    if (!c->input.isEmpty())
+        processFrames(c);
+}
+
+void WSNativeLoop::rejectHandshake(NativeConnection* c, const char* status,
+    const char* extraHeaders)
+{
+    QByteArray response = QByteArray("HTTP/1.1 ") + status + "\r\n"
+        + extraHeaders
+        + "Connection: close\r\n"
+        "Content-Length: 0\r\n\r\n";
+
+    queueRaw(c, response, 0);
+    c->closing = true;
+    c->input.clear();
+}
+
+void WSNativeLoop::processFrames(NativeConnection* c) {
+    char* data = c->input.data();
+    size_t size = c->input.size();
+    size_t position = 0;
+
+    while (!c->closing) {
+        WSFrameHeader header;
+        size_t headerSize = WSFrameCodec::ParseHeader(data + position,
+            size - position, header);
+        if (headerSize == 0)
+            break;
+
+        // Client frames must be masked (RFC 6455, section 5.1)
+        if (!header.masked || header.rsv2 || header.rsv3) {
+            queueClose(c, QWebSocketProtocol::CloseCodeProtocolError,
+                QByteArray());
+            break;
+        }
+
+        bool control = (header.opcode & 0x08) != 0;
+        if (control && (!header.fin || header.length > 125)) {
+            queueClose(c, QWebSocketProtocol::CloseCodeProtocolError,
+                QByteArray());
+            break;
+        }
+
+        if (header.length > NATIVE_MAX_MESSAGE || (!control
+            && c->message.size() + header.length > NATIVE_MAX_MESSAGE))
+        {
+            queueClose(c, QWebSocketProtocol::CloseCodeTooMuchData,
+                QByteArray());
+            break;
+        }
+
+        if (size - position - headerSize < header.length)
+            break;
+
+        char* payload = data + position + headerSize;
+        WSFrameCodec::Unmask(payload, header.length, header.mask);
+        position += headerSize + header.length;
+
+        _framesIn++;
+        handleFrame(c, header, payload);
+    }
+
+    if (c->closing)
+        c->input.clear();
+    else
+        c->input.remove(0, (int)position);
+}
+
+void WSNativeLoop::handleFrame(NativeConnection* c,
+    const WSFrameHeader& header, const char* payload)
+{
+    int length = (int)header.length;
+
+    switch (header.opcode) {
+        case WSFrameCodec::Ping:
+            queueFrame(c, WSFrameCodec::Pong, QByteArray(payload, length),
+                false, 0);
+            return;
+
+        case WSFrameCodec::Pong: {
+            WSNativeEvent event;
+            event.type = WSNativeEvent::Pong;
+            event.connection = c->id;
+            event.binary = false;
+            event.port = 0;
+            event.encoding = c->encoding;
+            _pendingEvents.append(event);
+            return;
+        }
+
+        case WSFrameCodec::Close: {
+            // Echo the peer's code (RFC 6455, section 5.5.1)
+            quint16 code = QWebSocketProtocol::CloseCodeNormal;
+            if (length >= 2)
+                code = ((uint8_t)payload[0] << 8) | (uint8_t)payload[1];
+            if (length == 1 || code < 1000 || code == 1004 || code == 1005
+                || code == 1006 || code == 1015)
+            {
+                code = QWebSocketProtocol::CloseCodeProtocolError;
+            }
+            queueClose(c, code, QByteArray());
+            return;
+        }
+
+        case WSFrameCodec::Text:
+        case WSFrameCodec::Binary:
+            if (c->messageOpcode != 0 || (header.rsv1 && !c->deflate)) {
+                queueClose(c, QWebSocketProtocol::CloseCodeProtocolError,
+                    QByteArray());
+                return;
+            }
+
+            c->messageOpcode = header.opcode;
+            c->messageCompressed = header.rsv1;
+            c->message = QByteArray(payload, length);
+            break;
+
+        case WSFrameCodec::Continuation:
+            if (c->messageOpcode == 0 || header.rsv1) {
+                queueClose(c, QWebSocketProtocol::CloseCodeProtocolError,
+                    QByteArray());
+                return;
+            }
+
+            c->message.append(payload, length);
+            break;
+
+        default:
+            queueClose(c, QWebSocketProtocol::CloseCodeProtocolError,
+                QByteArray());
+            return;
+    }
+
+    if (header.fin)
+        finishMessage(c);
+}
+
+void WSNativeLoop::finishMessage(NativeConnection* c) {
+    QByteArray message;
+    message.swap(c->message);
+
+    bool binary = (c->messageOpcode == WSFrameCodec::Binary);
+    bool compressed = c->messageCompressed;
+    c->messageOpcode = 0;
+    c->messageCompressed = false;
+
+    if (compressed) {
+        QByteArray inflated;
+        if (!c->deflate->Decompress(message.constData(), message.size(),
+            inflated, NATIVE_MAX_MESSAGE))
+        {
+            queueClose(c, QWebSocketProtocol::CloseCodeWrongDatatype,
+                QByteArray());
+            return;
+        }
+        message = inflated;
+    }
+
+    if (!binary && !WSFrameCodec::IsValidUtf8(message.constData(),
+        message.size()))
+    {
+        queueClose(c, QWebSocketProtocol::CloseCodeWrongDatatype,
+            QByteArray());
+        return;
+    }
+
+    _messagesIn++;
+
+    WSNativeEvent event;
+    event.type = WSNativeEvent::Message;
+    event.connection = c->id;
+    event.payload = message;
+    event.binary = binary;
+    event.port = 0;
+    event.encoding = c->encoding;
+    _pendingEvents.append(event);
+}
+
+// With release, the batch deadline has passed : nothing is deferred
+// any more, and later sends must wake the loop again
+void WSNativeLoop::processCommands(bool release) {
+    std::vector<NativeCommand> commands;
+
+    QMutexLocker locker(&_commandsMutex);
+    commands.swap(_commands);
+    _wakePending = false;
+    if (release)
+        _batchArmed = false;
+    locker.unlock();
+
+    for (const NativeCommand& command : commands) {
+        NativeConnection* c = _connections.value(command.connection);
+        if (!c)
+            continue;
+
+        switch (command.type) {
+            case NativeCommand::Send:
+                sendMessage(c, command.payload, command.binary,
+                    command.messageType,
+                    command.deferrable && !release && _batchDelay > 0);
+                break;
+
+            case NativeCommand::Close:
+                queueClose(c, command.closeCode, command.payload);
+                break;
+
+            case NativeCommand::Ping:
+                queueFrame(c, WSFrameCodec::Ping, QByteArray(), false, 0);
+                break;
+
+            case NativeCommand::Abort:
+                closeConnection(c);
+                break;
+        }
+    }
+}
+
+void WSNativeLoop::sendMessage(NativeConnection* c, const QByteArray& payload,
+    bool binary, const QByteArray& messageType, bool deferred)
+{
+    uint8_t opcode = binary ? WSFrameCodec::Binary : WSFrameCodec::Text;
+    _messagesOut++;
+
+    if (c->deflate && _compression
+        && (uint64_t)payload.size() >= _compressionThreshold)
+    {
+        QByteArray compressed;
+        const char* statsKey = !messageType.isEmpty()
+            ? messageType.constData() : (binary ? "binary" : "text");
+        if (c->deflate->Compress(payload.constData(), payload.size(),
+            compressed, statsKey))
+        {
+            queueFrame(c, opcode, compressed, true, payload.size(),
+                deferred);
+            return;
+        }
+    }
+
+    // The payload buffer is shared by all the clients of a broadcast
+    queueFrame(c, opcode, payload, false, payload.size(), deferred);
+}
+
+void WSNativeLoop::queueRaw(NativeConnection* c, const QByteArray& data,
+    uint64_t accounted, bool deferred)
+{
+    NativeChunk chunk;
+    chunk.data = data;
+    chunk.accounted = accounted;
+    c->output.push_back(chunk);
+
+    if (deferred)
+        markDeferred(c);
+    else
+        markDirty(c);
+}
+
+void WSNativeLoop::queueFrame(NativeConnection* c, uint8_t opcode,
+    const QByteArray& payload, bool compressed, uint64_t accounted,
+    bool deferred)
+{
+    if (c->closing) {
+        c->queued->fetch_sub(accounted);
+        return;
+    }
+
+    char header[WS_MAX_SERVER_HEADER];
+    size_t headerSize = WSFrameCodec::WriteHeader(header, opcode, compressed,
+        payload.size());
+
+    if (payload.isEmpty()) {
+        queueRaw(c, QByteArray(header, (int)headerSize), accounted, deferred);
+    }
+    else {
+        queueRaw(c, QByteArray(header, (int)headerSize), 0, deferred);
+        queueRaw(c, payload, accounted, deferred);
+    }
+    _framesOut++;
+}
+
+void WSNativeLoop::queueClose(NativeConnection* c, quint16 code,
+    const QByteArray& reason)
+{
+    if (c->closing)
+        return;
+
+    // Control frame payloads are limited to 125 bytes
+    QByteArray payload;
+    payload.append((char)(code >> 8));
+    payload.append((char)(code & 0xff));
+    payload.append(reason.left(123));
+
+    queueFrame(c, WSFrameCodec::Close, payload, false, 0);
+
+    // The server closes the TCP connection first (RFC 6455, 7.1.1)
+    c->closing = true;
+}
+
+void WSNativeLoop::markDirty(NativeConnection* c) {
+    if (!c->dirty) {
+        c->dirty = true;
+        _dirty.push_back(c);
+    }
+}
+
+// Deferred output is written with the connection's next flush, or at the
+// latest WriteBatchDelay after the first deferred message
+void WSNativeLoop::markDeferred(NativeConnection* c) {
+    if (!c->deferred) {
+        c->deferred = true;
+        _deferred.push_back(c);
+    }
+
+    if (!_flushDeadline) {
+        _flushDeadline = os_gettime_ns() + _batchDelay;
+
+        QMutexLocker locker(&_commandsMutex);
+        _batchArmed = true;
+    }
+}
+
+void WSNativeLoop::releaseDeferred() {
+    for (NativeConnection* c : _deferred) {
+        c->deferred = false;
+        markDirty(c);
+    }
+    _deferred.clear();
+    _flushDeadline = 0;
+}
+
+void WSNativeLoop::flush(NativeConnection* c) {
+    if (c->tls) {
+        flushTls(c);
+        return;
+    }
+
+    while (c->writable && !c->output.empty()) {
+        struct iovec iov[NATIVE_MAX_IOVECS];
+        int count = 0;
+
+        size_t offset = c->outputOffset;
+        for (std::deque<NativeChunk>::const_iterator it = c->output.begin();
+            it != c->output.end() && count < NATIVE_MAX_IOVECS; ++it)
+        {
+            iov[count].iov_base = (void*)(it->data.constData() + offset);
+            iov[count].iov_len = it->data.size() - offset;
+            offset = 0;
+            count++;
+        }
+
+        // sendmsg() rather than writev() : the same gathered write,
+        // without SIGPIPE
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+
+        ssize_t written = sendmsg(c->fd, &message, MSG_NOSIGNAL);
+        _writes++;
+        _syscalls++;
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                c->writable = false;
+                return;
+            }
+
+            closeConnection(c);
+            return;
+        }
+
+        _bytesOut += written;
+
+        size_t remaining = written;
+        while (remaining > 0) {
+            NativeChunk& chunk = c->output.front();
+            size_t left = chunk.data.size() - c->outputOffset;
+            if (remaining < left) {
+                c->outputOffset += remaining;
+                break;
+            }
+
+            remaining -= left;
+            if (chunk.accounted)
+                c->queued->fetch_sub(chunk.accounted);
+            c->output.pop_front();
+            c->outputOffset = 0;
+        }
+    }
+
+    if (c->output.empty() && c->closing)
+        closeConnection(c);
+}
+
+// All the queued frames are encrypted together, then written at once
+void WSNativeLoop::flushTls(NativeConnection* c) {
+    WSTlsSession* tls = c->tls.get();
+    if (tls->IsEstablished()) {
+        while (!c->output.empty()) {
+            NativeChunk& chunk = c->output.front();
+            if (!tls->Send(chunk.data.constData() + c->outputOffset,
+                chunk.data.size() - c->outputOffset))
+            {
+                tlsFailed(c);
+                closeConnection(c);
+                return;
+            }
+
+            c->tlsAccounted += chunk.accounted;
+            c->output.pop_front();
+            c->outputOffset = 0;
+        }
+
+        if (c->closing)
+            tls->CloseNotify();
+    }
+
+    while (c->writable && tls->PendingSize()) {
+        ssize_t written = send(c->fd, tls->PendingOutput(),
+            tls->PendingSize(), MSG_NOSIGNAL);
+        _writes++;
+        _syscalls++;
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                c->writable = false;
+                return;
+            }
+
+            closeConnection(c);
+            return;
+        }
+
+        _bytesOut += written;
+        tls->Consume(written);
+    }
+
+    if (!tls->PendingSize() && c->tlsAccounted) {
+        c->queued->fetch_sub(c->tlsAccounted);
+        c->tlsAccounted = 0;
+    }
+
+    if (c->output.empty() && !tls->PendingSize() && c->closing)
+        closeConnection(c);
+}
+
+void WSNativeLoop::flushDirty() {
+    // flush() may close connections : they are only deleted afterwards
+    for (size_t i = 0; i < _dirty.size(); i++) {
+        NativeConnection* c = _dirty[i];
+        c->dirty = false;
+        if (!c->closed)
+            flush(c);
+    }
+    _dirty.clear();
+
+    for (NativeConnection* c : _graveyard)
+        delete c;
+    _graveyard.clear();
+}
+
+void WSNativeLoop::closeConnection(NativeConnection* c) {
+    if (c->closed)
+        return;
+
+    c->closed = true;
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+
+    _connections.remove(c->id);
+    _connectionCount--;
+
+    if (c->deferred) {
+        _deferred.erase(std::remove(_deferred.begin(), _deferred.end(), c),
+            _deferred.end());
+        c->deferred = false;
+    }
+
+    if (c->upgraded) {
+        WSNativeEvent event;
+        event.type = WSNativeEvent::Closed;
+        event.connection = c->id;
+        event.binary = false;
+        event.port = 0;
+        event.encoding = c->encoding;
+        _pendingEvents.append(event);
+    }
+
+    _graveyard.push_back(c);
+}
+
+WSNativeTransport::WSNativeTransport(QObject* parent)
+    : WSTransport(parent),
+      _loop(nullptr),
+      _port(0),
+      _drainPending(false),
+      _generation(0)
+{
+}
+
+WSNativeTransport::~WSNativeTransport() {
+    Close();
+}
+
+const char* WSNativeTransport::Name() {
+    return "epoll";
+}
+
+bool WSNativeTransport::Listen(quint16 port, QString& error) {
+    Close();
+
+    WSNativeLoop* loop = new WSNativeLoop(this, _tls);
+    if (!loop->Bind(port, error)) {
+        delete loop;
+        return false;
+    }
+    loop->start();
+
+    QMutexLocker locker(&_clientsMutex);
+    _loop = loop;
+    _port = port;
+    return true;
+}
+
+void WSNativeTransport::Close() {
+    QMutexLocker locker(&_clientsMutex);
+    WSNativeLoop* loop = _loop;
+    _loop = nullptr;
+    _port = 0;
+    locker.unlock();
+
+    if (!loop)
+        return;
+
+    loop->Stop();
+    delete loop;
+
+    QMutexLocker eventsLocker(&_eventsMutex);
+    _events.clear();
+    _generation++;
+    eventsLocker.unlock();
+
+    // The connections are gone with the loop
+    locker.relock();
+    QList<QObject*> handles = _clients.keys();
+    _clients.clear();
+    _handles.clear();
+    locker.unlock();
+
+    for (QObject* handle : handles) {
+        emit clientDisconnected(handle);
+        handle->deleteLater();
+    }
+}
+
+quint16 WSNativeTransport::ServerPort() {
+    return _port;
+}
+
+bool WSNativeTransport::findClient(QObject* client, Client& result) {
+    QHash<QObject*, Client>::const_iterator it = _clients.constFind(client);
+    if (it == _clients.constEnd())
+        return false;
+
+    result = it.value();
+    return true;
+}
+
+qint64 WSNativeTransport::Send(QObject* client, const QByteArray& payload,
+    bool binary, const QByteArray& messageType, bool deferrable)
+{
+    QMutexLocker locker(&_clientsMutex);
+    Client target;
+    if (!_loop || !findClient(client, target))
+        return -1;
+
+    target.queued->fetch_add(payload.size());
+
+    NativeCommand command;
+    command.type = NativeCommand::Send;
+    command.connection = target.connection;
+    command.payload = payload;
+    command.messageType = messageType;
+    command.binary = binary;
+    command.deferrable = deferrable;
+    command.closeCode = 0;
+    _loop->Post(command);
+
+    return payload.size();
+}
+
+void WSNativeTransport::Disconnect(QObject* client, quint16 closeCode,
+    const QString& reason)
+{
+    QMutexLocker locker(&_clientsMutex);
+    Client target;
+    if (!_loop || !findClient(client, target))
+        return;
+
+    NativeCommand command;
+    command.type = NativeCommand::Close;
+    command.connection = target.connection;
+    command.payload = reason.toUtf8();
+    command.binary = false;
+    command.deferrable = false;
+    command.closeCode = closeCode;
+    _loop->Post(command);
+}
+
+void WSNativeTransport::Abort(QObject* client) {
+    postCommand(client, NativeCommand::Abort);
+}
+
+void WSNativeTransport::Ping(QObject* client) {
+    postCommand(client, NativeCommand::Ping);
+}
+
+void WSNativeTransport::postCommand(QObject* client, int type) {
+    QMutexLocker locker(&_clientsMutex);
+    Client target;
+    if (!_loop || !findClient(client, target))
+        return;
+
+    NativeCommand command;
+    command.type = (NativeCommand::Type)type;
+    command.connection = target.connection;
+    command.binary = false;
+    command.deferrable = false;
+    command.closeCode = 0;
+    _loop->Post(command);
+}
+
+uint64_t WSNativeTransport::QueuedBytes(QObject* client) {
+    QMutexLocker locker(&_clientsMutex);
+    Client target;
+    if (!findClient(client, target))
+        return 0;
+
+    return target.queued->load();
+}
+
+bool WSNativeTransport::SetSecure(bool secure, QString& error) {
+    if (!secure) {
+        _tls.reset();
+        return true;
+    }
+
+    Config* config = Config::Current();
+    std::shared_ptr<WSTlsContext> tls = std::make_shared<WSTlsContext>();
+    if (!tls->Load(config->TlsCertificate, config->TlsPrivateKey, error))
+        return false;
+
+    _tls = tls;
+    return true;
+}
+
+bool WSNativeTransport::IsSecure() {
+    return (_tls != nullptr);
+}
+
+WSTlsStats WSNativeTransport::TlsStats() {
+    WSTlsStats stats;
+    stats.enabled = IsSecure();
+    stats.handshakes = 0;
+    stats.resumed = 0;
+    stats.handshakeErrors = 0;
+
+    QMutexLocker locker(&_clientsMutex);
+    if (_loop)
+        _loop->GetTlsStats(stats);
+    return stats;
+}
+
+obs_data_t* WSNativeTransport::GetStats() {
+    obs_data_t* stats = obs_data_create();
+    obs_data_set_string(stats, "backend", Name());
+
+    QMutexLocker locker(&_clientsMutex);
+    if (_loop)
+        _loop->GetStats(stats);
+    return stats;
+}
+
+void WSNativeTransport::PostEvents(QVector<WSNativeEvent>& events) {
+    QMutexLocker locker(&_eventsMutex);
+    if (_events.isEmpty())
+        _events.swap(events);
+    else
+        _events += events;
+    events.clear();
+
+    // One queued call for everything until the main thread catches up
+    bool notify = !_drainPending;
+    _drainPending = true;
+    locker.unlock();
+
+    if (notify)
+        QMetaObject::invokeMethod(this, "drainEvents", Qt::QueuedConnection);
+}
+
+void WSNativeTransport::drainEvents() {
+    QVector<WSNativeEvent> events;
+
+    QMutexLocker eventsLocker(&_eventsMutex);
+    events.swap(_events);
+    _drainPending = false;
+    quint64 generation = _generation;
+    eventsLocker.unlock();
+
+    for (const WSNativeEvent& event : events) {
+        // A slot closed the transport : the remaining events are stale
+        if (generation != _generation)
+            return;
+
+        if (event.type == WSNativeEvent::Opened) {
+            QObject* handle = new QObject(this);
+
+            Client client;
+            client.connection = event.connection;
+            client.queued = event.queued;
+
+            QMutexLocker locker(&_clientsMutex);
+            _clients.insert(handle, client);
+            _handles.insert(event.connection, handle);
+            locker.unlock();
+
+            emit clientConnected(handle, event.ip, event.port,
+                event.encoding);
+            continue;
+        }
+
+        QObject* handle = _handles.value(event.connection);
+        if (!handle)
+            continue;
+
+        if (event.type == WSNativeEvent::Message) {
+            emit messageReceived(handle, event.payload, event.binary);
+        }
+        else if (event.type == WSNativeEvent::Pong) {
+            emit pongReceived(handle);
+        }
+        else {
+            QMutexLocker locker(&_clientsMutex);
+            _clients.remove(handle);
+            _handles.remove(event.connection);
+            locker.unlock();
+
+            emit clientDisconnected(handle);
+            handle->deleteLater();
+        }
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,117 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSNATIVETRANSPORT_H
+#define WSNATIVETRANSPORT_H
+
+#ifdef __linux__
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+#include "WSTransport.h"
+
+class WSNativeLoop;
+class WSTlsContext;
+
+// Handed from the IO thread to the main thread
+struct WSNativeEvent {
+    enum Type {
+        Opened,
+        Message,
+        Pong,
+        Closed
+    };
+
+    Type type;
+    quint64 connection;
+    QByteArray payload;
+    bool binary;
+    QString ip;
+    quint16 port;
+    int encoding;
+    std::shared_ptr<std::atomic<uint64_t>> queued;
+};
+
+// Linux backend : a single IO thread running an edge-triggered epoll
+// loop, with its own handshake and framing (WSFrameCodec). Messages are
+// handed to the main thread in batches, and sends are gathered with
+// writev(), events being held back for up to WriteBatchDelay to share
+// writes. Supports permessage-deflate, and TLS with mbedTLS, resuming
+// sessions (see WSTlsContext).
+class WSNativeTransport : public WSTransport {
+  Q_OBJECT
+  public:
+    explicit WSNativeTransport(QObject* parent = Q_NULLPTR);
+    ~WSNativeTransport();
+
+    const char* Name() override;
+    bool Listen(quint16 port, QString& error) override;
+    void Close() override;
+    quint16 ServerPort() override;
+    qint64 Send(QObject* client, const QByteArray& payload,
+        bool binary, const QByteArray& messageType,
+        bool deferrable = false) override;
+    void Disconnect(QObject* client, quint16 closeCode,
+        const QString& reason) override;
+    void Abort(QObject* client) override;
+    void Ping(QObject* client) override;
+    uint64_t QueuedBytes(QObject* client) override;
+    obs_data_t* GetStats() override;
+    bool SetSecure(bool secure, QString& error) override;
+    bool IsSecure() override;
+    WSTlsStats TlsStats() override;
+
+    // Called by the IO thread
+    void PostEvents(QVector<WSNativeEvent>& events);
+
+  private slots:
+    void drainEvents();
+
+  private:
+    struct Client {
+        quint64 connection;
+        std::shared_ptr<std::atomic<uint64_t>> queued;
+    };
+
+    bool findClient(QObject* client, Client& result);
+    void postCommand(QObject* client, int type);
+
+    WSNativeLoop* _loop;
+    quint16 _port;
+    std::shared_ptr<WSTlsContext> _tls; // Null unless secure
+
+    QMutex _clientsMutex;
+    QHash<QObject*, Client> _clients;
+    QHash<quint64, QObject*> _handles;
+
+    QMutex _eventsMutex;
+    QVector<WSNativeEvent> _events;
+    bool _drainPending;
+
+    // Incremented by Close() : events of a previous loop are dropped
+    quint64 _generation;
+};
+
+#endif // __linux__
+
+#endif // WSNATIVETRANSPORT_H
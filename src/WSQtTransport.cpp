@@ -0,0 +1,382 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <QtWebSockets/QWebSocket>
+#include <QtWebSockets/QWebSocketServer>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+#include <QtCore/QFile>
+#include <QtCore/QUrlQuery>
+
+#include "WSQtTransport.h"
+#include "obs-websocket.h"
+#include "Config.h"
+#include "Utils.h"
+
+QT_USE_NAMESPACE
+
+// Size of a message once framed by QWebSocket (server frames are never
+// masked). Fragmentation of very large messages is not accounted for :
+// the queue depth estimate resyncs on bytesWritten instead.
+static uint64_t framedSize(qint64 payloadSize) {
+    uint64_t headerSize = 2;
+    if (payloadSize > 65535)
+        headerSize += 8;
+    else if (payloadSize > 125)
+        headerSize += 2;
+
+    return (uint64_t)payloadSize + headerSize;
+}
+
+static QString protocolName(QSsl::SslProtocol protocol) {
+    switch (protocol) {
+        case QSsl::TlsV1_0:
+            return QStringLiteral("TLS 1.0");
+        case QSsl::TlsV1_1:
+            return QStringLiteral("TLS 1.1");
+        case QSsl::TlsV1_2:
+            return QStringLiteral("TLS 1.2");
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        case QSsl::TlsV1_3:
+            return QStringLiteral("TLS 1.3");
+#endif
+        default:
+            return QStringLiteral("unknown");
+    }
+}
+
+WSQtTransport::WSQtTransport(QObject* parent)
+    : WSTransport(parent),
+      _server(Q_NULLPTR),
+      _mutex(QMutex::Recursive),
+      _tlsHandshakes(0),
+      _tlsHandshakeErrors(0)
+{
+    createServer(false);
+}
+
+WSQtTransport::~WSQtTransport() {
+    Close();
+}
+
+void WSQtTransport::createServer(bool secure) {
+    if (_server) {
+        // Sockets of the previous server may still be closing
+        _server->close();
+        _server->deleteLater();
+    }
+
+    _server = new QWebSocketServer(
+        QStringLiteral("obs-websocket"),
+        secure ? QWebSocketServer::SecureMode
+            : QWebSocketServer::NonSecureMode,
+        this);
+
+    connect(_server, SIGNAL(newConnection()),
+        this, SLOT(onNewConnection()));
+    connect(_server, SIGNAL(sslErrors(const QList<QSslError>&)),
+        this, SLOT(onSslErrors(const QList<QSslError>&)));
+    connect(_server, SIGNAL(serverError(QWebSocketProtocol::CloseCode)),
+        this, SLOT(onServerError(QWebSocketProtocol::CloseCode)));
+}
+
+bool WSQtTransport::LoadTlsConfiguration(QSslConfiguration& sslConfig,
+    QString& error)
+{
+    Config* config = Config::Current();
+
+    // The first certificate of the file is the server's, the others
+    // (if any) are the intermediates sent along with it
+    QList<QSslCertificate> chain =
+        QSslCertificate::fromPath(config->TlsCertificate, QSsl::Pem);
+    if (chain.isEmpty()) {
+        error = QString("no PEM certificate found in \"%1\"")
+            .arg(config->TlsCertificate);
+        return false;
+    }
+
+    QFile keyFile(config->TlsPrivateKey);
+    if (!keyFile.open(QIODevice::ReadOnly)) {
+        error = QString("cannot read private key \"%1\": %2")
+            .arg(config->TlsPrivateKey, keyFile.errorString());
+        return false;
+    }
+    QByteArray keyData = keyFile.readAll();
+
+    QSslKey key(keyData, QSsl::Rsa, QSsl::Pem);
+    if (key.isNull())
+        key = QSslKey(keyData, QSsl::Ec, QSsl::Pem);
+    if (key.isNull()) {
+        error = QString("no RSA or EC PEM private key found in \"%1\"")
+            .arg(config->TlsPrivateKey);
+        return false;
+    }
+
+    sslConfig = QSslConfiguration::defaultConfiguration();
+    sslConfig.setLocalCertificateChain(chain);
+    sslConfig.setPrivateKey(key);
+    sslConfig.setPeerVerifyMode(QSslSocket::VerifyNone);
+    sslConfig.setProtocol(QSsl::TlsV1_2OrLater);
+
+    // Qt creates a new OpenSSL context for each server socket, so tickets
+    // would be encrypted with a key no later connection knows about, and
+    // it has no server-side session cache either : don't bother sending
+    // them. The epoll backend resumes sessions.
+    sslConfig.setSslOption(QSsl::SslOptionDisableSessionTickets, true);
+    return true;
+}
+
+const char* WSQtTransport::Name() {
+    return "qt";
+}
+
+bool WSQtTransport::SetSecure(bool secure, QString& error) {
+    QSslConfiguration sslConfig;
+    if (secure && !LoadTlsConfiguration(sslConfig, error))
+        return false;
+
+    if (secure != IsSecure())
+        createServer(secure);
+
+    _sslConfig = sslConfig;
+    return true;
+}
+
+bool WSQtTransport::IsSecure() {
+    return (_server->secureMode() == QWebSocketServer::SecureMode);
+}
+
+bool WSQtTransport::Listen(quint16 port, QString& error) {
+    if (IsSecure())
+        _server->setSslConfiguration(_sslConfig);
+
+    if (!_server->listen(QHostAddress::Any, port)) {
+        error = _server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void WSQtTransport::Close() {
+    _server->close();
+}
+
+quint16 WSQtTransport::ServerPort() {
+    return _server->isListening() ? _server->serverPort() : 0;
+}
+
+qint64 WSQtTransport::Send(QObject* client, const QByteArray& payload,
+    bool binary, const QByteArray& messageType, bool deferrable)
+{
+    // QTcpSocket already buffers everything written during an event loop
+    // iteration until its write notifier fires. Messages are never
+    // compressed.
+    Q_UNUSED(messageType);
+    Q_UNUSED(deferrable);
+
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(client);
+    if (!pSocket)
+        return -1;
+
+    QMutexLocker locker(&_mutex);
+    qint64 sent = 0;
+    if (binary) {
+        sent = pSocket->sendBinaryMessage(payload);
+    }
+    else {
+        // Same buffer as the previous call : the same broadcast
+        if (payload.constData() != _lastText.constData()) {
+            _lastText = payload;
+            _lastTextString = QString::fromUtf8(payload);
+        }
+        sent = pSocket->sendTextMessage(_lastTextString);
+    }
+
+    QHash<QObject*, QueueCounters>::iterator it = _queues.find(client);
+    if (it != _queues.end() && sent >= 0)
+        it->bytesSent += framedSize(sent);
+
+    return sent;
+}
+
+void WSQtTransport::Disconnect(QObject* client, quint16 closeCode,
+    const QString& reason)
+{
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(client);
+    if (pSocket)
+        pSocket->close((QWebSocketProtocol::CloseCode)closeCode, reason);
+}
+
+void WSQtTransport::Abort(QObject* client) {
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(client);
+    if (pSocket)
+        pSocket->abort();
+}
+
+void WSQtTransport::Ping(QObject* client) {
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(client);
+    if (pSocket)
+        pSocket->ping();
+}
+
+uint64_t WSQtTransport::QueuedBytes(QObject* client) {
+    QMutexLocker locker(&_mutex);
+    QHash<QObject*, QueueCounters>::iterator it = _queues.find(client);
+    if (it == _queues.end())
+        return 0;
+
+    // Control frames (pongs, close) are written but never counted
+    // as sent : resync rather than report a negative depth
+    if (it->bytesWritten > it->bytesSent)
+        it->bytesSent = it->bytesWritten;
+    return it->bytesSent - it->bytesWritten;
+}
+
+obs_data_t* WSQtTransport::GetStats() {
+    obs_data_t* stats = obs_data_create();
+    obs_data_set_string(stats, "backend", Name());
+
+    // QWebSocketServer answers the handshake itself, without extensions
+    obs_data_set_bool(stats, "compression", false);
+    return stats;
+}
+
+WSTlsStats WSQtTransport::TlsStats() {
+    QMutexLocker locker(&_mutex);
+
+    WSTlsStats stats;
+    stats.enabled = IsSecure();
+    stats.handshakes = _tlsHandshakes;
+    stats.resumed = 0;
+    stats.handshakeErrors = _tlsHandshakeErrors;
+    stats.lastError = _tlsLastError;
+    stats.protocols = _tlsProtocols;
+    return stats;
+}
+
+WSEncoding WSQtTransport::RequestedEncoding(QWebSocket* client) {
+    // Qt does not let the server confirm a subprotocol in the handshake
+    // response, and clients asking for one must then fail the connection
+    // (RFC 6455, section 4.1) : the subprotocol is never acted upon, the
+    // encoding comes from "?encoding=msgpack" in the URL
+    QUrlQuery query(client->requestUrl());
+    if (query.queryItemValue("encoding") == "msgpack")
+        return EncodingMsgPack;
+
+    return EncodingJson;
+}
+
+void WSQtTransport::onNewConnection() {
+    QWebSocket* pSocket = _server->nextPendingConnection();
+    if (!pSocket)
+        return;
+
+    pSocket->setParent(this);
+    connect(pSocket, SIGNAL(textMessageReceived(const QString&)),
+        this, SLOT(onTextMessageReceived(QString)));
+    connect(pSocket, SIGNAL(binaryMessageReceived(const QByteArray&)),
+        this, SLOT(onBinaryMessageReceived(QByteArray)));
+    connect(pSocket, SIGNAL(disconnected()),
+        this, SLOT(onSocketDisconnected()));
+    connect(pSocket, SIGNAL(pong(quint64, const QByteArray&)),
+        this, SLOT(onPong(quint64, const QByteArray&)));
+    connect(pSocket, SIGNAL(bytesWritten(qint64)),
+        this, SLOT(onBytesWritten(qint64)));
+
+    QMutexLocker locker(&_mutex);
+    QueueCounters counters = {};
+    _queues.insert(pSocket, counters);
+
+    // Secure connections are only handed over once encrypted
+    if (IsSecure()) {
+        _tlsHandshakes++;
+        _tlsProtocols[protocolName(
+            pSocket->sslConfiguration().sessionProtocol())]++;
+    }
+    locker.unlock();
+
+    QHostAddress clientAddr = pSocket->peerAddress();
+    emit clientConnected(pSocket, Utils::FormatIPAddress(clientAddr),
+        pSocket->peerPort(), RequestedEncoding(pSocket));
+}
+
+void WSQtTransport::onTextMessageReceived(QString message) {
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
+    if (pSocket)
+        emit messageReceived(pSocket, message.toUtf8(), false);
+}
+
+void WSQtTransport::onBinaryMessageReceived(QByteArray message) {
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
+    if (pSocket)
+        emit messageReceived(pSocket, message, true);
+}
+
+void WSQtTransport::onSocketDisconnected() {
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
+    if (!pSocket)
+        return;
+
+    QMutexLocker locker(&_mutex);
+    _queues.remove(pSocket);
+    locker.unlock();
+
+    emit clientDisconnected(pSocket);
+    pSocket->deleteLater();
+}
+
+void WSQtTransport::onPong(quint64 elapsedTime, const QByteArray& payload) {
+    Q_UNUSED(elapsedTime);
+    Q_UNUSED(payload);
+
+    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
+    if (pSocket)
+        emit pongReceived(pSocket);
+}
+
+void WSQtTransport::onBytesWritten(qint64 bytes) {
+    QMutexLocker locker(&_mutex);
+    QHash<QObject*, QueueCounters>::iterator it = _queues.find(sender());
+    if (it != _queues.end())
+        it->bytesWritten += bytes;
+}
+
+void WSQtTransport::onSslErrors(const QList<QSslError>& errors) {
+    QMutexLocker locker(&_mutex);
+    _tlsHandshakeErrors++;
+    if (!errors.isEmpty())
+        _tlsLastError = errors.last().errorString();
+    locker.unlock();
+
+    for (const QSslError& error : errors) {
+        blog(LOG_WARNING, "TLS error: %s",
+            error.errorString().toUtf8().constData());
+    }
+}
+
+void WSQtTransport::onServerError(QWebSocketProtocol::CloseCode closeCode) {
+    QString error = _server->errorString();
+    blog(LOG_WARNING, "handshake failed (code %d): %s",
+        (int)closeCode, error.toUtf8().constData());
+
+    if (IsSecure()) {
+        QMutexLocker locker(&_mutex);
+        _tlsHandshakeErrors++;
+        _tlsLastError = error;
+    }
+}
@@ -0,0 +1,97 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSQTTRANSPORT_H
+#define WSQTTRANSPORT_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QtNetwork/QSslConfiguration>
+#include <QtNetwork/QSslError>
+#include <QtWebSockets/QWebSocketProtocol>
+
+#include "WSTransport.h"
+
+QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
+QT_FORWARD_DECLARE_CLASS(QWebSocket)
+
+// QtWebSockets backend : the default one. Its TLS (OpenSSL through Qt)
+// never resumes sessions, see LoadTlsConfiguration.
+class WSQtTransport : public WSTransport {
+  Q_OBJECT
+  public:
+    explicit WSQtTransport(QObject* parent = Q_NULLPTR);
+    ~WSQtTransport();
+
+    const char* Name() override;
+    bool Listen(quint16 port, QString& error) override;
+    void Close() override;
+    quint16 ServerPort() override;
+    qint64 Send(QObject* client, const QByteArray& payload,
+        bool binary, const QByteArray& messageType,
+        bool deferrable = false) override;
+    void Disconnect(QObject* client, quint16 closeCode,
+        const QString& reason) override;
+    void Abort(QObject* client) override;
+    void Ping(QObject* client) override;
+    uint64_t QueuedBytes(QObject* client) override;
+    obs_data_t* GetStats() override;
+    bool SetSecure(bool secure, QString& error) override;
+    bool IsSecure() override;
+    WSTlsStats TlsStats() override;
+
+  private slots:
+    void onNewConnection();
+    void onTextMessageReceived(QString message);
+    void onBinaryMessageReceived(QByteArray message);
+    void onSocketDisconnected();
+    void onPong(quint64 elapsedTime, const QByteArray& payload);
+    void onBytesWritten(qint64 bytes);
+    void onSslErrors(const QList<QSslError>& errors);
+    void onServerError(QWebSocketProtocol::CloseCode closeCode);
+
+  private:
+    struct QueueCounters {
+        uint64_t bytesSent;
+        uint64_t bytesWritten;
+    };
+
+    void createServer(bool secure);
+    static bool LoadTlsConfiguration(QSslConfiguration& sslConfig,
+        QString& error);
+    static WSEncoding RequestedEncoding(QWebSocket* client);
+
+    QWebSocketServer* _server;
+    QSslConfiguration _sslConfig;
+    QMutex _mutex;
+    QHash<QObject*, QueueCounters> _queues;
+
+    // QWebSocket only takes text as a QString : a broadcast converts
+    // the payload once for all clients
+    QByteArray _lastText;
+    QString _lastTextString;
+
+    uint64_t _tlsHandshakes;
+    uint64_t _tlsHandshakeErrors;
+    QString _tlsLastError;
+    QHash<QString, uint64_t> _tlsProtocols;
+};
+
+#endif // WSQTTRANSPORT_H
@@ -0,0 +1,79 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "WSRateLimiter.h"
+
+WSRateLimiter::WSRateLimiter()
+    : _rate(0.0),
+      _burst(0.0)
+{
+}
+
+void WSRateLimiter::SetRate(uint64_t rate, uint64_t burst) {
+    _rate = (double)rate / 1000000000.0;
+    _burst = (double)(burst ? burst : rate);
+    _buckets.clear();
+}
+
+double WSRateLimiter::refill(const Bucket& bucket, uint64_t now) {
+    double tokens = bucket.tokens;
+    if (now > bucket.updatedAt)
+        tokens += (double)(now - bucket.updatedAt) * _rate;
+
+    return (tokens < _burst) ? tokens : _burst;
+}
+
+bool WSRateLimiter::Allow(const QString& key, uint64_t now) {
+    if (_rate <= 0.0)
+        return true;
+
+    QHash<QString, Bucket>::iterator it = _buckets.find(key);
+    if (it == _buckets.end()) {
+        if (_buckets.size() >= RATE_LIMITER_MAX_BUCKETS)
+            prune(now);
+
+        Bucket bucket;
+        bucket.tokens = _burst;
+        bucket.updatedAt = now;
+        it = _buckets.insert(key, bucket);
+    }
+
+    it->tokens = refill(*it, now);
+    it->updatedAt = now;
+
+    if (it->tokens < 1.0)
+        return false;
+
+    it->tokens -= 1.0;
+    return true;
+}
+
+void WSRateLimiter::Clear() {
+    _buckets.clear();
+}
+
+// A full bucket behaves like a missing one
+void WSRateLimiter::prune(uint64_t now) {
+    QHash<QString, Bucket>::iterator it = _buckets.begin();
+    while (it != _buckets.end()) {
+        if (refill(*it, now) >= _burst)
+            it = _buckets.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,57 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSRATELIMITER_H
+#define WSRATELIMITER_H
+
+#include <stdint.h>
+
+#include <QHash>
+#include <QString>
+
+// Buckets kept before idle (full) ones are dropped
+#define RATE_LIMITER_MAX_BUCKETS 1024
+
+// Token buckets keyed by client IP address. Not thread-safe : WSServer
+// only uses it from the main thread, under its clients mutex.
+class WSRateLimiter {
+  public:
+    WSRateLimiter();
+
+    // Tokens per second, and bucket size. A rate of 0 disables the limit.
+    void SetRate(uint64_t rate, uint64_t burst);
+
+    // Takes a token from the key's bucket, if there is one left
+    bool Allow(const QString& key, uint64_t now);
+    void Clear();
+
+  private:
+    struct Bucket {
+        double tokens;
+        uint64_t updatedAt;
+    };
+
+    double refill(const Bucket& bucket, uint64_t now);
+    void prune(uint64_t now);
+
+    double _rate; // per ns
+    double _burst;
+    QHash<QString, Bucket> _buckets;
+};
+
+#endif // WSRATELIMITER_H
@@ -21,7 +21,11 @@
 
 #include "Config.h"
 #include "Utils.h"
+#include "MsgPack.h"
 
+#include "WSServer.h"
+#include "WSDebugLog.h"
+#include "WSWatchdog.h"
 #include "WSRequestHandler.h"
 
 QHash<QString, void(*)(WSRequestHandler*)> WSRequestHandler::messageMap {
@@ -29,7 +33,19 @@ QHash<QString, void(*)(WSRequestHandler*)> WSRequestHandler::messageMap {
     { "GetAuthRequired", WSRequestHandler::HandleGetAuthRequired },
     { "Authenticate", WSRequestHandler::HandleAuthenticate },
 
+    { "CancelRequest", WSRequestHandler::HandleCancelRequest },
+    { "GetServerTime", WSRequestHandler::HandleGetServerTime },
+    { "SetEventTimestamps", WSRequestHandler::HandleSetEventTimestamps },
     { "SetHeartbeat", WSRequestHandler::HandleSetHeartbeat },
+    { "SetEventBatching", WSRequestHandler::HandleSetEventBatching },
+    { "SetNameInterning", WSRequestHandler::HandleSetNameInterning },
+    { "GetStats", WSRequestHandler::HandleGetStats },
+    { "ScheduleRequest", WSRequestHandler::HandleScheduleRequest },
+    { "ListScheduledRequests", WSRequestHandler::HandleListScheduledRequests },
+    { "CancelScheduledRequest", WSRequestHandler::HandleCancelScheduledRequest },
+    { "AddRule", WSRequestHandler::HandleAddRule },
+    { "RemoveRule", WSRequestHandler::HandleRemoveRule },
+    { "ListRules", WSRequestHandler::HandleListRules },
 
     { "SetFilenameFormatting", WSRequestHandler::HandleSetFilenameFormatting },
     { "GetFilenameFormatting", WSRequestHandler::HandleGetFilenameFormatting },
@@ -120,15 +136,70 @@ QSet<QString> WSRequestHandler::authNotRequired {
     "Authenticate"
 };
 
-WSRequestHandler::WSRequestHandler(QWebSocket* client) :
+QSet<QString> WSRequestHandler::controlRequests {
+    "Authenticate",
+    "SetCurrentScene",
+    "SetPreviewScene",
+    "TransitionToProgram",
+    "SetCurrentTransition",
+    "EnableStudioMode",
+    "DisableStudioMode",
+    "ToggleStudioMode",
+    "StartStopStreaming",
+    "StartStreaming",
+    "StopStreaming",
+    "StartStopRecording",
+    "StartRecording",
+    "StopRecording",
+    "StartStopReplayBuffer",
+    "StartReplayBuffer",
+    "StopReplayBuffer",
+    "SaveReplayBuffer",
+    "SetMute",
+    "ToggleMute"
+};
+
+QSet<QString> WSRequestHandler::bulkRequests {
+    "GetSceneList",
+    "GetSourcesList",
+    "GetSourceTypesList",
+    "GetTransitionList",
+    "ListSceneCollections",
+    "ListProfiles",
+    "GetStats"
+};
+
+// A CancelRequest queued behind the request it cancels would be useless,
+// time spent in the queue would skew the clock offset of GetServerTime
+QSet<QString> WSRequestHandler::unqueuedRequests {
+    "CancelRequest",
+    "GetServerTime"
+};
+
+// Requests acting on the client's connection, which can't run on behalf of
+// a client that went away
+QSet<QString> WSRequestHandler::sessionRequests {
+    "Authenticate",
+    "CancelRequest",
+    "SetHeartbeat",
+    "SetEventBatching",
+    "SetNameInterning",
+    "SetEventTimestamps",
+    "ScheduleRequest"
+};
+
+WSRequestHandler::WSRequestHandler(ClientSession* session) :
     _messageId(0),
     _requestType(""),
+    _debugSampled(false),
+    _rejection(nullptr),
+    _receivedAt(0),
     data(nullptr),
-    _client(client)
+    _session(session)
 {
 }
 
-void WSRequestHandler::processIncomingMessage(QString textMessage) {
+bool WSRequestHandler::parseIncomingMessage(QString textMessage) {
     QByteArray msgData = textMessage.toUtf8();
     const char* msg = msgData.constData();
 
@@ -139,13 +210,107 @@ void WSRequestHandler::processIncomingMessage(QString textMessage) {
 
         blog(LOG_ERROR, "invalid JSON payload received for '%s'", msg);
         SendErrorResponse("invalid JSON payload");
-        return;
+        return false;
+    }
+
+    if (Config::Current()->DebugEnabled) {
+        WSDebugLog* debugLog = WSDebugLog::Current();
+        _debugSampled = debugLog->ShouldSample(
+            obs_data_get_string(data, "request-type"));
+
+        if (_debugSampled)
+            debugLog->Log(WSDebugLog::Request, msg, msgData.size());
+    }
+
+    return true;
+}
+
+void WSRequestHandler::setRequest(obs_data_t* request) {
+    data = obs_data_create();
+    obs_data_apply(data, request);
+}
+
+bool WSRequestHandler::parseIncomingBinaryMessage(QByteArray binaryMessage) {
+    data = MsgPack::ToData(binaryMessage.constData(), binaryMessage.size());
+    if (!data) {
+        blog(LOG_ERROR, "invalid MessagePack payload received (%d bytes)",
+            binaryMessage.size());
+        SendErrorResponse("invalid MessagePack payload");
+        return false;
     }
 
     if (Config::Current()->DebugEnabled) {
-        blog(LOG_DEBUG, "Request >> '%s'", msg);
+        WSDebugLog* debugLog = WSDebugLog::Current();
+        _debugSampled = debugLog->ShouldSample(
+            obs_data_get_string(data, "request-type"));
+
+        if (_debugSampled) {
+            const char* json = obs_data_get_json(data);
+            debugLog->Log(WSDebugLog::Request, json, strlen(json));
+        }
     }
 
+    return true;
+}
+
+RequestPriority WSRequestHandler::priority() {
+    QString requestType = obs_data_get_string(data, "request-type");
+    if (controlRequests.contains(requestType))
+        return PriorityControl;
+    if (bulkRequests.contains(requestType))
+        return PriorityBulk;
+    if (requestType.startsWith("Get") || requestType.startsWith("List"))
+        return PriorityQuery;
+    return PriorityMutation;
+}
+
+QString WSRequestHandler::requestType() {
+    return QString::fromUtf8(obs_data_get_string(data, "request-type"));
+}
+
+QByteArray WSRequestHandler::coalescingKey() {
+    if (priority() < PriorityQuery)
+        return QByteArray();
+
+    OBSDataAutoRelease parameters = obs_data_create();
+    obs_data_apply(parameters, data);
+    obs_data_erase(parameters, "message-id");
+    obs_data_erase(parameters, "deadline-ms");
+    obs_data_erase(parameters, "idempotency-key");
+    obs_data_erase(parameters, "client-id");
+    return QByteArray(obs_data_get_json(parameters));
+}
+
+obs_data_t* WSRequestHandler::response() {
+    return _response;
+}
+
+QString WSRequestHandler::messageId() {
+    return QString::fromUtf8(obs_data_get_string(data, "message-id"));
+}
+
+bool WSRequestHandler::isUnqueued() {
+    return unqueuedRequests.contains(
+        QString::fromUtf8(obs_data_get_string(data, "request-type")));
+}
+
+uint64_t WSRequestHandler::deadline() {
+    if (!hasField("deadline-ms"))
+        return 0;
+
+    long long deadline = obs_data_get_int(data, "deadline-ms");
+    return (deadline > 0) ? (uint64_t)deadline : 0;
+}
+
+QString WSRequestHandler::idempotencyKey() {
+    return QString::fromUtf8(obs_data_get_string(data, "idempotency-key"));
+}
+
+QString WSRequestHandler::clientId() {
+    return QString::fromUtf8(obs_data_get_string(data, "client-id"));
+}
+
+void WSRequestHandler::processRequest() {
     if (!hasField("request-type")
         || !hasField("message-id"))
     {
@@ -156,25 +321,50 @@ void WSRequestHandler::processIncomingMessage(QString textMessage) {
     _requestType = obs_data_get_string(data, "request-type");
     _messageId = obs_data_get_string(data, "message-id");
 
+    if (_rejection) {
+        SendErrorResponse(_rejection);
+        return;
+    }
+
+    if (!_session && sessionRequests.contains(_requestType)) {
+        SendErrorResponse("client disconnected");
+        return;
+    }
+
     if (Config::Current()->AuthRequired
-        && (_client->property(PROP_AUTHENTICATED).toBool() == false)
+        && _session && !_session->authenticated
         && (authNotRequired.find(_requestType) == authNotRequired.end()))
     {
         SendErrorResponse("Not Authenticated");
         return;
     }
 
-    void (*handlerFunc)(WSRequestHandler*) = (messageMap[_requestType]);
+    void (*handlerFunc)(WSRequestHandler*) = messageMap.value(_requestType);
 
-    if (handlerFunc != nullptr)
+    if (handlerFunc != nullptr) {
+        WSActivityScope activity(WSWatchdog::InternName(_requestType));
         handlerFunc(this);
-    else
+    }
+    else {
         SendErrorResponse("invalid request type");
+    }
 }
 
 WSRequestHandler::~WSRequestHandler() {
 }
 
+void WSRequestHandler::setRejection(const char* error) {
+    _rejection = error;
+}
+
+void WSRequestHandler::setReceivedAt(uint64_t receivedAt) {
+    _receivedAt = receivedAt;
+}
+
+void WSRequestHandler::setResponseFields(obs_data_t* fields) {
+    _responseFields = fields;
+}
+
 void WSRequestHandler::SendOKResponse(obs_data_t* additionalFields) {
     OBSDataAutoRelease response = obs_data_create();
     obs_data_set_string(response, "status", "ok");
@@ -207,11 +397,17 @@ void WSRequestHandler::SendErrorResponse(obs_data_t* additionalFields) {
 }
 
 void WSRequestHandler::SendResponse(obs_data_t* response)  {
-    QString json = obs_data_get_json(response);
-    _client->sendTextMessage(json);
+    if (_responseFields)
+        obs_data_apply(response, _responseFields);
+
+    _response = response;
+    if (_session)
+        WSServer::Instance->sendMessage(_session, response, _requestType);
 
-    if (Config::Current()->DebugEnabled)
-        blog(LOG_DEBUG, "Response << '%s'", json.toUtf8().constData());
+    if (_debugSampled) {
+        const char* json = obs_data_get_json(response);
+        WSDebugLog::Current()->Log(WSDebugLog::Response, json, strlen(json));
+    }
 }
 
 bool WSRequestHandler::hasField(QString name) {
@@ -30,34 +30,106 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include "obs-websocket.h"
 
+struct ClientSession;
+
+// Order in which queued requests are executed, across clients
+enum RequestPriority {
+    PriorityControl = 0, // Transitions, scene switches, outputs
+    PriorityMutation,
+    PriorityQuery,
+    PriorityBulk // Large lists and stats
+};
+
 class WSRequestHandler : public QObject {
   Q_OBJECT
 
   public:
-    explicit WSRequestHandler(QWebSocket* client);
+    explicit WSRequestHandler(ClientSession* session);
     ~WSRequestHandler();
-    void processIncomingMessage(QString textMessage);
+    // Return false if the message is invalid : the error is already sent
+    bool parseIncomingMessage(QString textMessage);
+    bool parseIncomingBinaryMessage(QByteArray binaryMessage);
+
+    // Request built by obs-websocket itself, such as a scheduled one
+    void setRequest(obs_data_t* request);
+
+    // Runs the parsed request
+    void processRequest();
+    RequestPriority priority();
+    QString requestType();
+    QString messageId();
+
+    // Identical for read requests of the same type with the same
+    // parameters, empty for other requests
+    QByteArray coalescingKey();
+
+    // Response sent by processRequest()
+    obs_data_t* response();
+
+    // Requests run as soon as they are received, rather than queued
+    bool isUnqueued();
+
+    // Time (in milliseconds) the client is willing to wait for the request
+    // to start, 0 if unlimited
+    uint64_t deadline();
+
+    // Key under which the response is kept to answer retries, empty if none
+    QString idempotencyKey();
+
+    // Identity chosen by the client, kept across its reconnections, under
+    // which its idempotency keys are scoped. Empty if none.
+    QString clientId();
     bool hasField(QString name);
 
+    // The request is answered with this error instead of being processed
+    void setRejection(const char* error);
+
+    // Time the request was received (os_gettime_ns)
+    void setReceivedAt(uint64_t receivedAt);
+
+    // Added to the response
+    void setResponseFields(obs_data_t* fields);
+
+    static QHash<QString, void(*)(WSRequestHandler*)> messageMap;
+    static QSet<QString> authNotRequired;
+    static QSet<QString> controlRequests;
+    static QSet<QString> bulkRequests;
+    static QSet<QString> unqueuedRequests;
+    static QSet<QString> sessionRequests;
+
   private:
-    QWebSocket* _client;
+    ClientSession* _session;
     const char* _messageId;
     const char* _requestType;
+    bool _debugSampled;
+    const char* _rejection;
+    uint64_t _receivedAt;
     OBSDataAutoRelease data;
+    OBSData _response;
+    OBSData _responseFields;
 
     void SendOKResponse(obs_data_t* additionalFields = NULL);
     void SendErrorResponse(const char* errorMessage);
     void SendErrorResponse(obs_data_t* additionalFields = NULL);
     void SendResponse(obs_data_t* response);
 
-    static QHash<QString, void(*)(WSRequestHandler*)> messageMap;
-    static QSet<QString> authNotRequired;
-
     static void HandleGetVersion(WSRequestHandler* req);
     static void HandleGetAuthRequired(WSRequestHandler* req);
     static void HandleAuthenticate(WSRequestHandler* req);
 
+    static void HandleCancelRequest(WSRequestHandler* req);
+    static void HandleGetServerTime(WSRequestHandler* req);
+    static void HandleSetEventTimestamps(WSRequestHandler* req);
     static void HandleSetHeartbeat(WSRequestHandler* req);
+    static void HandleSetEventBatching(WSRequestHandler* req);
+    static void HandleSetNameInterning(WSRequestHandler* req);
+    static void HandleGetStats(WSRequestHandler* req);
+    static void HandleScheduleRequest(WSRequestHandler* req);
+    static void HandleListScheduledRequests(WSRequestHandler* req);
+    static void HandleCancelScheduledRequest(WSRequestHandler* req);
+    static void HandleAddRule(WSRequestHandler* req);
+    static void HandleRemoveRule(WSRequestHandler* req);
+    static void HandleListRules(WSRequestHandler* req);
 
     static void HandleSetFilenameFormatting(WSRequestHandler* req);
     static void HandleGetFilenameFormatting(WSRequestHandler* req);
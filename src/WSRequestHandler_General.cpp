@@ -1,8 +1,14 @@
+#include <QDateTime>
 #include <QString>
+#include <util/platform.h>
 
 #include "Config.h"
 #include "Utils.h"
+#include "WSDeflate.h"
+#include "WSEventRing.h"
 #include "WSEvents.h"
+#include "WSServer.h"
+#include "WSWatchdog.h"
 
 #include "WSRequestHandler.h"
 
@@ -70,7 +76,9 @@ void WSRequestHandler::HandleGetAuthRequired(WSRequestHandler* req) {
 }
 
 /**
- * Attempt to authenticate the client to the server.
+ * Attempt to authenticate the client to the server. After a failed attempt,
+ * attempts from the same IP address are refused for a delay doubling at each
+ * consecutive failure (from 0.5 to 60 seconds).
  *
  * @param {String} `auth` Response to the auth challenge (see "Authentication" for more information).
  *
@@ -91,10 +99,23 @@ void WSRequestHandler::HandleAuthenticate(WSRequestHandler* req) {
         return;
     }
 
-    if ((req->_client->property(PROP_AUTHENTICATED).toBool() == false)
-        && Config::Current()->CheckAuth(auth))
-    {
-        req->_client->setProperty(PROP_AUTHENTICATED, true);
+    if (req->_session->authenticated) {
+        req->SendErrorResponse("Authentication Failed.");
+        return;
+    }
+
+    uint64_t retryAfter = 0;
+    if (WSServer::Instance->authThrottled(req->_session, retryAfter)) {
+        QString error = QString("Too many failed attempts, retry in %1 ms")
+            .arg(retryAfter);
+        req->SendErrorResponse(error.toUtf8().constData());
+        return;
+    }
+
+    bool success = Config::Current()->CheckAuth(auth);
+    WSServer::Instance->authResult(req->_session, success);
+
+    if (success) {
         req->SendOKResponse();
     } else {
         req->SendErrorResponse("Authentication Failed.");
@@ -102,9 +123,128 @@ void WSRequestHandler::HandleAuthenticate(WSRequestHandler* req) {
 }
 
 /**
- * Enable/disable sending of the Heartbeat event
+ * Cancel a request sent earlier by this client that didn't start yet. The
+ * canceled request is answered with a `request canceled` error. This
+ * request is never queued : it runs as soon as it is received.
+ *
+ * @param {String} `target-message-id` `message-id` of the request to cancel.
+ *
+ * @return {boolean} `canceled` Whether the request was canceled. `false` if it already ran or was not found.
+ *
+ * @api requests
+ * @name CancelRequest
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleCancelRequest(WSRequestHandler* req) {
+    if (!req->hasField("target-message-id")) {
+        req->SendErrorResponse("CancelRequest <target-message-id> parameter missing");
+        return;
+    }
+
+    QString target = obs_data_get_string(req->data, "target-message-id");
+    bool canceled = WSServer::Instance->cancelRequest(req->_session, target);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "canceled", canceled);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Get the server's clocks, to estimate the offset between the client's
+ * clock and the server's monotonic clock (the one of `ScheduleRequest` and
+ * of the events' `server-time`), NTP-style. With `t0` and `t3` the client
+ * times of sending the request and receiving the response, and `t1` and
+ * `t2` the `receive-time` and `transmit-time` converted to the client's
+ * unit, the offset is `((t1 - t0) + (t2 - t3)) / 2` and the round trip
+ * time `(t3 - t0) - (t2 - t1)`. Keeping the offset of the samples with the
+ * shortest round trips gives the best estimate. This request is never
+ * queued : it runs as soon as it is received.
+ *
+ * @param {int (optional)} `client-time` Any client timestamp, sent back as is.
+ *
+ * @return {int} `receive-time` Time the request was received (in nanoseconds, on the monotonic clock).
+ * @return {int} `transmit-time` Time the response was sent (in nanoseconds, on the monotonic clock).
+ * @return {int} `wall-time` Server's wall clock when the response was sent (in milliseconds since January 1, 1970 UTC).
+ * @return {int (optional)} `client-time` `client-time` of the request.
+ *
+ * @api requests
+ * @name GetServerTime
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleGetServerTime(WSRequestHandler* req) {
+    OBSDataAutoRelease response = obs_data_create();
+    if (req->hasField("client-time")) {
+        obs_data_item_t* item =
+            obs_data_item_byname(req->data, "client-time");
+        if (obs_data_item_numtype(item) == OBS_DATA_NUM_DOUBLE) {
+            obs_data_set_double(response, "client-time",
+                obs_data_item_get_double(item));
+        }
+        else {
+            obs_data_set_int(response, "client-time",
+                obs_data_item_get_int(item));
+        }
+        obs_data_item_release(&item);
+    }
+
+    // Scheduled requests have no reception time
+    obs_data_set_int(response, "receive-time",
+        req->_receivedAt ? req->_receivedAt : os_gettime_ns());
+    obs_data_set_int(response, "wall-time",
+        QDateTime::currentMSecsSinceEpoch());
+    obs_data_set_int(response, "transmit-time", os_gettime_ns());
+    req->SendOKResponse(response);
+}
+
+/**
+ * Enable/disable the `server-time` field of the events sent to this
+ * client: the time the event was emitted, in nanoseconds on the server's
+ * monotonic clock (see `GetServerTime`).
+ *
+ * @param {boolean} `enable` Starts/Stops adding `server-time` to events.
+ *
+ * @return {boolean} `enable` Whether events have a `server-time`.
+ *
+ * @api requests
+ * @name SetEventTimestamps
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleSetEventTimestamps(WSRequestHandler* req) {
+    if (!req->hasField("enable")) {
+        req->SendErrorResponse("EventTimestamps <enable> parameter missing");
+        return;
+    }
+
+    bool enable = obs_data_get_bool(req->data, "enable");
+    WSServer::Instance->setEventTimestamps(req->_session, enable);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "enable", enable);
+    req->SendOKResponse(response);
+}
+
+// Names of the Heartbeat field groups, in HeartbeatFields order
+static const char* heartbeatFieldNames[HEARTBEAT_FIELD_GROUPS] = {
+    "profile",
+    "scene",
+    "streaming",
+    "recording"
+};
+
+/**
+ * Enable/disable sending of the Heartbeat event to this client. Each client
+ * has its own settings, heartbeats being disabled when it connects.
  *
  * @param {boolean} `enable` Starts/Stops emitting heartbeat messages
+ * @param {int (optional)} `interval` Time between two heartbeats (in milliseconds), between 250 and 30000, rounded up to a multiple of 250. Defaults to 2000.
+ * @param {Object (optional)} `fields` Field groups to include, each one enabled by a boolean: `profile`, `scene`, `streaming` and `recording`. Defaults to all of them. `pulse` is always included.
+ *
+ * @return {boolean} `enable` Whether heartbeats are sent.
+ * @return {int} `interval` Time between two heartbeats (in milliseconds).
+ * @return {Object} `fields` Field groups included.
  *
  * @api requests
  * @name SetHeartbeat
@@ -117,12 +257,531 @@ void WSRequestHandler::HandleAuthenticate(WSRequestHandler* req) {
         return;
     }
 
-    WSEvents::Instance->HeartbeatIsActive =
-        obs_data_get_bool(req->data, "enable");
+    bool enable = obs_data_get_bool(req->data, "enable");
+    long long interval = HEARTBEAT_DEFAULT_INTERVAL;
+    if (req->hasField("interval")) {
+        interval = obs_data_get_int(req->data, "interval");
+        if (interval < HEARTBEAT_TICK || interval > HEARTBEAT_MAX_INTERVAL) {
+            req->SendErrorResponse("invalid <interval> value");
+            return;
+        }
+    }
+
+    int fields = HeartbeatAllFields;
+    if (req->hasField("fields")) {
+        OBSDataAutoRelease requested = obs_data_get_obj(req->data, "fields");
+        fields = 0;
+        for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++) {
+            if (obs_data_get_bool(requested, heartbeatFieldNames[i]))
+                fields |= (1 << i);
+        }
+    }
+
+    // Heartbeats are only sent on ticks
+    interval = ((interval + HEARTBEAT_TICK - 1) / HEARTBEAT_TICK)
+        * HEARTBEAT_TICK;
+    WSServer::Instance->setHeartbeat(req->_session,
+        enable ? (uint64_t)interval : 0, fields);
+
+    OBSDataAutoRelease fieldsObj = obs_data_create();
+    for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++) {
+        obs_data_set_bool(fieldsObj, heartbeatFieldNames[i],
+            (fields & (1 << i)) != 0);
+    }
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "enable", enable);
+    obs_data_set_int(response, "interval", enable ? interval : 0);
+    obs_data_set_obj(response, "fields", fieldsObj);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Enable/disable event batching for this client. When enabled, the events
+ * emitted within a window following the first one are delivered together
+ * in a single `EventBatch` message, in the order they were emitted.
+ *
+ * @param {boolean} `enable` Starts/Stops batching events.
+ * @param {int (optional)} `window` Batching window (in milliseconds), between 1 and 1000. Defaults to 20.
+ *
+ * @return {boolean} `enable` Whether events are batched.
+ * @return {int} `window` Batching window (in milliseconds).
+ *
+ * @api requests
+ * @name SetEventBatching
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleSetEventBatching(WSRequestHandler* req) {
+    if (!req->hasField("enable")) {
+        req->SendErrorResponse("EventBatching <enable> parameter missing");
+        return;
+    }
+
+    bool enable = obs_data_get_bool(req->data, "enable");
+    long long window = EVENT_BATCH_DEFAULT_WINDOW;
+    if (req->hasField("window")) {
+        window = obs_data_get_int(req->data, "window");
+        if (window < 1 || window > EVENT_BATCH_MAX_WINDOW) {
+            req->SendErrorResponse("invalid <window> value");
+            return;
+        }
+    }
+
+    WSServer::Instance->setEventBatching(req->_session,
+        enable ? (uint64_t)window : 0);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "enable", enable);
+    obs_data_set_int(response, "window", enable ? window : 0);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Enable/disable name interning for this client. When enabled, scene,
+ * source and source type names (`name`, `type`, `scene-name`,
+ * `source-name`, `item-name`, `current-scene`, `from-scene` and `to-scene`
+ * fields) are replaced in responses and events by integer handles. The
+ * handles are defined by `NameTable` events, sent right before the first
+ * message using them and when a source is renamed. Handles are valid until
+ * interning is disabled or the client disconnects. Settings objects
+ * (`settings`, `sourceSettings` and `defaultSettings`) and rule
+ * definitions are left untouched.
+ *
+ * @param {boolean} `enable` Starts/Stops interning names.
+ *
+ * @return {boolean} `enable` Whether names are interned.
+ *
+ * @api requests
+ * @name SetNameInterning
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleSetNameInterning(WSRequestHandler* req) {
+    if (!req->hasField("enable")) {
+        req->SendErrorResponse("NameInterning <enable> parameter missing");
+        return;
+    }
+
+    bool enable = obs_data_get_bool(req->data, "enable");
+    WSServer::Instance->setNameInterning(req->_session, enable);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "enable", enable);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Get internal statistics of obs-websocket, for diagnostics.
+ *
+ * @return {Object} `main-thread` Responsiveness of the OBS main thread, which runs requests and events.
+ * @return {boolean} `main-thread.active` Whether the main thread is being monitored.
+ * @return {int} `main-thread.threshold-ms` Lag (in milliseconds) above which a `MainThreadStall` event is emitted.
+ * @return {int} `main-thread.probes` Number of lag measurements taken.
+ * @return {int} `main-thread.stalls` Number of measurements above the threshold.
+ * @return {double} `main-thread.average-lag-ms` Average lag (in milliseconds).
+ * @return {double} `main-thread.max-lag-ms` Highest lag measured (in milliseconds).
+ * @return {Array} `main-thread.lag-histogram` Lag distribution, as objects with a `count` and an upper bound `below-ms` (absent on the last bucket).
+ * @return {Array} `clients` Connected clients.
+ * @return {int} `clients.*.connection-id` Connection identifier, unique for the server's lifetime.
+ * @return {String} `clients.*.address` Client address and port.
+ * @return {boolean} `clients.*.authenticated` Whether the client is authenticated.
+ * @return {int} `clients.*.uptime-ms` Time since the client connected (in milliseconds).
+ * @return {int} `clients.*.messages-in` Number of requests received from the client.
+ * @return {int} `clients.*.messages-out` Number of responses and events sent to the client.
+ * @return {int} `clients.*.queued-bytes` Estimated number of bytes waiting to be written to the client.
+ * @return {int} `clients.*.queued-requests` Number of requests received from the client and waiting to be executed.
+ * @return {double} `clients.*.p99-latency-ms` 99th percentile of request handling time over the client's last requests, time spent waiting for execution included (in milliseconds).
+ * @return {double} `clients.*.rtt-ms` Round-trip time measured by the last ping (in milliseconds), 0 until the client answered one.
+ * @return {Array} `broadcasts` Cost of building and sending each event type.
+ * @return {String} `broadcasts.*.update-type` Event type.
+ * @return {int} `broadcasts.*.count` Number of times the event was emitted.
+ * @return {double} `broadcasts.*.total-time-ms` Total time spent emitting the event (in milliseconds).
+ * @return {int} `broadcasts.*.total-bytes` Total number of bytes sent to clients for the event.
+ * @return {Array} `compression` permessage-deflate statistics for each message type. Only the `epoll` backend compresses messages: empty with the `qt` backend, whatever `CompressionEnabled` is (see `transport.compression`).
+ * @return {String} `compression.*.message-type` Request type of a response, update type of an event (e.g. `GetSceneList`, `SwitchScenes`), or `text`/`binary` for other messages.
+ * @return {int} `compression.*.count` Number of compressed messages.
+ * @return {int} `compression.*.input-bytes` Total size of the messages before compression (in bytes).
+ * @return {int} `compression.*.output-bytes` Total size of the messages after compression (in bytes).
+ * @return {double} `compression.*.ratio` Compressed size divided by the uncompressed size.
+ * @return {double} `compression.*.total-time-ms` Total time spent compressing (in milliseconds).
+ * @return {Object} `event-ring` Shared memory event ring statistics.
+ * @return {boolean} `event-ring.active` Whether events are published to the ring.
+ * @return {String (optional)} `event-ring.name` Name of the shared memory object.
+ * @return {int (optional)} `event-ring.capacity` Size of the ring's data area (in bytes).
+ * @return {int (optional)} `event-ring.published` Number of events published.
+ * @return {int (optional)} `event-ring.oversized` Number of events too large to be published.
+ * @return {int (optional)} `event-ring.wakes` Number of times waiting readers were woken up.
+ * @return {Object} `tls` Secure connection statistics.
+ * @return {boolean} `tls.enabled` Whether the server accepts `wss://` connections (instead of `ws://`).
+ * @return {int} `tls.handshakes` Number of completed TLS handshakes.
+ * @return {int} `tls.resumed` Number of these handshakes resuming an earlier session (from a ticket or the session cache), skipping the full handshake. Always 0 with the `qt` backend.
+ * @return {int} `tls.handshake-errors` Number of failed TLS or WebSocket handshakes.
+ * @return {String (optional)} `tls.last-error` Description of the last handshake error.
+ * @return {Array} `tls.protocols` Number of completed handshakes for each TLS version.
+ * @return {String} `tls.protocols.*.protocol` TLS version.
+ * @return {int} `tls.protocols.*.count` Number of handshakes.
+ * @return {Object} `transport` WebSocket backend statistics.
+ * @return {String} `transport.backend` Backend in use: `qt` or `epoll`.
+ * @return {boolean} `transport.compression` Whether permessage-deflate is offered to clients. Only with the `epoll` backend and `CompressionEnabled`: QtWebSockets can't negotiate extensions.
+ * @return {int (optional)} `transport.connections` Number of open TCP connections (`epoll` only, same for the following fields).
+ * @return {int (optional)} `transport.accepted` Number of accepted TCP connections.
+ * @return {int (optional)} `transport.refused` Number of TCP connections closed right away, `MaxClients` connections (upgraded or not) being open.
+ * @return {int (optional)} `transport.handshake-timeouts` Number of connections closed for not completing their handshake within 5 seconds.
+ * @return {int (optional)} `transport.wakeups` Number of times the IO thread woke up.
+ * @return {int (optional)} `transport.reads` Number of read system calls.
+ * @return {int (optional)} `transport.writes` Number of write system calls, each one sending all the frames queued for a client.
+ * @return {int (optional)} `transport.frames-in` Number of frames received.
+ * @return {int (optional)} `transport.frames-out` Number of frames sent.
+ * @return {int (optional)} `transport.bytes-in` Number of bytes received.
+ * @return {int (optional)} `transport.bytes-out` Number of bytes sent.
+ * @return {int (optional)} `transport.messages-in` Number of messages received.
+ * @return {int (optional)} `transport.messages-out` Number of messages sent.
+ * @return {int (optional)} `transport.syscalls` Number of IO system calls made by the IO thread (waits, accepts, reads and writes).
+ * @return {double (optional)} `transport.writes-per-message` Write system calls per message sent. Below 1 when messages share writes.
+ * @return {double (optional)} `transport.syscalls-per-message` IO system calls per message sent or received.
+ * @return {Object} `admission` Connection admission and rate limiting.
+ * @return {int} `admission.max-clients` Maximum number of clients (0 if unlimited).
+ * @return {int} `admission.rejected-connections` Number of connections refused because of `max-clients` or the per-IP connection rate limit.
+ * @return {int} `admission.rejected-requests` Number of requests refused because of the per-IP request rate limit.
+ * @return {int} `admission.throttled-authentications` Number of `Authenticate` requests refused while waiting after a failed attempt.
+ * @return {int} `admission.timed-out-clients` Number of clients dropped for not answering a ping or not authenticating in time.
+ * @return {Object} `coalescing` Identical read requests answered with a single execution.
+ * @return {int} `coalescing.executed` Number of read requests executed.
+ * @return {int} `coalescing.coalesced` Number of read requests answered with the response of an identical one.
+ * @return {double} `coalescing.hit-rate` Share of read requests that were coalesced.
+ * @return {Array} `coalescing.requests` Same statistics for each request type.
+ * @return {String} `coalescing.requests.*.request-type` Request type.
+ * @return {int} `coalescing.requests.*.executed` Number of requests executed.
+ * @return {int} `coalescing.requests.*.coalesced` Number of requests coalesced.
+ * @return {double} `coalescing.requests.*.hit-rate` Share of requests that were coalesced.
+ * @return {Object} `idempotency` Responses kept for requests with an `idempotency-key`.
+ * @return {int} `idempotency.cached` Number of responses currently kept.
+ * @return {int} `idempotency.capacity` Maximum number of responses kept. The least recently used ones are dropped first.
+ * @return {int} `idempotency.stored` Number of responses kept since the server started.
+ * @return {int} `idempotency.replays` Number of retries answered with a kept response, without running the request again.
+ * @return {Object} `scheduler` Requests run at a given time, see `ScheduleRequest`.
+ * @return {int} `scheduler.pending` Number of requests waiting for their time.
+ * @return {int} `scheduler.executed` Number of scheduled requests executed.
+ * @return {double} `scheduler.average-lateness-ms` Average delay between the time a request was scheduled for and the time it ran (in milliseconds).
+ * @return {double} `scheduler.max-lateness-ms` Largest of these delays (in milliseconds).
+ *
+ * @api requests
+ * @name GetStats
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleGetStats(WSRequestHandler* req) {
+    OBSDataAutoRelease response = obs_data_create();
+
+    if (WSWatchdog::Instance) {
+        OBSDataAutoRelease mainThread = WSWatchdog::Instance->GetStats();
+        obs_data_set_obj(response, "main-thread", mainThread);
+    }
+
+    OBSDataArrayAutoRelease clients = obs_data_array_create();
+    for (const WSClientStats& stats : WSServer::Instance->clientStats()) {
+        OBSDataAutoRelease client = obs_data_create();
+        obs_data_set_int(client, "connection-id", stats.connectionId);
+        obs_data_set_string(client, "address", stats.address.toUtf8());
+        obs_data_set_bool(client, "authenticated", stats.authenticated);
+        obs_data_set_int(client, "uptime-ms", stats.uptime / 1000000);
+        obs_data_set_int(client, "messages-in", stats.messagesIn);
+        obs_data_set_int(client, "messages-out", stats.messagesOut);
+        obs_data_set_int(client, "queued-bytes", stats.queuedBytes);
+        obs_data_set_int(client, "queued-requests", stats.queuedRequests);
+        obs_data_set_double(client, "p99-latency-ms",
+            (double)stats.p99Latency / 1000000.0);
+        obs_data_set_double(client, "rtt-ms", (double)stats.rtt / 1000000.0);
+        obs_data_array_push_back(clients, client);
+    }
+    obs_data_set_array(response, "clients", clients);
+
+    OBSDataArrayAutoRelease broadcasts = obs_data_array_create();
+    QHash<QString, WSBroadcastStats> broadcastStats =
+        WSEvents::Instance->GetBroadcastStats();
+    for (QString updateType : broadcastStats.keys()) {
+        const WSBroadcastStats& stats = broadcastStats[updateType];
+
+        OBSDataAutoRelease broadcast = obs_data_create();
+        obs_data_set_string(broadcast, "update-type", updateType.toUtf8());
+        obs_data_set_int(broadcast, "count", stats.count);
+        obs_data_set_double(broadcast, "total-time-ms",
+            (double)stats.totalTime / 1000000.0);
+        obs_data_set_int(broadcast, "total-bytes", stats.totalBytes);
+        obs_data_array_push_back(broadcasts, broadcast);
+    }
+    obs_data_set_array(response, "broadcasts", broadcasts);
+
+    OBSDataArrayAutoRelease compression = WSDeflate::GetStats();
+    obs_data_set_array(response, "compression", compression);
+
+    if (WSEventRing::Instance) {
+        OBSDataAutoRelease eventRing = WSEventRing::Instance->GetStats();
+        obs_data_set_obj(response, "event-ring", eventRing);
+    }
+
+    WSTlsStats tlsStats = WSServer::Instance->tlsStats();
+    OBSDataAutoRelease tls = obs_data_create();
+    obs_data_set_bool(tls, "enabled", tlsStats.enabled);
+    obs_data_set_int(tls, "handshakes", tlsStats.handshakes);
+    obs_data_set_int(tls, "resumed", tlsStats.resumed);
+    obs_data_set_int(tls, "handshake-errors", tlsStats.handshakeErrors);
+    if (!tlsStats.lastError.isEmpty())
+        obs_data_set_string(tls, "last-error", tlsStats.lastError.toUtf8());
+
+    OBSDataArrayAutoRelease protocols = obs_data_array_create();
+    for (QString protocol : tlsStats.protocols.keys()) {
+        OBSDataAutoRelease item = obs_data_create();
+        obs_data_set_string(item, "protocol", protocol.toUtf8());
+        obs_data_set_int(item, "count", tlsStats.protocols[protocol]);
+        obs_data_array_push_back(protocols, item);
+    }
+    obs_data_set_array(tls, "protocols", protocols);
+    obs_data_set_obj(response, "tls", tls);
+
+    OBSDataAutoRelease transport = WSServer::Instance->transportStats();
+    obs_data_set_obj(response, "transport", transport);
+
+    OBSDataAutoRelease admission = WSServer::Instance->admissionStats();
+    obs_data_set_obj(response, "admission", admission);
+
+    OBSDataAutoRelease coalescing = WSServer::Instance->coalescingStats();
+    obs_data_set_obj(response, "coalescing", coalescing);
+
+    OBSDataAutoRelease idempotency = WSServer::Instance->idempotencyStats();
+    obs_data_set_obj(response, "idempotency", idempotency);
+
+    OBSDataAutoRelease scheduler =
+        WSServer::Instance->scheduler()->GetStats();
+    obs_data_set_obj(response, "scheduler", scheduler);
+
+    req->SendOKResponse(response);
+}
+
+/**
+ * Run a request at a given time. The timer wakes up shortly before, the
+ * last milliseconds being waited precisely. Once it ran, the request is
+ * answered like any other, with additional `schedule-id`, `scheduled-at`
+ * and `executed-at` fields: the time it was scheduled for and the time it
+ * actually ran (in milliseconds, on the monotonic clock). A scheduled
+ * request still runs if its client disconnected meanwhile, unanswered.
+ *
+ * @param {Object} `request` Request to run, with its `request-type` and `message-id`. `Authenticate`, `CancelRequest`, `SetHeartbeat`, `SetEventBatching`, `SetNameInterning`, `SetEventTimestamps` and `ScheduleRequest` can't be scheduled.
+ * @param {double} `at` Time to run the request at (in milliseconds). Requests scheduled in the past run right away.
+ * @param {String (optional)} `clock` Clock of `at`: `monotonic` (the server's monotonic clock, default) or `wall` (milliseconds since January 1, 1970 UTC, on the server's clock).
+ * @param {boolean (optional)} `align-to-frame` Run the request just before the first video frame rendered at or after `at`, so that its change appears in that frame. Defaults to false.
+ *
+ * @return {int} `schedule-id` Identifier of the scheduled request.
+ * @return {double} `execute-at` Time the request will run at (in milliseconds, on the clock of `at`), after frame alignment.
+ *
+ * @api requests
+ * @name ScheduleRequest
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleScheduleRequest(WSRequestHandler* req) {
+    if (!req->hasField("request") || !req->hasField("at")) {
+        req->SendErrorResponse("ScheduleRequest <request> or <at> parameter missing");
+        return;
+    }
+
+    OBSDataAutoRelease request = obs_data_get_obj(req->data, "request");
+    QString requestType = obs_data_get_string(request, "request-type");
+    if (!messageMap.contains(requestType)
+        || sessionRequests.contains(requestType)
+        || !obs_data_has_user_value(request, "message-id"))
+    {
+        req->SendErrorResponse("invalid <request> value");
+        return;
+    }
+
+    // Difference between the clock of at and the monotonic clock, in ms
+    double now = (double)os_gettime_ns() / 1000000.0;
+    double offset = 0.0;
+    if (req->hasField("clock")) {
+        QString clock = obs_data_get_string(req->data, "clock");
+        if (clock == "wall") {
+            offset = (double)QDateTime::currentMSecsSinceEpoch() - now;
+        }
+        else if (clock != "monotonic") {
+            req->SendErrorResponse("invalid <clock> value");
+            return;
+        }
+    }
+
+    double at = obs_data_get_double(req->data, "at") - offset;
+    if (at > now + SCHEDULER_MAX_DELAY) {
+        req->SendErrorResponse("invalid <at> value");
+        return;
+    }
+
+    WSScheduler* scheduler = WSServer::Instance->scheduler();
+    if (scheduler->Size() >= SCHEDULER_MAX_REQUESTS) {
+        req->SendErrorResponse("too many scheduled requests");
+        return;
+    }
+
+    bool alignToFrame = obs_data_get_bool(req->data, "align-to-frame");
+    uint64_t executeAt = 0;
+    quint32 id = scheduler->Schedule(req->_session, request,
+        (uint64_t)(((at > now) ? at : now) * 1000000.0), alignToFrame,
+        executeAt);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_int(response, "schedule-id", id);
+    obs_data_set_double(response, "execute-at",
+        (double)executeAt / 1000000.0 + offset);
+    req->SendOKResponse(response);
+}
+
+/**
+ * List the requests waiting for their time, of all clients.
+ *
+ * @return {Array} `requests` Scheduled requests, in execution order.
+ * @return {int} `requests.*.schedule-id` Identifier of the scheduled request.
+ * @return {int} `requests.*.connection-id` Connection of the client that scheduled it, 0 if it disconnected.
+ * @return {String} `requests.*.request-type` Request type.
+ * @return {String} `requests.*.message-id` `message-id` of the request.
+ * @return {double} `requests.*.requested-at` Time it was scheduled at (in milliseconds, on the monotonic clock).
+ * @return {double} `requests.*.execute-at` Time it will run at, after frame alignment.
+ *
+ * @api requests
+ * @name ListScheduledRequests
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleListScheduledRequests(WSRequestHandler* req) {
+    OBSDataArrayAutoRelease requests =
+        WSServer::Instance->scheduler()->List();
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_array(response, "requests", requests);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Cancel a scheduled request that didn't run yet. Unlike `CancelRequest`,
+ * the canceled request is not answered.
+ *
+ * @param {int} `schedule-id` Identifier of the scheduled request.
+ *
+ * @return {boolean} `canceled` Whether the request was canceled. `false` if it already ran or was not found.
+ *
+ * @api requests
+ * @name CancelScheduledRequest
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleCancelScheduledRequest(WSRequestHandler* req) {
+    if (!req->hasField("schedule-id")) {
+        req->SendErrorResponse("CancelScheduledRequest <schedule-id> parameter missing");
+        return;
+    }
+
+    quint32 id = (quint32)obs_data_get_int(req->data, "schedule-id");
+    bool canceled = WSServer::Instance->scheduler()->Cancel(id);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "canceled", canceled);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Add a rule running requests when an event matches, in OBS itself rather
+ * than through a client. The actions run right after the event was sent
+ * to the clients, in order, as if sent by a client: their responses are
+ * dropped. Rules aren't tied to the client adding them and last until OBS
+ * exits. Chains of rules triggered by events of other rules' actions stop
+ * after 4 rules, events matching within a second of a rule's actions
+ * counting as triggered by them. A rule runs at most 10 times per second.
+ *
+ * @param {String (optional)} `name` Name of the rule, for `ListRules`.
+ * @param {String} `event` `update-type` of the events to match.
+ * @param {Array (optional)} `conditions` Conditions on the event's fields, all of which must hold (at most 16).
+ * @param {String} `conditions.*.field` Field name. Fields of nested objects are separated by dots (e.g. `transform.position.x`).
+ * @param {String (optional)} `conditions.*.op` `equals` (default), `not-equals`, `less-than`, `greater-than` or `exists`.
+ * @param {String | double | boolean} `conditions.*.value` Value to compare the field with. With `exists`, whether the field must be present (optional, defaults to true).
+ * @param {Array} `actions` Requests to run, with their `request-type` and parameters (at most 16). `message-id` is optional. `AddRule` and the requests acting on a client's connection (`Authenticate`, `CancelRequest`, `SetHeartbeat`, `SetEventBatching`, `SetNameInterning`, `SetEventTimestamps`, `ScheduleRequest`) aren't allowed.
+ *
+ * @return {int} `rule-id` Identifier of the rule.
+ *
+ * @api requests
+ * @name AddRule
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleAddRule(WSRequestHandler* req) {
+    if (!req->hasField("event") || !req->hasField("actions")) {
+        req->SendErrorResponse("AddRule <event> or <actions> parameter missing");
+        return;
+    }
+
+    const char* error = nullptr;
+    quint32 id = WSServer::Instance->rules()->Add(req->data, error);
+    if (!id) {
+        req->SendErrorResponse(error);
+        return;
+    }
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_int(response, "rule-id", id);
+    req->SendOKResponse(response);
+}
+
+/**
+ * Remove a rule added with `AddRule`.
+ *
+ * @param {int} `rule-id` Identifier of the rule.
+ *
+ * @return {boolean} `removed` Whether the rule was removed. `false` if it was not found.
+ *
+ * @api requests
+ * @name RemoveRule
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleRemoveRule(WSRequestHandler* req) {
+    if (!req->hasField("rule-id")) {
+        req->SendErrorResponse("RemoveRule <rule-id> parameter missing");
+        return;
+    }
+
+    quint32 id = (quint32)obs_data_get_int(req->data, "rule-id");
+    bool removed = WSServer::Instance->rules()->Remove(id);
+
+    OBSDataAutoRelease response = obs_data_create();
+    obs_data_set_bool(response, "removed", removed);
+    req->SendOKResponse(response);
+}
+
+/**
+ * List the rules added with `AddRule`, with their statistics.
+ *
+ * @return {Array} `rules` Rules, in the order they were added.
+ * @return {int} `rules.*.rule-id` Identifier of the rule.
+ * @return {String} `rules.*.name` Name of the rule.
+ * @return {String} `rules.*.event` `update-type` of the events matched.
+ * @return {Array} `rules.*.conditions` Conditions, as defined.
+ * @return {Array} `rules.*.actions` Requests run, as defined.
+ * @return {int} `rules.*.hits` Number of matching events.
+ * @return {int} `rules.*.executions` Number of times the actions ran.
+ * @return {int} `rules.*.errors` Number of actions answered with an error.
+ * @return {int} `rules.*.loops-broken` Number of matching events ignored for being too deep in a chain of rules.
+ * @return {int} `rules.*.throttled` Number of matching events ignored for the rule running more than 10 times per second.
+ * @return {double} `rules.*.average-latency-ms` Average time from the event to the end of the actions (in milliseconds).
+ * @return {double} `rules.*.max-latency-ms` Longest of these times (in milliseconds).
+ *
+ * @api requests
+ * @name ListRules
+ * @category general
+ * @since 5.0.0
+ */
+void WSRequestHandler::HandleListRules(WSRequestHandler* req) {
+    OBSDataArrayAutoRelease rules = WSServer::Instance->rules()->List();
 
     OBSDataAutoRelease response = obs_data_create();
-    obs_data_set_bool(response, "enable",
-        WSEvents::Instance->HeartbeatIsActive);
+    obs_data_set_array(response, "rules", rules);
     req->SendOKResponse(response);
 }
 
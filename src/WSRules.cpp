@@ -0,0 +1,430 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <QtCore/QThread>
+#include <util/platform.h>
+
+#include <string.h>
+
+#include "WSRules.h"
+#include "WSRequestHandler.h"
+
+// Operator names, in Operator order
+static const char* operatorNames[] = {
+    "equals",
+    "not-equals",
+    "less-than",
+    "greater-than",
+    "exists"
+};
+
+// Sets order like strcmp. Returns false if the items can't be compared.
+static bool CompareItems(obs_data_item_t* item, obs_data_item_t* value,
+    int& order)
+{
+    obs_data_type type = obs_data_item_gettype(item);
+    if (type != obs_data_item_gettype(value))
+        return false;
+
+    switch (type) {
+        case OBS_DATA_STRING:
+            order = strcmp(obs_data_item_get_string(item),
+                obs_data_item_get_string(value));
+            return true;
+
+        case OBS_DATA_NUMBER: {
+            double a = obs_data_item_get_double(item);
+            double b = obs_data_item_get_double(value);
+            order = (a < b) ? -1 : ((a > b) ? 1 : 0);
+            return true;
+        }
+
+        case OBS_DATA_BOOLEAN:
+            order = (int)obs_data_item_get_bool(item)
+                - (int)obs_data_item_get_bool(value);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+WSRules::WSRules(QObject* parent)
+    : QObject(parent),
+      _runScheduled(false),
+      _depth(0),
+      _chainDepth(0),
+      _chainEnd(0),
+      _nextId(1)
+{
+}
+
+WSRules::~WSRules() {
+}
+
+bool WSRules::ParseCondition(obs_data_t* definition, Condition& condition) {
+    QString field = obs_data_get_string(definition, "field");
+    if (field.isEmpty())
+        return false;
+
+    condition.path = field.split('.');
+
+    QString op = obs_data_has_user_value(definition, "op")
+        ? obs_data_get_string(definition, "op") : "equals";
+    int i = 0;
+    while (i <= OperatorExists && op != operatorNames[i])
+        i++;
+    if (i > OperatorExists)
+        return false;
+
+    condition.op = (Operator)i;
+
+    OBSDataAutoRelease value = obs_data_create();
+    obs_data_item_t* item = obs_data_item_byname(definition, "value");
+    bool valid = true;
+    if (condition.op == OperatorExists) {
+        // Whether the field must exist, true if omitted
+        if (item && obs_data_item_gettype(item) != OBS_DATA_BOOLEAN)
+            valid = false;
+        obs_data_set_bool(value, "value",
+            item ? obs_data_item_get_bool(item) : true);
+    }
+    else if (!item) {
+        valid = false;
+    }
+    else {
+        switch (obs_data_item_gettype(item)) {
+            case OBS_DATA_STRING:
+                obs_data_set_string(value, "value",
+                    obs_data_item_get_string(item));
+                break;
+
+            case OBS_DATA_NUMBER:
+                obs_data_set_double(value, "value",
+                    obs_data_item_get_double(item));
+                break;
+
+            case OBS_DATA_BOOLEAN:
+                obs_data_set_bool(value, "value",
+                    obs_data_item_get_bool(item));
+                break;
+
+            default:
+                valid = false;
+        }
+    }
+    obs_data_item_release(&item);
+
+    condition.value = value;
+    return valid;
+}
+
+bool WSRules::Evaluate(const Condition& condition, obs_data_t* event) {
+    OBSData parent = event;
+    for (int i = 0; parent && i < condition.path.size() - 1; i++) {
+        OBSDataAutoRelease child =
+            obs_data_get_obj(parent, condition.path[i].toUtf8());
+        parent = (obs_data_t*)child;
+    }
+
+    obs_data_item_t* item = parent
+        ? obs_data_item_byname(parent, condition.path.last().toUtf8())
+        : nullptr;
+
+    bool result = false;
+    if (condition.op == OperatorExists) {
+        result = (item != nullptr)
+            == obs_data_get_bool(condition.value, "value");
+    }
+    else if (!item) {
+        result = (condition.op == OperatorNotEquals);
+    }
+    else {
+        obs_data_item_t* value =
+            obs_data_item_byname(condition.value, "value");
+        int order = 0;
+        bool comparable = CompareItems(item, value, order);
+        obs_data_item_release(&value);
+
+        switch (condition.op) {
+            case OperatorEquals:
+                result = comparable && order == 0;
+                break;
+            case OperatorNotEquals:
+                result = !comparable || order != 0;
+                break;
+            case OperatorLessThan:
+                result = comparable && order < 0;
+                break;
+            case OperatorGreaterThan:
+                result = comparable && order > 0;
+                break;
+            default:
+                break;
+        }
+    }
+
+    obs_data_item_release(&item);
+    return result;
+}
+
+quint32 WSRules::Add(obs_data_t* definition, const char*& error) {
+    Rule rule;
+    rule.name = obs_data_get_string(definition, "name");
+    rule.eventType = obs_data_get_string(definition, "event");
+    rule.hits = 0;
+    rule.executions = 0;
+    rule.errors = 0;
+    rule.loopsBroken = 0;
+    rule.throttled = 0;
+    rule.rateWindowStart = 0;
+    rule.rateCount = 0;
+    rule.totalLatency = 0;
+    rule.maxLatency = 0;
+
+    if (rule.eventType.isEmpty()) {
+        error = "invalid <event> value";
+        return 0;
+    }
+
+    OBSDataArrayAutoRelease conditions =
+        obs_data_get_array(definition, "conditions");
+    size_t count = conditions ? obs_data_array_count(conditions) : 0;
+    if (count > RULE_MAX_CONDITIONS) {
+        error = "invalid <conditions> value";
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        OBSDataAutoRelease item = obs_data_array_item(conditions, i);
+        Condition condition;
+        if (!ParseCondition(item, condition)) {
+            error = "invalid <conditions> value";
+            return 0;
+        }
+        rule.conditions.append(condition);
+    }
+
+    if (!conditions)
+        conditions = obs_data_array_create();
+    rule.conditionList = (obs_data_array_t*)conditions;
+
+    OBSDataArrayAutoRelease actions =
+        obs_data_get_array(definition, "actions");
+    count = actions ? obs_data_array_count(actions) : 0;
+    if (count == 0 || count > RULE_MAX_ACTIONS) {
+        error = "invalid <actions> value";
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        OBSDataAutoRelease item = obs_data_array_item(actions, i);
+
+        // Actions run on behalf of no client
+        QString requestType = obs_data_get_string(item, "request-type");
+        if (!WSRequestHandler::messageMap.contains(requestType)
+            || WSRequestHandler::sessionRequests.contains(requestType)
+            || requestType == "AddRule")
+        {
+            error = "invalid <actions> value";
+            return 0;
+        }
+
+        OBSDataAutoRelease action = obs_data_create();
+        obs_data_apply(action, item);
+        rule.actions.append(OBSData(action));
+    }
+
+    QMutexLocker locker(&_mutex);
+    if (_rules.size() >= RULES_MAX) {
+        error = "too many rules";
+        return 0;
+    }
+
+    rule.id = _nextId++;
+    for (int i = 0; i < rule.actions.size(); i++) {
+        if (!obs_data_has_user_value(rule.actions[i], "message-id")) {
+            obs_data_set_string(rule.actions[i], "message-id",
+                QString("rule-%1-%2").arg(rule.id).arg(i).toUtf8());
+        }
+    }
+
+    _rules.append(rule);
+    return rule.id;
+}
+
+bool WSRules::Remove(quint32 id) {
+    QMutexLocker locker(&_mutex);
+    for (int i = 0; i < _rules.size(); i++) {
+        if (_rules[i].id == id) {
+            _rules.removeAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called with _mutex held
+WSRules::Rule* WSRules::find(quint32 id) {
+    for (Rule& rule : _rules) {
+        if (rule.id == id)
+            return &rule;
+    }
+    return nullptr;
+}
+
+obs_data_array_t* WSRules::List() {
+    obs_data_array_t* list = obs_data_array_create();
+
+    QMutexLocker locker(&_mutex);
+    for (const Rule& rule : _rules) {
+        OBSDataArrayAutoRelease actions = obs_data_array_create();
+        for (const OBSData& action : rule.actions)
+            obs_data_array_push_back(actions, action);
+
+        OBSDataAutoRelease item = obs_data_create();
+        obs_data_set_int(item, "rule-id", rule.id);
+        obs_data_set_string(item, "name", rule.name.toUtf8());
+        obs_data_set_string(item, "event", rule.eventType.toUtf8());
+        obs_data_set_array(item, "conditions", rule.conditionList);
+        obs_data_set_array(item, "actions", actions);
+        obs_data_set_int(item, "hits", rule.hits);
+        obs_data_set_int(item, "executions", rule.executions);
+        obs_data_set_int(item, "errors", rule.errors);
+        obs_data_set_int(item, "loops-broken", rule.loopsBroken);
+        obs_data_set_int(item, "throttled", rule.throttled);
+        obs_data_set_double(item, "average-latency-ms", rule.executions
+            ? (double)rule.totalLatency / (double)rule.executions / 1000000.0
+            : 0.0);
+        obs_data_set_double(item, "max-latency-ms",
+            (double)rule.maxLatency / 1000000.0);
+        obs_data_array_push_back(list, item);
+    }
+    return list;
+}
+
+// Events emitted by the actions of a rule are matched one level deeper.
+// Those emitted while the actions run are recognized by thread, those
+// emitted afterwards (asynchronously) by time.
+void WSRules::Match(obs_data_t* event, uint64_t emittedAt) {
+    QString eventType = obs_data_get_string(event, "update-type");
+    bool onMainThread = (QThread::currentThread() == thread());
+    uint64_t now = os_gettime_ns();
+
+    QMutexLocker locker(&_mutex);
+    int depth = onMainThread ? _depth : 0;
+    if (now < _chainEnd && _chainDepth > depth)
+        depth = _chainDepth;
+    depth++;
+    bool matched = false;
+    for (Rule& rule : _rules) {
+        if (rule.eventType != eventType)
+            continue;
+
+        bool match = true;
+        for (const Condition& condition : rule.conditions) {
+            if (!Evaluate(condition, event)) {
+                match = false;
+                break;
+            }
+        }
+        if (!match)
+            continue;
+
+        rule.hits++;
+        if (depth > RULES_MAX_DEPTH) {
+            rule.loopsBroken++;
+            continue;
+        }
+
+        if (now - rule.rateWindowStart >= 1000000000) {
+            rule.rateWindowStart = now;
+            rule.rateCount = 0;
+        }
+        if (rule.rateCount >= RULE_MAX_RATE) {
+            rule.throttled++;
+            continue;
+        }
+        rule.rateCount++;
+
+        PendingRule pending;
+        pending.id = rule.id;
+        pending.depth = depth;
+        pending.emittedAt = emittedAt;
+        _pending.append(pending);
+        matched = true;
+    }
+
+    // Not run from the code emitting the event : OBS may be in the middle
+    // of a change
+    if (matched && !_runScheduled) {
+        _runScheduled = true;
+        QMetaObject::invokeMethod(this, "runPending", Qt::QueuedConnection);
+    }
+}
+
+void WSRules::runPending() {
+    QMutexLocker locker(&_mutex);
+    _runScheduled = false;
+    QList<PendingRule> pending = _pending;
+    _pending.clear();
+
+    for (const PendingRule& item : pending) {
+        Rule* rule = find(item.id);
+        if (!rule)
+            continue;
+
+        QList<OBSData> actions = rule->actions;
+        _depth = item.depth;
+        locker.unlock();
+
+        uint64_t errors = 0;
+        for (const OBSData& action : actions) {
+            WSRequestHandler handler(nullptr);
+            handler.setRequest(action);
+            handler.processRequest();
+
+            obs_data_t* response = handler.response();
+            if (!response
+                || strcmp(obs_data_get_string(response, "status"), "ok"))
+            {
+                errors++;
+            }
+        }
+        uint64_t finishedAt = os_gettime_ns();
+        uint64_t latency = finishedAt - item.emittedAt;
+
+        locker.relock();
+        _depth = 0;
+
+        // The deepest chain recently run wins
+        if (finishedAt >= _chainEnd || item.depth >= _chainDepth)
+            _chainDepth = item.depth;
+        _chainEnd = finishedAt + (uint64_t)RULES_CHAIN_WINDOW * 1000000;
+
+        rule = find(item.id);
+        if (!rule)
+            continue;
+
+        rule->executions++;
+        rule->errors += errors;
+        rule->totalLatency += latency;
+        if (latency > rule->maxLatency)
+            rule->maxLatency = latency;
+    }
+}
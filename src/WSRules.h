@@ -0,0 +1,122 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSRULES_H
+#define WSRULES_H
+
+#include <stdint.h>
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <obs.hpp>
+
+// Rules kept, and conditions and actions per rule
+#define RULES_MAX 64
+#define RULE_MAX_CONDITIONS 16
+#define RULE_MAX_ACTIONS 16
+
+// Chains of rules triggered by the events of other rules' actions are cut
+// beyond that length, breaking loops. Events emitted later, from other
+// threads (e.g. at the end of a transition), are counted in the chain when
+// they match within RULES_CHAIN_WINDOW milliseconds of the actions.
+#define RULES_MAX_DEPTH 4
+#define RULES_CHAIN_WINDOW 1000
+
+// Executions per second of a rule beyond which matching events are
+// ignored, should a loop escape the chain window
+#define RULE_MAX_RATE 10
+
+// Runs requests when an event matches, without a client round trip. Rules
+// are matched on the thread emitting the event, their actions run on the
+// main thread right after.
+class WSRules : public QObject {
+  Q_OBJECT
+  public:
+    explicit WSRules(QObject* parent = Q_NULLPTR);
+    ~WSRules();
+
+    // Returns the rule's id, or 0 with error set if the definition is
+    // invalid
+    quint32 Add(obs_data_t* definition, const char*& error);
+    bool Remove(quint32 id);
+    obs_data_array_t* List();
+
+    // Any thread
+    void Match(obs_data_t* event, uint64_t emittedAt);
+
+  private slots:
+    void runPending();
+
+  private:
+    enum Operator {
+        OperatorEquals,
+        OperatorNotEquals,
+        OperatorLessThan,
+        OperatorGreaterThan,
+        OperatorExists
+    };
+
+    struct Condition {
+        QStringList path; // Nested objects, then field name
+        Operator op;
+        OBSData value; // Holds a "value" item
+    };
+
+    struct Rule {
+        quint32 id;
+        QString name;
+        QString eventType;
+        QList<Condition> conditions;
+        QList<OBSData> actions;
+        OBSDataArray conditionList; // As defined, for ListRules
+        uint64_t hits;
+        uint64_t executions;
+        uint64_t errors;
+        uint64_t loopsBroken;
+        uint64_t throttled;
+        uint64_t rateWindowStart; // See RULE_MAX_RATE
+        int rateCount;
+        uint64_t totalLatency;
+        uint64_t maxLatency;
+    };
+
+    struct PendingRule {
+        quint32 id;
+        int depth;
+        uint64_t emittedAt;
+    };
+
+    static bool ParseCondition(obs_data_t* definition, Condition& condition);
+    static bool Evaluate(const Condition& condition, obs_data_t* event);
+    Rule* find(quint32 id);
+
+    QList<Rule> _rules;
+    QList<PendingRule> _pending;
+    bool _runScheduled;
+    int _depth; // Of the rule whose actions are running, 0 if none
+    int _chainDepth; // Of the last rule run, until _chainEnd
+    uint64_t _chainEnd;
+    quint32 _nextId;
+    QMutex _mutex;
+};
+
+#endif // WSRULES_H
@@ -0,0 +1,198 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <QtCore/QTimer>
+#include <util/platform.h>
+
+#include "WSScheduler.h"
+#include "WSServer.h"
+#include "WSRequestHandler.h"
+
+// Frame aligned requests run that fraction of a frame before the frame,
+// so that their change is rendered in it
+#define SCHEDULER_FRAME_LEAD_DIVISOR 4
+
+static uint64_t AlignToFrame(uint64_t at) {
+    obs_video_info ovi;
+    if (!obs_get_video_info(&ovi) || !ovi.fps_num)
+        return at;
+
+    uint64_t interval =
+        (uint64_t)ovi.fps_den * 1000000000ULL / (uint64_t)ovi.fps_num;
+    uint64_t lastFrame = obs_get_video_frame_time();
+    if (!interval || at <= lastFrame)
+        return at;
+
+    uint64_t frames = (at - lastFrame + interval - 1) / interval;
+    return lastFrame + frames * interval
+        - interval / SCHEDULER_FRAME_LEAD_DIVISOR;
+}
+
+WSScheduler::WSScheduler(QObject* parent)
+    : QObject(parent),
+      _nextId(1),
+      _executed(0),
+      _totalLateness(0),
+      _maxLateness(0)
+{
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    _timer->setTimerType(Qt::PreciseTimer);
+    connect(_timer, SIGNAL(timeout()),
+        this, SLOT(runDue()));
+}
+
+WSScheduler::~WSScheduler() {
+}
+
+quint32 WSScheduler::Schedule(ClientSession* session, obs_data_t* request,
+    uint64_t at, bool alignToFrame, uint64_t& executeAt)
+{
+    ScheduledRequest scheduled;
+    scheduled.id = _nextId++;
+    scheduled.session = session;
+    scheduled.connectionId = session->connectionId;
+    scheduled.request = request;
+    scheduled.requestedAt = at;
+    scheduled.executeAt = alignToFrame ? AlignToFrame(at) : at;
+
+    // After the ones due at the same time
+    int i = 0;
+    while (i < _requests.size()
+        && _requests[i].executeAt <= scheduled.executeAt)
+    {
+        i++;
+    }
+    _requests.insert(i, scheduled);
+
+    if (i == 0)
+        arm();
+
+    executeAt = scheduled.executeAt;
+    return scheduled.id;
+}
+
+bool WSScheduler::Cancel(quint32 id) {
+    for (int i = 0; i < _requests.size(); i++) {
+        if (_requests[i].id != id)
+            continue;
+
+        _requests.removeAt(i);
+        if (i == 0)
+            arm();
+        return true;
+    }
+    return false;
+}
+
+void WSScheduler::Detach(ClientSession* session) {
+    for (ScheduledRequest& scheduled : _requests) {
+        if (scheduled.session == session)
+            scheduled.session = nullptr;
+    }
+}
+
+int WSScheduler::Size() {
+    return _requests.size();
+}
+
+obs_data_array_t* WSScheduler::List() {
+    obs_data_array_t* list = obs_data_array_create();
+    for (const ScheduledRequest& scheduled : _requests) {
+        OBSDataAutoRelease item = obs_data_create();
+        obs_data_set_int(item, "schedule-id", scheduled.id);
+        obs_data_set_int(item, "connection-id",
+            scheduled.session ? scheduled.connectionId : 0);
+        obs_data_set_string(item, "request-type",
+            obs_data_get_string(scheduled.request, "request-type"));
+        obs_data_set_string(item, "message-id",
+            obs_data_get_string(scheduled.request, "message-id"));
+        obs_data_set_double(item, "requested-at",
+            (double)scheduled.requestedAt / 1000000.0);
+        obs_data_set_double(item, "execute-at",
+            (double)scheduled.executeAt / 1000000.0);
+        obs_data_array_push_back(list, item);
+    }
+    return list;
+}
+
+obs_data_t* WSScheduler::GetStats() {
+    obs_data_t* stats = obs_data_create();
+    obs_data_set_int(stats, "pending", _requests.size());
+    obs_data_set_int(stats, "executed", _executed);
+    obs_data_set_double(stats, "average-lateness-ms", _executed
+        ? (double)_totalLateness / (double)_executed / 1000000.0 : 0.0);
+    obs_data_set_double(stats, "max-lateness-ms",
+        (double)_maxLateness / 1000000.0);
+    return stats;
+}
+
+// Wakes up SCHEDULER_SPIN_MARGIN before the next request : timers are only
+// accurate to the millisecond, and late when the event loop is busy
+void WSScheduler::arm() {
+    if (_requests.isEmpty()) {
+        _timer->stop();
+        return;
+    }
+
+    uint64_t now = os_gettime_ns();
+    uint64_t wakeAt = _requests.first().executeAt;
+    wakeAt = (wakeAt > SCHEDULER_SPIN_MARGIN)
+        ? wakeAt - SCHEDULER_SPIN_MARGIN : 0;
+
+    _timer->start((wakeAt > now) ? (int)((wakeAt - now) / 1000000) : 0);
+}
+
+void WSScheduler::runDue() {
+    while (!_requests.isEmpty()) {
+        uint64_t now = os_gettime_ns();
+        if (_requests.first().executeAt > now + SCHEDULER_SPIN_MARGIN)
+            break;
+
+        ScheduledRequest scheduled = _requests.takeFirst();
+        if (scheduled.executeAt > now)
+            os_sleepto_ns(scheduled.executeAt);
+
+        execute(scheduled);
+    }
+    arm();
+}
+
+// The response is sent to the client that scheduled the request, with the
+// time it actually ran
+void WSScheduler::execute(const ScheduledRequest& scheduled) {
+    WSRequestHandler handler(scheduled.session);
+    handler.setRequest(scheduled.request);
+
+    uint64_t executedAt = os_gettime_ns();
+    OBSDataAutoRelease fields = obs_data_create();
+    obs_data_set_int(fields, "schedule-id", scheduled.id);
+    obs_data_set_double(fields, "scheduled-at",
+        (double)scheduled.executeAt / 1000000.0);
+    obs_data_set_double(fields, "executed-at",
+        (double)executedAt / 1000000.0);
+    handler.setResponseFields(fields);
+    handler.processRequest();
+
+    uint64_t lateness = (executedAt > scheduled.executeAt)
+        ? executedAt - scheduled.executeAt : 0;
+    _executed++;
+    _totalLateness += lateness;
+    if (lateness > _maxLateness)
+        _maxLateness = lateness;
+}
@@ -0,0 +1,89 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSSCHEDULER_H
+#define WSSCHEDULER_H
+
+#include <stdint.h>
+
+#include <QList>
+#include <QObject>
+
+#include <obs.hpp>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+struct ClientSession;
+
+// Requests waiting for their time, beyond which new ones are refused
+#define SCHEDULER_MAX_REQUESTS 256
+
+// Furthest a request can be scheduled (in milliseconds)
+#define SCHEDULER_MAX_DELAY (24 * 3600 * 1000)
+
+// The timer is set that much (in nanoseconds) before the execution time,
+// the remainder is waited precisely
+#define SCHEDULER_SPIN_MARGIN 2000000
+
+// Runs requests at a given time of the server's monotonic clock
+// (os_gettime_ns). Main thread only.
+class WSScheduler : public QObject {
+  Q_OBJECT
+  public:
+    explicit WSScheduler(QObject* parent = Q_NULLPTR);
+    ~WSScheduler();
+
+    // Schedules request for session, returns its id. When alignToFrame is
+    // set, the execution time is moved to just before the first video
+    // frame rendered at or after at.
+    quint32 Schedule(ClientSession* session, obs_data_t* request,
+        uint64_t at, bool alignToFrame, uint64_t& executeAt);
+    bool Cancel(quint32 id);
+
+    // Requests of a disconnected client still run, unanswered
+    void Detach(ClientSession* session);
+
+    int Size();
+    obs_data_array_t* List();
+    obs_data_t* GetStats();
+
+  private slots:
+    void runDue();
+
+  private:
+    struct ScheduledRequest {
+        quint32 id;
+        ClientSession* session;
+        quint32 connectionId;
+        OBSData request;
+        uint64_t requestedAt; // Time asked for, before frame alignment
+        uint64_t executeAt;
+    };
+
+    void arm();
+    void execute(const ScheduledRequest& scheduled);
+
+    QList<ScheduledRequest> _requests; // Sorted by execution time
+    QTimer* _timer;
+    quint32 _nextId;
+    uint64_t _executed;
+    uint64_t _totalLateness;
+    uint64_t _maxLateness;
+};
+
+#endif // WSSCHEDULER_H
@@ -16,53 +16,232 @@ You should have received a copy of the GNU General Public License along
 with this program. If not, see <https://www.gnu.org/licenses/>
 */
 
-#include <QtWebSockets/QWebSocket>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+#include <QtCore/QtEndian>
 #include <QtCore/QThread>
 #include <QtCore/QByteArray>
+#include <QtCore/QTimer>
 #include <QMainWindow>
 #include <QMessageBox>
 #include <obs-frontend-api.h>
+#include <util/platform.h>
+
+#include <algorithm>
+#include <string.h>
 
 #include "WSServer.h"
+#include "WSNativeTransport.h"
+#include "MsgPack.h"
 #include "obs-websocket.h"
 #include "Config.h"
 #include "Utils.h"
 
 QT_USE_NAMESPACE
 
+// Fields holding scene, source and source type names
+static const char* internedKeys[] = {
+    "name",
+    "type",
+    "scene-name",
+    "source-name",
+    "item-name",
+    "current-scene",
+    "from-scene",
+    "to-scene",
+    nullptr
+};
+
+// Objects holding plugin or client defined data, such as source settings :
+// a "name" or "type" field in them isn't a scene or source name
+static const char* opaqueKeys[] = {
+    "settings",
+    "sourceSettings",
+    "defaultSettings",
+    "conditions",
+    "actions",
+    nullptr
+};
+
+static bool isKeyIn(const char** keys, const char* key) {
+    for (const char** it = keys; *it; it++) {
+        if (strcmp(*it, key) == 0)
+            return true;
+    }
+    return false;
+}
+
 WSServer* WSServer::Instance = nullptr;
 
 WSServer::WSServer(QObject* parent)
     : QObject(parent),
-      _wsServer(Q_NULLPTR),
-      _clients(),
-      _clMutex(QMutex::Recursive)
+      _rejectedConnections(0),
+      _rejectedRequests(0),
+      _throttledAuths(0),
+      _unloggedRejections(0),
+      _summaryConnected(0),
+      _summaryDisconnected(0),
+      _requestQueueScheduled(false),
+      _idempotencyCache(IDEMPOTENCY_CACHE_SIZE),
+      _idempotencyStored(0),
+      _idempotencyReplays(0),
+      _timedOutClients(0),
+      _transport(Q_NULLPTR),
+      _localServer(Q_NULLPTR),
+      _clMutex(QMutex::Recursive),
+      _nextConnectionId(1)
 {
-    _wsServer = new QWebSocketServer(
-        QStringLiteral("obs-websocket"),
-        QWebSocketServer::NonSecureMode);
+    _eventBatchTimer = new QTimer(this);
+    _eventBatchTimer->setSingleShot(true);
+    _eventBatchTimer->setTimerType(Qt::PreciseTimer);
+    connect(_eventBatchTimer, SIGNAL(timeout()),
+        this, SLOT(flushEventBatches()));
+
+    _summaryTimer = new QTimer(this);
+    _summaryTimer->setSingleShot(true);
+    connect(_summaryTimer, SIGNAL(timeout()),
+        this, SLOT(flushConnectionSummary()));
+
+    _livenessTimer = new QTimer(this);
+    connect(_livenessTimer, SIGNAL(timeout()),
+        this, SLOT(checkLiveness()));
+    _livenessTimer->start(LIVENESS_CHECK_INTERVAL);
+
+    _scheduler = new WSScheduler(this);
+    _rules = new WSRules(this);
+
+    createTransport(false);
 }
 
 WSServer::~WSServer() {
     Stop();
 }
 
+void WSServer::createTransport(bool native) {
+    if (_transport) {
+        // Clients of the previous backend are dropped right away : the
+        // backend deletes them along with itself
+        _transport->disconnect(this);
+        _transport->Close();
+
+        QList<QObject*> clients;
+        QMutexLocker locker(&_clMutex);
+        for (ClientSession* session : _sessions) {
+            if (!session->local)
+                clients << session->client;
+        }
+        locker.unlock();
+
+        for (QObject* pClient : clients)
+            onClientDisconnected(pClient);
+
+        _transport->deleteLater();
+    }
+
+#ifdef __linux__
+    if (native)
+        _transport = new WSNativeTransport(this);
+    else
+        _transport = new WSQtTransport(this);
+#else
+    Q_UNUSED(native);
+    _transport = new WSQtTransport(this);
+#endif
+
+    connect(_transport, SIGNAL(clientConnected(QObject*, QString, quint16, int)),
+        this, SLOT(onClientConnected(QObject*, QString, quint16, int)));
+    connect(_transport, SIGNAL(messageReceived(QObject*, QByteArray, bool)),
+        this, SLOT(onMessageReceived(QObject*, QByteArray, bool)));
+    connect(_transport, SIGNAL(clientDisconnected(QObject*)),
+        this, SLOT(onClientDisconnected(QObject*)));
+    connect(_transport, SIGNAL(pongReceived(QObject*)),
+        this, SLOT(onPongReceived(QObject*)));
+}
+
 void WSServer::Start(quint16 port) {
-    if (port == _wsServer->serverPort())
+    Config* config = Config::Current();
+
+    QMutexLocker locker(&_clMutex);
+    _connectionLimiter.SetRate(config->ConnectionRate, config->ConnectionBurst);
+    _requestLimiter.SetRate(config->RequestRate, config->RequestBurst);
+    locker.unlock();
+
+    startTcp(port);
+    startLocal(Config::Current()->LocalSocketPath);
+}
+
+void WSServer::startTcp(quint16 port) {
+    Config* config = Config::Current();
+
+    bool native = false;
+    if (config->ServerBackend == "epoll") {
+#ifdef __linux__
+        native = true;
+#else
+        blog(LOG_WARNING, "the epoll backend is only available on Linux, "
+            "using the Qt backend");
+#endif
+    }
+    else if (config->ServerBackend != "qt") {
+        blog(LOG_WARNING, "unknown server backend \"%s\", using the Qt backend",
+            config->ServerBackend.toUtf8().constData());
+    }
+
+    const char* backend = native ? "epoll" : "qt";
+    if (!native && config->CompressionEnabled) {
+        blog(LOG_INFO, "permessage-deflate is only supported by the epoll "
+            "backend: messages won't be compressed");
+    }
+    bool sameBackend = (strcmp(_transport->Name(), backend) == 0);
+
+    bool secure = config->TlsEnabled;
+    bool wasSecure = _transport->IsSecure();
+
+    if (port == _transport->ServerPort() && sameBackend && secure == wasSecure)
         return;
 
-    if(_wsServer->isListening())
+    if (_transport->ServerPort())
         Stop();
 
-    bool serverStarted = _wsServer->listen(QHostAddress::Any, port);
+    if (!sameBackend)
+        createTransport(native);
+
+    QString error;
+    if (!_transport->SetSecure(secure, error)) {
+        // Never fall back to plain text when TLS was asked for
+        blog(LOG_ERROR, "error: failed to set up TLS: %s",
+            error.toUtf8().constData());
+
+        QMainWindow* mainWindow =
+            (QMainWindow*)obs_frontend_get_main_window();
+
+        obs_frontend_push_ui_translation(obs_module_get_string);
+        QString title = tr("OBSWebsocket.Server.StartFailed.Title");
+        QString msg = tr("OBSWebsocket.Server.TlsFailed.Message")
+            .arg(error);
+        obs_frontend_pop_ui_translation();
+
+        QMessageBox::warning(mainWindow, title, msg);
+        return;
+    }
+
+    QString errorString;
+    bool serverStarted = _transport->Listen(port, errorString);
     if (serverStarted) {
-        blog(LOG_INFO, "server started successfully on TCP port %d", port);
+        blog(LOG_INFO, "server started successfully on TCP port %d (%s, %s backend)",
+            port, secure ? "wss" : "ws", backend);
 
-        connect(_wsServer, SIGNAL(newConnection()),
-            this, SLOT(onNewConnection()));
+        if (config->CaptureEnabled) {
+            QString captureDir = config->CaptureDirectory;
+            if (captureDir.isEmpty()) {
+                char* defaultDir = obs_module_config_path("captures");
+                captureDir = defaultDir;
+                bfree(defaultDir);
+            }
+            _capture.Start(captureDir);
+        }
     }
     else {
-        QString errorString = _wsServer->errorString();
         blog(LOG_ERROR,
             "error: failed to start server on TCP port %d: %s",
             port, errorString.toUtf8().constData());
@@ -78,91 +257,1452 @@ void WSServer::Start(quint16 port) {
     }
 }
 
+void WSServer::startLocal(QString path) {
+    if (_localServer && _localServer->isListening()
+        && _localServer->serverName() == path)
+    {
+        return;
+    }
+
+    if (_localServer) {
+        _localServer->close();
+        _localServer->deleteLater();
+        _localServer = Q_NULLPTR;
+    }
+
+    if (path.isEmpty())
+        return;
+
+    _localServer = new QLocalServer(this);
+    _localServer->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(_localServer, SIGNAL(newConnection()),
+        this, SLOT(onNewLocalConnection()));
+
+    // A socket file left behind by a crash would make listen() fail
+    QLocalServer::removeServer(path);
+
+    if (_localServer->listen(path)) {
+        blog(LOG_INFO, "server listening on local socket %s",
+            _localServer->fullServerName().toUtf8().constData());
+    }
+    else {
+        blog(LOG_ERROR, "error: failed to listen on local socket %s: %s",
+            path.toUtf8().constData(),
+            _localServer->errorString().toUtf8().constData());
+    }
+}
+
 void WSServer::Stop() {
     QMutexLocker locker(&_clMutex);
-    for(QWebSocket* pClient : _clients) {
-        pClient->close();
-    }
+    QList<ClientSession*> sessions = _sessions.values();
     locker.unlock();
 
-    _wsServer->close();
+    // Local sockets may disconnect synchronously, deleting their session
+    for (ClientSession* session : sessions) {
+        if (session->local) {
+            ((QLocalSocket*)session->client)->disconnectFromServer();
+        }
+        else {
+            _transport->Disconnect(session->client,
+                QWebSocketProtocol::CloseCodeNormal, QString());
+        }
+    }
+
+    _transport->Close();
+    if (_localServer) {
+        _localServer->close();
+        _localServer->deleteLater();
+        _localServer = Q_NULLPTR;
+    }
+    _capture.Stop();
 
     blog(LOG_INFO, "server stopped successfully");
 }
 
-void WSServer::broadcast(QString message) {
+uint64_t WSServer::broadcast(obs_data_t* message) {
+    uint64_t emittedAt = os_gettime_ns();
+    bool authRequired = Config::Current()->AuthRequired;
+
+    // Serialized at most once per encoding, and only if a client uses it.
+    // Index 1 holds the message with its server-time.
+    OBSDataAutoRelease stamped;
+    QByteArray json[2];
+    QByteArray msgpack[2];
+    QByteArray updateType = obs_data_get_string(message, "update-type");
+    uint64_t totalSent = 0;
+
     QMutexLocker locker(&_clMutex);
-    for(QWebSocket* pClient : _clients) {
-        if (Config::Current()->AuthRequired
-            && (pClient->property(PROP_AUTHENTICATED).toBool() == false)) {
-            // Skip this client if unauthenticated
+    for (ClientSession* session : _sessions) {
+        if (authRequired && !session->authenticated)
+            continue;
+
+        int variant = session->eventTimestamps ? 1 : 0;
+        if (variant && !stamped) {
+            stamped = obs_data_create();
+            obs_data_apply(stamped, message);
+            obs_data_set_int(stamped, "server-time", emittedAt);
+        }
+        obs_data_t* event = variant ? (obs_data_t*)stamped : message;
+
+        qint64 sent = 0;
+        if (session->names.enabled) {
+            sent = sendInterned(session, event, updateType, true);
+            if (sent > 0)
+                totalSent += sent;
             continue;
         }
-        pClient->sendTextMessage(message);
+
+        if (session->encoding == EncodingMsgPack) {
+            QByteArray& payload = msgpack[variant];
+            if (payload.isEmpty())
+                payload = MsgPack::FromData(event);
+            if (batchEvent(session, true, payload)) {
+                totalSent += payload.size();
+                continue;
+            }
+            sent = sendPayload(session, payload, true, updateType, true);
+        }
+        else {
+            QByteArray& payload = json[variant];
+            if (payload.isEmpty())
+                payload = obs_data_get_json(event);
+            if (batchEvent(session, false, payload)) {
+                totalSent += payload.size();
+                continue;
+            }
+            sent = sendPayload(session, payload, false, updateType,
+                true);
+        }
+        countOutbound(session, sent);
+
+        if (sent > 0)
+            totalSent += sent;
     }
-}
+    locker.unlock();
 
-void WSServer::onNewConnection() {
-    QWebSocket* pSocket = _wsServer->nextPendingConnection();
-    if (pSocket) {
-        connect(pSocket, SIGNAL(textMessageReceived(const QString&)),
-            this, SLOT(onTextMessageReceived(QString)));
-        connect(pSocket, SIGNAL(disconnected()),
-            this, SLOT(onSocketDisconnected()));
+    if (_capture.IsActive()) {
+        _capture.Record(CaptureRecord::Broadcast, 0,
+            QByteArray(obs_data_get_json(message)));
+    }
 
-        pSocket->setProperty(PROP_AUTHENTICATED, false);
+    // After the clients : rules don't delay their events
+    _rules->Match(message, emittedAt);
 
-        QMutexLocker locker(&_clMutex);
-        _clients << pSocket;
+    return totalSent;
+}
+
+void WSServer::sendMessage(ClientSession* session, obs_data_t* message,
+    const QByteArray& messageType)
+{
+    QByteArray payload;
+
+    QMutexLocker locker(&_clMutex);
+    bool msgpack = (session->encoding == EncodingMsgPack);
+    if (session->names.enabled) {
+        sendInterned(session, message, messageType, false);
+    }
+    else {
         locker.unlock();
 
-        QHostAddress clientAddr = pSocket->peerAddress();
-        QString clientIp = Utils::FormatIPAddress(clientAddr);
+        payload = msgpack ? MsgPack::FromData(message)
+            : QByteArray(obs_data_get_json(message));
+        qint64 sent = sendPayload(session, payload, msgpack, messageType,
+            false);
+
+        locker.relock();
+        countOutbound(session, sent);
+    }
+    locker.unlock();
+
+    // Captures always hold JSON (with names), whatever the client's
+    // encoding
+    if (_capture.IsActive()) {
+        _capture.Record(CaptureRecord::Outbound, session->connectionId,
+            payload.isEmpty() || msgpack
+                ? QByteArray(obs_data_get_json(message)) : payload);
+    }
+}
 
-        blog(LOG_INFO, "new client connection from %s:%d",
-            clientIp.toUtf8().constData(), pSocket->peerPort());
+QList<WSClientStats> WSServer::clientStats() {
+    QList<WSClientStats> result;
+    uint64_t now = os_gettime_ns();
 
-        obs_frontend_push_ui_translation(obs_module_get_string);
-        QString title = tr("OBSWebsocket.NotifyConnect.Title");
-        QString msg = tr("OBSWebsocket.NotifyConnect.Message")
-            .arg(Utils::FormatIPAddress(clientAddr));
-        obs_frontend_pop_ui_translation();
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        WSClientStats stats;
+        stats.connectionId = session->connectionId;
+        stats.address = session->address;
+        stats.authenticated = session->authenticated;
+        stats.uptime = now - session->connectedAt;
+        stats.messagesIn = session->messagesIn;
+        stats.messagesOut = session->messagesOut;
+        stats.queuedRequests = session->requests.size();
+        stats.queuedBytes = session->local
+            ? ((QLocalSocket*)session->client)->bytesToWrite()
+            : _transport->QueuedBytes(session->client);
 
-        Utils::SysTrayNotify(msg, QSystemTrayIcon::Information, title);
+        stats.rtt = session->rtt;
+        stats.p99Latency = 0;
+        if (session->latencyCount > 0) {
+            uint64_t samples[CLIENT_LATENCY_SAMPLES];
+            std::copy(session->latencies,
+                session->latencies + session->latencyCount, samples);
+            std::sort(samples, samples + session->latencyCount);
+
+            int index = ((session->latencyCount * 99) + 99) / 100 - 1;
+            stats.p99Latency = samples[index];
+        }
+
+        result.append(stats);
     }
+
+    return result;
 }
 
-void WSServer::onTextMessageReceived(QString message) {
-    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
-    if (pSocket) {
-        WSRequestHandler handler(pSocket);
-        handler.processIncomingMessage(message);
+void WSServer::kickClient(quint32 connectionId) {
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        if (session->connectionId != connectionId)
+            continue;
+
+        if (session->local) {
+            blog(LOG_INFO, "kicking local client %u", connectionId);
+            QLocalSocket* localSocket = (QLocalSocket*)session->client;
+            locker.unlock();
+            localSocket->disconnectFromServer();
+        }
+        else {
+            blog(LOG_INFO, "kicking client %s",
+                session->address.toUtf8().constData());
+            _transport->Disconnect(session->client,
+                QWebSocketProtocol::CloseCodePolicyViolated,
+                QStringLiteral("Disconnected by the server operator"));
+        }
+        return;
     }
 }
 
-void WSServer::onSocketDisconnected() {
-    QWebSocket* pSocket = qobject_cast<QWebSocket*>(sender());
-    if (pSocket) {
-        pSocket->setProperty(PROP_AUTHENTICATED, false);
+WSTlsStats WSServer::tlsStats() {
+    return _transport->TlsStats();
+}
 
-        QMutexLocker locker(&_clMutex);
-        _clients.removeAll(pSocket);
-        locker.unlock();
+WSScheduler* WSServer::scheduler() {
+    return _scheduler;
+}
 
-        pSocket->deleteLater();
+WSRules* WSServer::rules() {
+    return _rules;
+}
 
-        QHostAddress clientAddr = pSocket->peerAddress();
-        QString clientIp = Utils::FormatIPAddress(clientAddr);
+obs_data_t* WSServer::transportStats() {
+    return _transport->GetStats();
+}
 
-        blog(LOG_INFO, "client %s:%d disconnected",
-            clientIp.toUtf8().constData(), pSocket->peerPort());
+qint64 WSServer::sendPayload(ClientSession* session,
+    const QByteArray& payload, bool msgpack, const QByteArray& messageType,
+    bool deferrable)
+{
+    if (session->local) {
+        QLocalSocket* localSocket = (QLocalSocket*)session->client;
+        if (QThread::currentThread() == localSocket->thread())
+            return WriteLocalFrame(localSocket, payload);
 
-        obs_frontend_push_ui_translation(obs_module_get_string);
-        QString title = tr("OBSWebsocket.NotifyDisconnect.Title");
-        QString msg = tr("OBSWebsocket.NotifyDisconnect.Message")
-            .arg(Utils::FormatIPAddress(clientAddr));
-        obs_frontend_pop_ui_translation();
+        // QLocalSocket isn't thread-safe : events raised on libobs threads
+        // are written from the socket's thread
+        QMetaObject::invokeMethod(this, "writeQueuedLocalFrame",
+            Qt::QueuedConnection, Q_ARG(QObject*, session->client),
+            Q_ARG(QByteArray, payload));
+        return payload.size();
+    }
+
+    return _transport->Send(session->client, payload, msgpack, messageType,
+        deferrable);
+}
+
+void WSServer::setHeartbeat(ClientSession* session, uint64_t interval,
+    int fields)
+{
+    QMutexLocker locker(&_clMutex);
+    ClientSession::Heartbeat& heartbeat = session->heartbeat;
+    heartbeat.interval = interval * 1000000;
+    heartbeat.fields = fields;
+    heartbeat.next = os_gettime_ns() + heartbeat.interval;
+}
+
+// Timers may fire a bit early : a heartbeat due before the middle of the
+// next tick is sent on this one
+static bool heartbeatDue(const ClientSession::Heartbeat& heartbeat,
+    uint64_t now)
+{
+    return heartbeat.interval
+        && heartbeat.next <= now + (uint64_t)HEARTBEAT_TICK * 500000;
+}
+
+// Returns the field groups needed by the clients due for a heartbeat, or
+// 0 if none is
+int WSServer::dueHeartbeats(uint64_t now) {
+    bool authRequired = Config::Current()->AuthRequired;
+    int fields = 0;
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        if (authRequired && !session->authenticated)
+            continue;
+
+        if (heartbeatDue(session->heartbeat, now))
+            fields |= session->heartbeat.fields;
+    }
+    return fields;
+}
+
+// Sends update to the clients due for a heartbeat, along with the field
+// groups each of them asked for. groups is indexed by field group.
+uint64_t WSServer::sendHeartbeats(uint64_t now, obs_data_t* update,
+    obs_data_t* const* groups)
+{
+    bool authRequired = Config::Current()->AuthRequired;
+    uint64_t totalSent = 0;
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        ClientSession::Heartbeat& heartbeat = session->heartbeat;
+        if ((authRequired && !session->authenticated)
+            || !heartbeatDue(heartbeat, now))
+        {
+            continue;
+        }
+
+        heartbeat.next += heartbeat.interval;
+        if (heartbeat.next <= now)
+            heartbeat.next = now + heartbeat.interval;
+        heartbeat.pulse = !heartbeat.pulse;
+
+        OBSDataAutoRelease message = obs_data_create();
+        obs_data_apply(message, update);
+        obs_data_set_bool(message, "pulse", heartbeat.pulse);
+        if (session->eventTimestamps)
+            obs_data_set_int(message, "server-time", now);
+        for (int i = 0; i < HEARTBEAT_FIELD_GROUPS; i++) {
+            if ((heartbeat.fields & (1 << i)) && groups[i])
+                obs_data_apply(message, groups[i]);
+        }
+
+        qint64 sent = session->names.enabled
+            ? sendInterned(session, message, "Heartbeat", true)
+            : deliver(session, message, "Heartbeat", true);
+        if (sent > 0)
+            totalSent += sent;
+    }
+    return totalSent;
+}
+
+void WSServer::setEventTimestamps(ClientSession* session, bool enable) {
+    QMutexLocker locker(&_clMutex);
+    session->eventTimestamps = enable;
+}
+
+void WSServer::setEventBatching(ClientSession* session, uint64_t window) {
+    QMutexLocker locker(&_clMutex);
+
+    // Pending events go out before the response
+    if (window == 0)
+        sendEventBatch(session);
+
+    session->batch.window = window * 1000000;
+}
+
+// Called with _clMutex held. Returns false if the client doesn't batch
+// its events.
+bool WSServer::batchEvent(ClientSession* session, bool msgpack,
+    const QByteArray& payload)
+{
+    ClientSession::EventBatch& batch = session->batch;
+    if (!batch.window)
+        return false;
+
+    // A local client switched encodings : a batch holds only one
+    if (!batch.events.isEmpty() && batch.msgpack != msgpack)
+        sendEventBatch(session);
+
+    batch.events.append(payload);
+    if (batch.events.size() >= EVENT_BATCH_MAX_EVENTS) {
+        sendEventBatch(session);
+    }
+    else if (batch.events.size() == 1) {
+        batch.deadline = os_gettime_ns() + batch.window;
+        batch.msgpack = msgpack;
+
+        // Events may be emitted from any thread
+        QMetaObject::invokeMethod(this, "scheduleEventBatches");
+    }
+    return true;
+}
+
+/**
+ * Events emitted within the batching window of a client that enabled
+ * `SetEventBatching`. Each event keeps all of its fields, `update-type`
+ * included.
+ *
+ * @return {int} `batch-sequence` Number of this batch for the client, starting at 1. Consecutive batches have consecutive numbers.
+ * @return {Array} `events` The events, in the order they were emitted.
+ *
+ * @api events
+ * @name EventBatch
+ * @category general
+ * @since 5.0.0
+ */
+// Called with _clMutex held
+void WSServer::sendEventBatch(ClientSession* session) {
+    ClientSession::EventBatch& batch = session->batch;
+    if (batch.events.isEmpty())
+        return;
+
+    int size = 64;
+    for (const QByteArray& event : batch.events)
+        size += event.size() + 1;
+
+    // The events are already encoded : only the envelope around them is
+    // written here, with the same fields in both encodings
+    QByteArray envelope;
+    envelope.reserve(size);
+    batch.sequence++;
+
+    if (batch.msgpack) {
+        MsgPack::WriteMapHeader(envelope, 3);
+        MsgPack::WriteString(envelope, "update-type");
+        MsgPack::WriteString(envelope, "EventBatch");
+        MsgPack::WriteString(envelope, "batch-sequence");
+        MsgPack::WriteInt(envelope, (long long)batch.sequence);
+        MsgPack::WriteString(envelope, "events");
+        MsgPack::WriteArrayHeader(envelope, (uint32_t)batch.events.size());
+        for (const QByteArray& event : batch.events)
+            envelope += event;
+    }
+    else {
+        envelope += "{\"update-type\":\"EventBatch\",\"batch-sequence\":";
+        envelope += QByteArray::number((qulonglong)batch.sequence);
+        envelope += ",\"events\":[";
+        for (int i = 0; i < batch.events.size(); i++) {
+            if (i > 0)
+                envelope += ',';
+            envelope += batch.events[i];
+        }
+        envelope += "]}";
+    }
+
+    batch.events.clear();
+    batch.deadline = 0;
+
+    qint64 sent = sendPayload(session, envelope, batch.msgpack,
+        "EventBatch", true);
+    countOutbound(session, sent);
+}
+
+void WSServer::setNameInterning(ClientSession* session, bool enable) {
+    QMutexLocker locker(&_clMutex);
+    ClientSession::NameTable& table = session->names;
+    if (!enable) {
+        table.enabled = false;
+        table.handles.clear();
+        return;
+    }
+
+    if (!table.enabled) {
+        table.enabled = true;
+        table.nextHandle = 1;
+    }
+}
+
+/**
+ * Definitions of the name handles used in the following messages, for
+ * clients that enabled `SetNameInterning`. Sent right before the first
+ * message using a new handle, and when a source whose name has a handle
+ * is renamed.
+ *
+ * @return {Object} `names` Names, keyed by handle.
+ *
+ * @api events
+ * @name NameTable
+ * @category general
+ * @since 5.0.0
+ */
+void WSServer::renameInterned(const QString& from, const QString& to) {
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        ClientSession::NameTable& table = session->names;
+        if (!table.enabled)
+            continue;
+
+        qint64 handle = table.handles.take(from);
+        if (!handle || table.handles.contains(to))
+            continue;
+
+        table.handles.insert(to, handle);
+
+        OBSDataAutoRelease names = obs_data_create();
+        obs_data_set_string(names, QByteArray::number(handle).constData(),
+            to.toUtf8().constData());
+
+        OBSDataAutoRelease update = obs_data_create();
+        obs_data_set_string(update, "update-type", "NameTable");
+        obs_data_set_obj(update, "names", names);
+        deliver(session, update, "NameTable", true);
+    }
+}
+
+// Called with _clMutex held
+qint64 WSServer::sendInterned(ClientSession* session, obs_data_t* message,
+    const QByteArray& messageType, bool event)
+{
+    // A response may use handles defined in events still held back
+    if (!event)
+        sendEventBatch(session);
 
-        Utils::SysTrayNotify(msg, QSystemTrayIcon::Information, title);
+    // Deep copy : objects and arrays are shared by obs_data_apply()
+    OBSDataAutoRelease copy =
+        obs_data_create_from_json(obs_data_get_json(message));
+    OBSDataAutoRelease names = obs_data_create();
+
+    if (InternNames(copy, session->names, names) > 0) {
+        OBSDataAutoRelease update = obs_data_create();
+        obs_data_set_string(update, "update-type", "NameTable");
+        obs_data_set_obj(update, "names", names);
+        deliver(session, update, "NameTable", event);
+    }
+
+    return deliver(session, copy, messageType, event);
+}
+
+// Called with _clMutex held
+qint64 WSServer::deliver(ClientSession* session, obs_data_t* message,
+    const QByteArray& messageType, bool event)
+{
+    bool msgpack = (session->encoding == EncodingMsgPack);
+    QByteArray payload = msgpack ? MsgPack::FromData(message)
+        : QByteArray(obs_data_get_json(message));
+
+    if (event && batchEvent(session, msgpack, payload))
+        return payload.size();
+
+    qint64 sent = sendPayload(session, payload, msgpack, messageType,
+        event);
+    countOutbound(session, sent);
+    return sent;
+}
+
+// Replaces names with their handle, recursively. New names are given a
+// handle and added to names. Returns the number of names added.
+int WSServer::InternNames(obs_data_t* data,
+    ClientSession::NameTable& table, obs_data_t* names)
+{
+    int added = 0;
+    QList<QPair<QByteArray, qint64>> replaced;
+
+    obs_data_item_t* item = nullptr;
+    for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
+        const char* key = obs_data_item_get_name(item);
+
+        switch (obs_data_item_gettype(item)) {
+            case OBS_DATA_STRING: {
+                if (!isKeyIn(internedKeys, key))
+                    break;
+
+                QString name = QString::fromUtf8(obs_data_item_get_string(item));
+                qint64 handle = table.handles.value(name);
+                if (!handle && table.handles.size() < NAME_TABLE_MAX_SIZE) {
+                    handle = table.nextHandle++;
+                    table.handles.insert(name, handle);
+                    obs_data_set_string(names,
+                        QByteArray::number(handle).constData(),
+                        name.toUtf8().constData());
+                    added++;
+                }
+
+                // Items can't change type while iterating
+                if (handle)
+                    replaced.append(qMakePair(QByteArray(key), handle));
+                break;
+            }
+
+            case OBS_DATA_OBJECT: {
+                if (isKeyIn(opaqueKeys, key))
+                    break;
+
+                OBSDataAutoRelease child = obs_data_item_get_obj(item);
+                added += InternNames(child, table, names);
+                break;
+            }
+
+            case OBS_DATA_ARRAY: {
+                if (isKeyIn(opaqueKeys, key))
+                    break;
+
+                OBSDataArrayAutoRelease array = obs_data_item_get_array(item);
+                size_t count = obs_data_array_count(array);
+                for (size_t i = 0; i < count; i++) {
+                    OBSDataAutoRelease child = obs_data_array_item(array, i);
+                    added += InternNames(child, table, names);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    for (const QPair<QByteArray, qint64>& field : replaced)
+        obs_data_set_int(data, field.first.constData(), field.second);
+
+    return added;
+}
+
+void WSServer::scheduleEventBatches() {
+    uint64_t next = 0;
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        uint64_t deadline = session->batch.deadline;
+        if (deadline && (!next || deadline < next))
+            next = deadline;
+    }
+    locker.unlock();
+
+    if (!next) {
+        _eventBatchTimer->stop();
+        return;
     }
+
+    uint64_t now = os_gettime_ns();
+    int delay = (next > now) ? (int)((next - now + 999999) / 1000000) : 0;
+    _eventBatchTimer->start(delay);
+}
+
+void WSServer::flushEventBatches() {
+    uint64_t now = os_gettime_ns();
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        if (session->batch.deadline && session->batch.deadline <= now)
+            sendEventBatch(session);
+    }
+    locker.unlock();
+
+    scheduleEventBatches();
+}
+
+// Returns why the connection is refused, or nullptr. Kept cheap : no
+// logging or notification per rejected connection.
+const char* WSServer::admitClient(const QString& ip) {
+    Config* config = Config::Current();
+
+    QMutexLocker locker(&_clMutex);
+    const char* rejection = nullptr;
+    if (config->MaxClients
+        && (uint64_t)_sessions.size() >= config->MaxClients)
+    {
+        rejection = "too many clients";
+    }
+    else if (!_connectionLimiter.Allow(ip, os_gettime_ns())) {
+        rejection = "connection rate limit exceeded";
+    }
+
+    if (!rejection)
+        return nullptr;
+
+    _rejectedConnections++;
+    _unloggedRejections++;
+    locker.unlock();
+
+    if (!_summaryTimer->isActive())
+        _summaryTimer->start(CONNECTION_SUMMARY_DELAY);
+    return rejection;
+}
+
+bool WSServer::authThrottled(ClientSession* session, uint64_t& retryAfter) {
+    QMutexLocker locker(&_clMutex);
+    QHash<QString, AuthThrottle>::iterator it =
+        _authThrottles.find(session->ip);
+    uint64_t now = os_gettime_ns();
+    if (it == _authThrottles.end() || now >= it->blockedUntil)
+        return false;
+
+    _throttledAuths++;
+    retryAfter = (it->blockedUntil - now + 999999) / 1000000;
+    return true;
+}
+
+// Failures are counted per IP address, so that reconnecting doesn't
+// reset the delay
+void WSServer::authResult(ClientSession* session, bool success) {
+    QMutexLocker locker(&_clMutex);
+    if (success) {
+        session->authenticated = true;
+        _authThrottles.remove(session->ip);
+        return;
+    }
+
+    uint64_t now = os_gettime_ns();
+    uint64_t forgetAfter = (uint64_t)AUTH_BACKOFF_MAX_MS * 1000000;
+
+    if (_authThrottles.size() >= RATE_LIMITER_MAX_BUCKETS) {
+        QHash<QString, AuthThrottle>::iterator it = _authThrottles.begin();
+        while (it != _authThrottles.end()) {
+            if (now > it->blockedUntil + forgetAfter)
+                it = _authThrottles.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    AuthThrottle& throttle = _authThrottles[session->ip];
+    if (now > throttle.blockedUntil + forgetAfter)
+        throttle.failures = 0;
+    throttle.failures++;
+
+    uint64_t delay = AUTH_BACKOFF_MAX_MS;
+    if (throttle.failures <= 16)
+        delay = std::min<uint64_t>(delay,
+            (uint64_t)AUTH_BACKOFF_BASE_MS << (throttle.failures - 1));
+    throttle.blockedUntil = now + delay * 1000000;
+}
+
+obs_data_t* WSServer::admissionStats() {
+    obs_data_t* stats = obs_data_create();
+
+    QMutexLocker locker(&_clMutex);
+    obs_data_set_int(stats, "max-clients", Config::Current()->MaxClients);
+    obs_data_set_int(stats, "rejected-connections", _rejectedConnections);
+    obs_data_set_int(stats, "rejected-requests", _rejectedRequests);
+    obs_data_set_int(stats, "throttled-authentications", _throttledAuths);
+    obs_data_set_int(stats, "timed-out-clients", _timedOutClients);
+    return stats;
+}
+
+// The first notification is shown right away. The following ones are
+// summed up until things calm down.
+void WSServer::notifyConnection(bool connected, const QString& ip) {
+    if (!_summaryTimer->isActive()) {
+        ShowNotification(connected ? 1 : 0, connected ? 0 : 1, ip);
+        _summaryTimer->start(CONNECTION_SUMMARY_DELAY);
+        return;
+    }
+
+    if (connected)
+        _summaryConnected++;
+    else
+        _summaryDisconnected++;
+    _summaryIp = ip;
+}
+
+void WSServer::flushConnectionSummary() {
+    QMutexLocker locker(&_clMutex);
+    uint64_t rejections = _unloggedRejections;
+    _unloggedRejections = 0;
+    locker.unlock();
+
+    if (rejections) {
+        blog(LOG_WARNING, "refused %llu connections in the last %d ms "
+            "(MaxClients or ConnectionRate reached)",
+            (unsigned long long)rejections, CONNECTION_SUMMARY_DELAY);
+    }
+
+    if (!_summaryConnected && !_summaryDisconnected)
+        return;
+
+    ShowNotification(_summaryConnected, _summaryDisconnected, _summaryIp);
+    _summaryConnected = 0;
+    _summaryDisconnected = 0;
+    _summaryIp.clear();
+
+    _summaryTimer->start(CONNECTION_SUMMARY_DELAY);
+}
+
+void WSServer::ShowNotification(int connected, int disconnected,
+    const QString& ip)
+{
+    QString title;
+    QString msg;
+
+    obs_frontend_push_ui_translation(obs_module_get_string);
+    if (connected == 1 && disconnected == 0) {
+        title = tr("OBSWebsocket.NotifyConnect.Title");
+        msg = tr("OBSWebsocket.NotifyConnect.Message").arg(ip);
+    }
+    else if (connected == 0 && disconnected == 1) {
+        title = tr("OBSWebsocket.NotifyDisconnect.Title");
+        msg = tr("OBSWebsocket.NotifyDisconnect.Message").arg(ip);
+    }
+    else {
+        title = tr("OBSWebsocket.NotifySummary.Title");
+        msg = tr("OBSWebsocket.NotifySummary.Message")
+            .arg(connected).arg(disconnected);
+    }
+    obs_frontend_pop_ui_translation();
+
+    Utils::SysTrayNotify(msg, QSystemTrayIcon::Information, title);
+}
+
+qint64 WSServer::WriteLocalFrame(QLocalSocket* client,
+    const QByteArray& payload)
+{
+    // Frames are a 32-bit big endian payload length, then the payload
+    uchar header[4];
+    qToBigEndian<quint32>((quint32)payload.size(), header);
+
+    if (client->write((const char*)header, sizeof(header)) != sizeof(header))
+        return -1;
+
+    return client->write(payload);
+}
+
+ClientSession* WSServer::registerClient(QObject* client, bool local,
+    const QString& ip, quint16 port, int encoding)
+{
+    ClientSession* session = new ClientSession();
+    session->client = client;
+    session->local = local;
+    session->connectionId = _nextConnectionId++;
+    session->ip = ip;
+    session->address = port ? QString("%1:%2").arg(ip).arg(port) : ip;
+    session->connectedAt = os_gettime_ns();
+    session->encoding = encoding;
+
+    QMutexLocker locker(&_clMutex);
+    _sessions.insert(client, session);
+    locker.unlock();
+
+    if (_capture.IsActive()) {
+        _capture.Record(CaptureRecord::Connected, session->connectionId,
+            session->address.toUtf8());
+    }
+
+    return session;
+}
+
+void WSServer::unregisterClient(QObject* client) {
+    QMutexLocker locker(&_clMutex);
+    ClientSession* session = _sessions.take(client);
+    locker.unlock();
+
+    if (!session)
+        return;
+
+    if (_capture.IsActive()) {
+        _capture.Record(CaptureRecord::Disconnected, session->connectionId);
+    }
+
+    for (const ClientSession::QueuedRequest& request : session->requests)
+        delete request.handler;
+
+    _scheduler->Detach(session);
+
+    if (session->local) {
+        blog(LOG_INFO, "local client %u disconnected", session->connectionId);
+    }
+    else {
+        blog(LOG_INFO, "client %s disconnected",
+            session->address.toUtf8().constData());
+        notifyConnection(false, session->ip);
+    }
+
+    delete session;
+}
+
+void WSServer::countInbound(ClientSession* session, uint64_t latency) {
+    QMutexLocker locker(&_clMutex);
+    session->messagesIn++;
+    session->latencies[session->latencyPos] = latency;
+    session->latencyPos = (session->latencyPos + 1) % CLIENT_LATENCY_SAMPLES;
+    if (session->latencyCount < CLIENT_LATENCY_SAMPLES)
+        session->latencyCount++;
+}
+
+void WSServer::countOutbound(ClientSession* session, qint64 payloadSize) {
+    if (payloadSize < 0)
+        return;
+
+    session->messagesOut++;
+}
+
+void WSServer::processMessage(QObject* client, const QByteArray& payload,
+    bool binary)
+{
+    uint64_t startTime = os_gettime_ns();
+
+    QMutexLocker locker(&_clMutex);
+    ClientSession* session = _sessions.value(client);
+    if (!session)
+        return;
+
+    bool allowed = _requestLimiter.Allow(session->ip, startTime);
+    if (!allowed)
+        _rejectedRequests++;
+    locker.unlock();
+
+    if (_capture.IsActive()) {
+        QByteArray captured = payload;
+        if (binary) {
+            OBSDataAutoRelease data =
+                MsgPack::ToData(payload.constData(), payload.size());
+            captured = data ? QByteArray(obs_data_get_json(data))
+                : QByteArray();
+        }
+        _capture.Record(CaptureRecord::Inbound, session->connectionId,
+            captured);
+    }
+
+    WSRequestHandler* handler = new WSRequestHandler(session);
+    handler->setReceivedAt(startTime);
+    bool parsed = binary ? handler->parseIncomingBinaryMessage(payload)
+        : handler->parseIncomingMessage(QString::fromUtf8(payload));
+    if (!parsed) {
+        countInbound(session, os_gettime_ns() - startTime);
+        delete handler;
+        return;
+    }
+
+    locker.relock();
+    if (!allowed) {
+        handler->setRejection("request rate limit exceeded");
+    }
+    else if (session->requests.size() >= REQUEST_QUEUE_MAX) {
+        handler->setRejection("too many pending requests");
+        allowed = false;
+    }
+    locker.unlock();
+
+    // Refusals are answered right away
+    if (!allowed || handler->isUnqueued()) {
+        handler->processRequest();
+        countInbound(session, os_gettime_ns() - startTime);
+        delete handler;
+        return;
+    }
+
+    ClientSession::QueuedRequest request;
+    request.handler = handler;
+    request.priority = handler->priority();
+    request.receivedAt = startTime;
+    request.coalescingKey = handler->coalescingKey();
+    request.deadline = handler->deadline();
+    if (request.deadline)
+        request.deadline = startTime + request.deadline * 1000000;
+
+    locker.relock();
+    session->requests.append(request);
+    locker.unlock();
+
+    scheduleRequestQueue();
+}
+
+void WSServer::scheduleRequestQueue() {
+    if (_requestQueueScheduled)
+        return;
+
+    _requestQueueScheduled = true;
+    QMetaObject::invokeMethod(this, "processRequestQueue",
+        Qt::QueuedConnection);
+}
+
+// Runs one request, then goes back to the event loop so that requests
+// received meanwhile are queued before the next one is picked. Requests
+// of a client run in the order they were received : the next request is
+// the most urgent one among the clients' oldest requests, the one waiting
+// for the longest on equal priority.
+void WSServer::processRequestQueue() {
+    _requestQueueScheduled = false;
+
+    QMutexLocker locker(&_clMutex);
+    ClientSession* next = nullptr;
+    bool more = false;
+    for (ClientSession* session : _sessions) {
+        if (session->requests.isEmpty())
+            continue;
+
+        if (!next) {
+            next = session;
+            continue;
+        }
+
+        more = true;
+        const ClientSession::QueuedRequest& head = session->requests.first();
+        const ClientSession::QueuedRequest& best = next->requests.first();
+        if (head.priority < best.priority
+            || (head.priority == best.priority
+                && head.receivedAt < best.receivedAt))
+        {
+            next = session;
+        }
+    }
+
+    if (!next)
+        return;
+
+    ClientSession::QueuedRequest request = next->requests.takeFirst();
+    if (!next->requests.isEmpty())
+        more = true;
+    locker.unlock();
+
+    if (more)
+        scheduleRequestQueue();
+
+    // The client gave up on it : not worth running
+    bool expired = request.deadline && os_gettime_ns() > request.deadline;
+    if (expired) {
+        request.handler->setRejection("timeout");
+        request.coalescingKey.clear();
+    }
+
+    bool authRequired = Config::Current()->AuthRequired;
+    bool trusted = !authRequired || next->authenticated;
+    if (!trusted)
+        request.coalescingKey.clear();
+
+    // A retry of a request that already ran gets its response again
+    QString cacheKey;
+    if (trusted && !expired)
+        cacheKey = idempotencyCacheKey(next, request.handler);
+    if (!cacheKey.isEmpty() && replayResponse(next, request, cacheKey)) {
+        delete request.handler;
+        return;
+    }
+
+    QList<QPair<ClientSession*, ClientSession::QueuedRequest>> followers;
+    if (!request.coalescingKey.isEmpty())
+        followers = takeCoalesced(request);
+
+    request.handler->processRequest();
+    countInbound(next, os_gettime_ns() - request.receivedAt);
+
+    // Identical requests waiting meanwhile get the same response
+    obs_data_t* response = request.handler->response();
+    QByteArray sharedJson;
+    for (const QPair<ClientSession*, ClientSession::QueuedRequest>&
+        follower : followers)
+    {
+        WSRequestHandler* handler = follower.second.handler;
+        if (response)
+            sendShared(follower.first, response,
+                handler->requestType().toUtf8(), handler->messageId(),
+                sharedJson);
+        countInbound(follower.first,
+            os_gettime_ns() - follower.second.receivedAt);
+        delete handler;
+    }
+
+    if (!request.coalescingKey.isEmpty()) {
+        locker.relock();
+        CoalescingCounters& counters =
+            _coalescing[request.handler->requestType()];
+        counters.executed++;
+        counters.coalesced += followers.size();
+        locker.unlock();
+    }
+
+    if (!cacheKey.isEmpty() && response) {
+        IdempotentResponse* entry = new IdempotentResponse();
+        entry->response = response;
+        entry->storedAt = os_gettime_ns();
+
+        locker.relock();
+        _idempotencyCache.insert(cacheKey, entry);
+        _idempotencyStored++;
+        locker.unlock();
+    }
+
+    delete request.handler;
+}
+
+// Retries are recognized by the client-id of the request, which a client
+// reconnecting after losing a response sends again, or else by their
+// connection. Never by address : clients on the same host would share it.
+QString WSServer::idempotencyCacheKey(ClientSession* session,
+    WSRequestHandler* handler)
+{
+    QString key = handler->idempotencyKey();
+    if (key.isEmpty())
+        return QString();
+
+    QString clientId = handler->clientId();
+    QString scope = clientId.isEmpty()
+        ? QString("connection:%1").arg(session->connectionId)
+        : "client:" + clientId;
+
+    return scope + '\n' + handler->requestType() + '\n' + key;
+}
+
+// Answers request with the response kept under cacheKey, if any
+bool WSServer::replayResponse(ClientSession* session,
+    const ClientSession::QueuedRequest& request, const QString& cacheKey)
+{
+    QMutexLocker locker(&_clMutex);
+    IdempotentResponse* entry = _idempotencyCache.object(cacheKey);
+    if (!entry)
+        return false;
+
+    if (os_gettime_ns() - entry->storedAt
+        > (uint64_t)IDEMPOTENCY_TTL * 1000000)
+    {
+        _idempotencyCache.remove(cacheKey);
+        return false;
+    }
+
+    OBSData response = entry->response;
+    QByteArray json = entry->json;
+    _idempotencyReplays++;
+    locker.unlock();
+
+    sendShared(session, response, request.handler->requestType().toUtf8(),
+        request.handler->messageId(), json);
+    countInbound(session, os_gettime_ns() - request.receivedAt);
+
+    // Later retries reuse the serialized response
+    locker.relock();
+    entry = _idempotencyCache.object(cacheKey);
+    if (entry && entry->json.isEmpty())
+        entry->json = json;
+    return true;
+}
+
+// Takes the queued requests identical to leader, of authenticated
+// clients. A request only qualifies if it's preceded by reads only in
+// its client's queue : it can't overtake a change made by its client.
+QList<QPair<ClientSession*, ClientSession::QueuedRequest>>
+    WSServer::takeCoalesced(const ClientSession::QueuedRequest& leader)
+{
+    QList<QPair<ClientSession*, ClientSession::QueuedRequest>> followers;
+    bool authRequired = Config::Current()->AuthRequired;
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        if (authRequired && !session->authenticated)
+            continue;
+
+        QList<ClientSession::QueuedRequest>::iterator it =
+            session->requests.begin();
+        while (it != session->requests.end()) {
+            if (it->priority < PriorityQuery)
+                break;
+
+            if (it->coalescingKey == leader.coalescingKey) {
+                followers.append(qMakePair(session, *it));
+                it = session->requests.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    return followers;
+}
+
+// Sends a response computed for another request. JSON clients get the
+// same serialized response, with their message-id spliced in.
+void WSServer::sendShared(ClientSession* session, obs_data_t* response,
+    const QByteArray& requestType, const QString& messageId,
+    QByteArray& sharedJson)
+{
+    QMutexLocker locker(&_clMutex);
+    bool shared = (session->encoding == EncodingJson)
+        && !session->names.enabled;
+    locker.unlock();
+
+    if (!shared) {
+        OBSDataAutoRelease copy = obs_data_create();
+        obs_data_apply(copy, response);
+        obs_data_set_string(copy, "message-id", messageId.toUtf8());
+        sendMessage(session, copy, requestType);
+        return;
+    }
+
+    if (sharedJson.isEmpty()) {
+        OBSDataAutoRelease body = obs_data_create();
+        obs_data_apply(body, response);
+        obs_data_erase(body, "message-id");
+        sharedJson = obs_data_get_json(body);
+    }
+
+    // Serialized by obs_data for proper escaping : {"message-id": "..."}
+    OBSDataAutoRelease id = obs_data_create();
+    obs_data_set_string(id, "message-id", messageId.toUtf8());
+    QByteArray idJson = obs_data_get_json(id);
+    idJson = idJson.mid(1, idJson.lastIndexOf('}') - 1).trimmed();
+
+    QByteArray payload;
+    payload.reserve(sharedJson.size() + idJson.size() + 2);
+    payload += '{';
+    payload += idJson;
+    payload += ',';
+    payload += sharedJson.mid(1);
+
+    qint64 sent = sendPayload(session, payload, false, requestType, false);
+
+    locker.relock();
+    countOutbound(session, sent);
+    locker.unlock();
+
+    if (_capture.IsActive())
+        _capture.Record(CaptureRecord::Outbound, session->connectionId, payload);
+}
+
+obs_data_t* WSServer::coalescingStats() {
+    obs_data_t* stats = obs_data_create();
+    OBSDataArrayAutoRelease requests = obs_data_array_create();
+    uint64_t executed = 0;
+    uint64_t coalesced = 0;
+
+    QMutexLocker locker(&_clMutex);
+    QHash<QString, CoalescingCounters>::const_iterator it;
+    for (it = _coalescing.constBegin(); it != _coalescing.constEnd(); ++it) {
+        OBSDataAutoRelease request = obs_data_create();
+        obs_data_set_string(request, "request-type", it.key().toUtf8());
+        obs_data_set_int(request, "executed", it->executed);
+        obs_data_set_int(request, "coalesced", it->coalesced);
+        obs_data_set_double(request, "hit-rate", (double)it->coalesced
+            / (double)(it->executed + it->coalesced));
+        obs_data_array_push_back(requests, request);
+
+        executed += it->executed;
+        coalesced += it->coalesced;
+    }
+    locker.unlock();
+
+    obs_data_set_int(stats, "executed", executed);
+    obs_data_set_int(stats, "coalesced", coalesced);
+    obs_data_set_double(stats, "hit-rate", (executed + coalesced)
+        ? (double)coalesced / (double)(executed + coalesced) : 0.0);
+    obs_data_set_array(stats, "requests", requests);
+    return stats;
+}
+
+obs_data_t* WSServer::idempotencyStats() {
+    obs_data_t* stats = obs_data_create();
+
+    QMutexLocker locker(&_clMutex);
+    obs_data_set_int(stats, "cached", _idempotencyCache.size());
+    obs_data_set_int(stats, "capacity", _idempotencyCache.maxCost());
+    obs_data_set_int(stats, "stored", _idempotencyStored);
+    obs_data_set_int(stats, "replays", _idempotencyReplays);
+    return stats;
+}
+
+// The canceled request is answered with an error, like a refused one
+bool WSServer::cancelRequest(ClientSession* session,
+    const QString& messageId)
+{
+    QMutexLocker locker(&_clMutex);
+    for (int i = 0; i < session->requests.size(); i++) {
+        WSRequestHandler* handler = session->requests[i].handler;
+        if (handler->messageId() != messageId)
+            continue;
+
+        session->requests.removeAt(i);
+        locker.unlock();
+
+        handler->setRejection("request canceled");
+        handler->processRequest();
+        delete handler;
+        return true;
+    }
+    return false;
+}
+
+void WSServer::onClientConnected(QObject* client, QString ip, quint16 port,
+    int encoding)
+{
+    const char* rejection = admitClient(ip);
+    if (rejection) {
+        _transport->Disconnect(client,
+            QWebSocketProtocol::CloseCodePolicyViolated,
+            QString::fromLatin1(rejection));
+        return;
+    }
+
+    registerClient(client, false, ip, port, encoding);
+
+    blog(LOG_INFO, "new client connection from %s:%d",
+        ip.toUtf8().constData(), port);
+
+    notifyConnection(true, ip);
+}
+
+void WSServer::onMessageReceived(QObject* client, QByteArray payload,
+    bool binary)
+{
+    processMessage(client, payload, binary);
+}
+
+void WSServer::onClientDisconnected(QObject* client) {
+    unregisterClient(client);
+}
+
+void WSServer::onPongReceived(QObject* client) {
+    QMutexLocker locker(&_clMutex);
+    ClientSession* session = _sessions.value(client);
+    if (!session || !session->pingSentAt)
+        return;
+
+    session->rtt = os_gettime_ns() - session->pingSentAt;
+    session->pingSentAt = 0;
+}
+
+// Pings WebSocket clients, and drops the ones that don't answer in time
+// and the ones that didn't authenticate in time. Dead clients are
+// dropped right away, along with everything queued for them, rather than
+// waiting for TCP to notice.
+void WSServer::checkLiveness() {
+    Config* config = Config::Current();
+    uint64_t now = os_gettime_ns();
+    uint64_t pingInterval = config->PingInterval * 1000000;
+    uint64_t pongTimeout = config->PongTimeout * 1000000;
+    uint64_t authTimeout = config->AuthRequired
+        ? config->AuthTimeout * 1000000 : 0;
+
+    QList<QObject*> pings;
+    QList<QPair<QObject*, const char*>> timeouts;
+
+    QMutexLocker locker(&_clMutex);
+    for (ClientSession* session : _sessions) {
+        if (authTimeout && !session->authenticated
+            && now - session->connectedAt > authTimeout)
+        {
+            timeouts.append(qMakePair(session->client,
+                "did not authenticate in time"));
+            continue;
+        }
+
+        if (session->local || !pingInterval)
+            continue;
+
+        if (session->pingSentAt) {
+            if (pongTimeout && now - session->pingSentAt > pongTimeout)
+                timeouts.append(qMakePair(session->client, "ping timeout"));
+            continue;
+        }
+
+        uint64_t lastPing = session->lastPingAt
+            ? session->lastPingAt : session->connectedAt;
+        if (now - lastPing >= pingInterval) {
+            session->lastPingAt = now;
+            session->pingSentAt = now;
+            pings.append(session->client);
+        }
+    }
+    locker.unlock();
+
+    for (QObject* client : pings)
+        _transport->Ping(client);
+
+    for (const QPair<QObject*, const char*>& timeout : timeouts) {
+        locker.relock();
+        ClientSession* session = _sessions.value(timeout.first);
+        if (!session) {
+            locker.unlock();
+            continue;
+        }
+
+        bool local = session->local;
+        blog(LOG_INFO, "dropping client %s: %s",
+            session->address.toUtf8().constData(), timeout.second);
+        _timedOutClients++;
+        locker.unlock();
+
+        // The session goes first : nothing more is queued for the client
+        // while the transport closes the connection
+        unregisterClient(timeout.first);
+        if (local) {
+            QLocalSocket* localSocket = (QLocalSocket*)timeout.first;
+            localSocket->abort();
+        }
+        else {
+            _transport->Abort(timeout.first);
+        }
+    }
+}
+
+void WSServer::onNewLocalConnection() {
+    QLocalSocket* pSocket = _localServer->nextPendingConnection();
+    if (!pSocket)
+        return;
+
+    if (admitClient(QStringLiteral("local"))) {
+        pSocket->abort();
+        pSocket->deleteLater();
+        return;
+    }
+
+    connect(pSocket, SIGNAL(readyRead()),
+        this, SLOT(onLocalReadyRead()));
+    connect(pSocket, SIGNAL(disconnected()),
+        this, SLOT(onLocalDisconnected()));
+
+    // JSON until the client's first message tells otherwise
+    ClientSession* session = registerClient(pSocket, true,
+        QStringLiteral("local"), 0, EncodingJson);
+
+    blog(LOG_INFO, "new local client connection (%u)",
+        session->connectionId);
+}
+
+void WSServer::onLocalReadyRead() {
+    QLocalSocket* pSocket = qobject_cast<QLocalSocket*>(sender());
+    if (!pSocket)
+        return;
+
+    QMutexLocker locker(&_clMutex);
+    ClientSession* session = _sessions.value(pSocket);
+    locker.unlock();
+
+    if (!session)
+        return;
+
+    // Frames stay in the socket's buffer until they are complete
+    while (pSocket->bytesAvailable() >= 4) {
+        uchar header[4];
+        pSocket->peek((char*)header, sizeof(header));
+
+        quint32 length = qFromBigEndian<quint32>(header);
+        if (length > LOCAL_MAX_FRAME_SIZE) {
+            blog(LOG_WARNING, "local client %u sent an oversized frame "
+                "(%u bytes), disconnecting", session->connectionId, length);
+            pSocket->abort();
+            return;
+        }
+
+        if (pSocket->bytesAvailable() < (qint64)length + 4)
+            return;
+
+        pSocket->read((char*)header, sizeof(header));
+        QByteArray message = pSocket->read(length);
+
+        // JSON messages are objects, MessagePack ones start with a map
+        // header : the client is answered in the encoding it last used
+        bool json = message.startsWith('{');
+        locker.relock();
+        session->encoding = json ? EncodingJson : EncodingMsgPack;
+        locker.unlock();
+
+        processMessage(pSocket, message, !json);
+    }
+}
+
+// Queued from other threads by sendPayload()
+void WSServer::writeQueuedLocalFrame(QObject* client, QByteArray payload) {
+    // The client may have left meanwhile
+    QMutexLocker locker(&_clMutex);
+    bool connected = _sessions.contains(client);
+    locker.unlock();
+
+    if (connected)
+        WriteLocalFrame((QLocalSocket*)client, payload);
+}
+
+void WSServer::onLocalDisconnected() {
+    QLocalSocket* pSocket = qobject_cast<QLocalSocket*>(sender());
+    if (!pSocket)
+        return;
+
+    unregisterClient(pSocket);
+    pSocket->deleteLater();
 }
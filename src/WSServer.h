@@ -20,13 +20,155 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #define WSSERVER_H
 
 #include <QObject>
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
 #include <QList>
 #include <QMutex>
+#include <QPair>
+#include <QString>
 
 #include "WSRequestHandler.h"
+#include "WSCapture.h"
+#include "WSQtTransport.h"
+#include "WSRateLimiter.h"
+#include "WSRules.h"
+#include "WSScheduler.h"
 
-QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
-QT_FORWARD_DECLARE_CLASS(QWebSocket)
+QT_FORWARD_DECLARE_CLASS(QLocalServer)
+QT_FORWARD_DECLARE_CLASS(QLocalSocket)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+// Number of request latencies kept per client for percentiles
+#define CLIENT_LATENCY_SAMPLES 128
+
+// Requests waiting to be executed per client, beyond which new requests
+// are refused
+#define REQUEST_QUEUE_MAX 256
+
+// Responses kept for requests with an idempotency-key, and how long (in
+// milliseconds) a retry can be answered with them
+#define IDEMPOTENCY_CACHE_SIZE 1024
+#define IDEMPOTENCY_TTL 600000
+
+// Largest frame accepted from local socket clients
+#define LOCAL_MAX_FRAME_SIZE (16 * 1024 * 1024)
+
+// Bounds of the event batching window (in milliseconds)
+#define EVENT_BATCH_DEFAULT_WINDOW 20
+#define EVENT_BATCH_MAX_WINDOW 1000
+
+// Batches are sent early once they hold that many events
+#define EVENT_BATCH_MAX_EVENTS 256
+
+// Heartbeat intervals (in milliseconds). Heartbeats are sampled on a tick
+// of HEARTBEAT_TICK, intervals are rounded up to a multiple of it.
+#define HEARTBEAT_TICK 250
+#define HEARTBEAT_DEFAULT_INTERVAL 2000
+#define HEARTBEAT_MAX_INTERVAL 30000
+
+// Field groups of the Heartbeat event, see SetHeartbeat. Group n is
+// (1 << n).
+#define HEARTBEAT_FIELD_GROUPS 4
+
+enum HeartbeatFields {
+    HeartbeatProfile = 1,
+    HeartbeatScene = 2,
+    HeartbeatStreaming = 4,
+    HeartbeatRecording = 8,
+    HeartbeatAllFields = 15
+};
+
+// Names interned per client, beyond which new names are sent as strings
+#define NAME_TABLE_MAX_SIZE 65536
+
+// Delay before a new authentication attempt after a failure (doubled at
+// each consecutive failure), in milliseconds
+#define AUTH_BACKOFF_BASE_MS 500
+#define AUTH_BACKOFF_MAX_MS 60000
+
+// Period of the ping, pong timeout and authentication timeout checks (in
+// milliseconds)
+#define LIVENESS_CHECK_INTERVAL 1000
+
+// Connections and disconnections within that time (in milliseconds) are
+// summed up in one notification
+#define CONNECTION_SUMMARY_DELAY 2000
+
+// State of one client connection, created when the client connects and
+// deleted when it disconnects. Owned by WSServer and guarded by its client
+// mutex.
+struct ClientSession {
+    QObject* client;
+    bool local;
+    quint32 connectionId;
+    QString ip;
+    QString address;
+    uint64_t connectedAt;
+
+    // Negotiated options
+    int encoding;
+    bool authenticated;
+    bool eventTimestamps; // See SetEventTimestamps
+
+    uint64_t messagesIn;
+    uint64_t messagesOut;
+    uint64_t latencies[CLIENT_LATENCY_SAMPLES];
+    int latencyCount;
+    int latencyPos;
+
+    // Requests waiting to be executed, in the order they were received
+    struct QueuedRequest {
+        WSRequestHandler* handler;
+        RequestPriority priority;
+        uint64_t receivedAt;
+        uint64_t deadline; // 0 if none
+        QByteArray coalescingKey;
+    };
+    QList<QueuedRequest> requests;
+
+    // Liveness, see PingInterval
+    uint64_t lastPingAt;
+    uint64_t pingSentAt; // 0 while no pong is expected
+    uint64_t rtt; // ns, 0 until the first pong
+
+    // See SetHeartbeat
+    struct Heartbeat {
+        uint64_t interval; // ns, 0 while disabled
+        uint64_t next;
+        int fields;
+        bool pulse;
+    } heartbeat;
+
+    // Events held back, sent as one EventBatch message
+    struct EventBatch {
+        uint64_t window; // ns, 0 while disabled
+        uint64_t deadline; // 0 while empty
+        uint64_t sequence;
+        bool msgpack;
+        QList<QByteArray> events;
+    } batch;
+
+    // Handles of the names already sent, see SetNameInterning
+    struct NameTable {
+        bool enabled;
+        QHash<QString, qint64> handles;
+        qint64 nextHandle;
+    } names;
+};
+
+struct WSClientStats {
+    quint32 connectionId;
+    QString address;
+    bool authenticated;
+    uint64_t uptime;
+    uint64_t messagesIn;
+    uint64_t messagesOut;
+    uint64_t queuedBytes;
+    uint64_t queuedRequests;
+    uint64_t p99Latency;
+    uint64_t rtt;
+};
 
 class WSServer : public QObject {
   Q_OBJECT
@@ -35,18 +177,131 @@ class WSServer : public QObject {
     virtual ~WSServer();
     void Start(quint16 port);
     void Stop();
-    void broadcast(QString message);
+    uint64_t broadcast(obs_data_t* message);
+    void sendMessage(ClientSession* session, obs_data_t* message,
+        const QByteArray& messageType);
+    QList<WSClientStats> clientStats();
+    void kickClient(quint32 connectionId);
+    bool cancelRequest(ClientSession* session, const QString& messageId);
+    void setHeartbeat(ClientSession* session, uint64_t interval, int fields);
+    int dueHeartbeats(uint64_t now);
+    uint64_t sendHeartbeats(uint64_t now, obs_data_t* update,
+        obs_data_t* const* groups);
+    void setEventBatching(ClientSession* session, uint64_t window);
+    void setNameInterning(ClientSession* session, bool enable);
+    void setEventTimestamps(ClientSession* session, bool enable);
+    void renameInterned(const QString& from, const QString& to);
+    bool authThrottled(ClientSession* session, uint64_t& retryAfter);
+    void authResult(ClientSession* session, bool success);
+    obs_data_t* admissionStats();
+    obs_data_t* coalescingStats();
+    obs_data_t* idempotencyStats();
+    WSTlsStats tlsStats();
+    obs_data_t* transportStats();
+    WSScheduler* scheduler();
+    WSRules* rules();
     static WSServer* Instance;
 
   private slots:
-    void onNewConnection();
-    void onTextMessageReceived(QString message);
-    void onSocketDisconnected();
+    void onClientConnected(QObject* client, QString ip, quint16 port,
+        int encoding);
+    void onMessageReceived(QObject* client, QByteArray payload, bool binary);
+    void onClientDisconnected(QObject* client);
+    void onPongReceived(QObject* client);
+    void onNewLocalConnection();
+    void onLocalReadyRead();
+    void onLocalDisconnected();
+    void writeQueuedLocalFrame(QObject* client, QByteArray payload);
+    void scheduleEventBatches();
+    void flushEventBatches();
+    void flushConnectionSummary();
+    void checkLiveness();
+    void processRequestQueue();
 
   private:
-    QWebSocketServer* _wsServer;
-    QList<QWebSocket*> _clients;
+    struct CoalescingCounters {
+        uint64_t executed;
+        uint64_t coalesced;
+    };
+
+    struct IdempotentResponse {
+        OBSData response;
+        QByteArray json; // Serialized on the first retry, see sendShared()
+        uint64_t storedAt;
+    };
+
+    struct AuthThrottle {
+        uint64_t failures;
+        uint64_t blockedUntil;
+    };
+
+    const char* admitClient(const QString& ip);
+    void notifyConnection(bool connected, const QString& ip);
+    static void ShowNotification(int connected, int disconnected,
+        const QString& ip);
+    void startTcp(quint16 port);
+    void startLocal(QString path);
+    void createTransport(bool native);
+    static qint64 WriteLocalFrame(QLocalSocket* client,
+        const QByteArray& payload);
+    ClientSession* registerClient(QObject* client, bool local,
+        const QString& ip, quint16 port, int encoding);
+    void unregisterClient(QObject* client);
+    void countInbound(ClientSession* session, uint64_t latency);
+    void countOutbound(ClientSession* session, qint64 payloadSize);
+    void processMessage(QObject* client, const QByteArray& payload,
+        bool binary);
+    void scheduleRequestQueue();
+    QList<QPair<ClientSession*, ClientSession::QueuedRequest>>
+        takeCoalesced(const ClientSession::QueuedRequest& leader);
+    QString idempotencyCacheKey(ClientSession* session,
+        WSRequestHandler* handler);
+    bool replayResponse(ClientSession* session,
+        const ClientSession::QueuedRequest& request, const QString& cacheKey);
+    void sendShared(ClientSession* session, obs_data_t* response,
+        const QByteArray& requestType, const QString& messageId,
+        QByteArray& sharedJson);
+    qint64 sendPayload(ClientSession* session, const QByteArray& payload,
+        bool msgpack, const QByteArray& messageType, bool deferrable);
+    bool batchEvent(ClientSession* session, bool msgpack,
+        const QByteArray& payload);
+    void sendEventBatch(ClientSession* session);
+    qint64 sendInterned(ClientSession* session, obs_data_t* message,
+        const QByteArray& messageType, bool event);
+    qint64 deliver(ClientSession* session, obs_data_t* message,
+        const QByteArray& messageType, bool event);
+    static int InternNames(obs_data_t* data,
+        ClientSession::NameTable& table, obs_data_t* names);
+
+    QHash<QObject*, ClientSession*> _sessions;
+
+    WSRateLimiter _connectionLimiter;
+    WSRateLimiter _requestLimiter;
+    QHash<QString, AuthThrottle> _authThrottles;
+    uint64_t _rejectedConnections;
+    uint64_t _rejectedRequests;
+    uint64_t _throttledAuths;
+    uint64_t _unloggedRejections;
+
+    QTimer* _summaryTimer;
+    int _summaryConnected;
+    int _summaryDisconnected;
+    QString _summaryIp;
+    QTimer* _eventBatchTimer;
+    QTimer* _livenessTimer;
+    WSScheduler* _scheduler;
+    WSRules* _rules;
+    bool _requestQueueScheduled;
+    QHash<QString, CoalescingCounters> _coalescing;
+    QCache<QString, IdempotentResponse> _idempotencyCache;
+    uint64_t _idempotencyStored;
+    uint64_t _idempotencyReplays;
+    uint64_t _timedOutClients;
+    WSTransport* _transport;
+    QLocalServer* _localServer;
     QMutex _clMutex;
+    quint32 _nextConnectionId;
+    WSCapture _capture;
 };
 
 #endif // WSSERVER_H
\ No newline at end of file
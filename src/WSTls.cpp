@@ -0,0 +1,318 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+
+#include <QFile>
+#include <mbedtls/error.h>
+
+#include "WSTls.h"
+
+#define TLS_READ_SIZE 16384
+
+static const char drbgPersonalization[] = "obs-websocket";
+
+static QString errorString(int error) {
+    char buffer[128];
+    mbedtls_strerror(error, buffer, sizeof(buffer));
+    return QString::fromUtf8(buffer);
+}
+
+WSTlsContext::WSTlsContext()
+    : _current(nullptr)
+{
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_ctr_drbg_init(&_drbg);
+    mbedtls_x509_crt_init(&_chain);
+    mbedtls_pk_init(&_key);
+    mbedtls_ssl_config_init(&_config);
+    mbedtls_ssl_ticket_init(&_tickets);
+    mbedtls_ssl_cache_init(&_cache);
+}
+
+WSTlsContext::~WSTlsContext() {
+    mbedtls_ssl_cache_free(&_cache);
+    mbedtls_ssl_ticket_free(&_tickets);
+    mbedtls_ssl_config_free(&_config);
+    mbedtls_pk_free(&_key);
+    mbedtls_x509_crt_free(&_chain);
+    mbedtls_ctr_drbg_free(&_drbg);
+    mbedtls_entropy_free(&_entropy);
+}
+
+bool WSTlsContext::Load(const QString& certificatePath,
+    const QString& keyPath, QString& error)
+{
+    int result = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func,
+        &_entropy, (const unsigned char*)drbgPersonalization,
+        sizeof(drbgPersonalization) - 1);
+    if (result != 0) {
+        error = QString("cannot seed the random generator: %1")
+            .arg(errorString(result));
+        return false;
+    }
+
+    // The first certificate of the file is the server's, the others
+    // (if any) are the intermediates sent along with it
+    QByteArray certificateFile = QFile::encodeName(certificatePath);
+    result = mbedtls_x509_crt_parse_file(&_chain, certificateFile.constData());
+    if (result < 0) {
+        error = QString("cannot load certificate \"%1\": %2")
+            .arg(certificatePath, errorString(result));
+        return false;
+    }
+
+    QByteArray keyFile = QFile::encodeName(keyPath);
+    result = mbedtls_pk_parse_keyfile(&_key, keyFile.constData(), nullptr);
+    if (result != 0) {
+        error = QString("cannot load private key \"%1\": %2")
+            .arg(keyPath, errorString(result));
+        return false;
+    }
+
+    result = mbedtls_ssl_config_defaults(&_config, MBEDTLS_SSL_IS_SERVER,
+        MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (result == 0)
+        result = mbedtls_ssl_conf_own_cert(&_config, &_chain, &_key);
+    if (result != 0) {
+        error = QString("invalid certificate or key: %1")
+            .arg(errorString(result));
+        return false;
+    }
+
+    mbedtls_ssl_conf_rng(&_config, mbedtls_ctr_drbg_random, &_drbg);
+    mbedtls_ssl_conf_authmode(&_config, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_min_version(&_config, MBEDTLS_SSL_MAJOR_VERSION_3,
+        MBEDTLS_SSL_MINOR_VERSION_3);
+
+    // Ticket keys live as long as the server : any ticket it issued since
+    // it started is accepted, whichever connection it came from
+    result = mbedtls_ssl_ticket_setup(&_tickets, mbedtls_ctr_drbg_random,
+        &_drbg, MBEDTLS_CIPHER_AES_256_GCM, TLS_SESSION_LIFETIME);
+    if (result != 0) {
+        error = QString("cannot set up session tickets: %1")
+            .arg(errorString(result));
+        return false;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&_config, writeTicket, parseTicket,
+        this);
+
+    mbedtls_ssl_cache_set_timeout(&_cache, TLS_SESSION_LIFETIME);
+    mbedtls_ssl_cache_set_max_entries(&_cache, TLS_SESSION_CACHE_SIZE);
+    mbedtls_ssl_conf_session_cache(&_config, this, getCachedSession,
+        setCachedSession);
+
+    return true;
+}
+
+int WSTlsContext::writeTicket(void* context,
+    const mbedtls_ssl_session* session, unsigned char* start,
+    const unsigned char* end, size_t* length, uint32_t* lifetime)
+{
+    WSTlsContext* tls = (WSTlsContext*)context;
+    return mbedtls_ssl_ticket_write(&tls->_tickets, session, start, end,
+        length, lifetime);
+}
+
+// mbedTLS doesn't tell whether a handshake resumed a session : the
+// ticket and cache lookups do
+int WSTlsContext::parseTicket(void* context, mbedtls_ssl_session* session,
+    unsigned char* buffer, size_t length)
+{
+    WSTlsContext* tls = (WSTlsContext*)context;
+    int result = mbedtls_ssl_ticket_parse(&tls->_tickets, session, buffer,
+        length);
+    if (result == 0 && tls->_current)
+        tls->_current->_resumed = true;
+    return result;
+}
+
+int WSTlsContext::getCachedSession(void* context,
+    mbedtls_ssl_session* session)
+{
+    WSTlsContext* tls = (WSTlsContext*)context;
+    int result = mbedtls_ssl_cache_get(&tls->_cache, session);
+    if (result == 0 && tls->_current)
+        tls->_current->_resumed = true;
+    return result;
+}
+
+int WSTlsContext::setCachedSession(void* context,
+    const mbedtls_ssl_session* session)
+{
+    WSTlsContext* tls = (WSTlsContext*)context;
+    return mbedtls_ssl_cache_set(&tls->_cache, session);
+}
+
+WSTlsSession::WSTlsSession(WSTlsContext* context)
+    : _context(context),
+      _established(false),
+      _resumed(false),
+      _closeNotified(false),
+      _inputOffset(0),
+      _outputOffset(0)
+{
+    mbedtls_ssl_init(&_ssl);
+}
+
+WSTlsSession::~WSTlsSession() {
+    mbedtls_ssl_free(&_ssl);
+}
+
+bool WSTlsSession::Setup() {
+    int result = mbedtls_ssl_setup(&_ssl, &_context->_config);
+    if (result != 0) {
+        setError(result);
+        return false;
+    }
+
+    mbedtls_ssl_set_bio(&_ssl, this, sendCallback, receiveCallback, nullptr);
+    return true;
+}
+
+bool WSTlsSession::Receive(const char* data, size_t size,
+    QByteArray& plaintext)
+{
+    // Drop what mbedTLS already consumed
+    _input.remove(0, _inputOffset);
+    _inputOffset = 0;
+    _input.append(data, (int)size);
+
+    if (!_established) {
+        _context->_current = this;
+        int result = mbedtls_ssl_handshake(&_ssl);
+        _context->_current = nullptr;
+
+        if (result == MBEDTLS_ERR_SSL_WANT_READ
+            || result == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            return true;
+        }
+        if (result != 0) {
+            setError(result);
+            return false;
+        }
+        _established = true;
+    }
+
+    // Records may hold more than what was just read : read until
+    // mbedTLS needs more input
+    for (;;) {
+        int offset = plaintext.size();
+        plaintext.resize(offset + TLS_READ_SIZE);
+        int result = mbedtls_ssl_read(&_ssl,
+            (unsigned char*)plaintext.data() + offset, TLS_READ_SIZE);
+        plaintext.resize(offset + (result > 0 ? result : 0));
+
+        if (result > 0)
+            continue;
+
+        if (result == MBEDTLS_ERR_SSL_WANT_READ
+            || result == MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            return true;
+        }
+
+        if (result != 0 && result != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+            setError(result);
+        return false;
+    }
+}
+
+bool WSTlsSession::Send(const char* data, size_t size) {
+    while (size > 0) {
+        int result = mbedtls_ssl_write(&_ssl, (const unsigned char*)data,
+            size);
+        if (result < 0) {
+            setError(result);
+            return false;
+        }
+
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+void WSTlsSession::CloseNotify() {
+    if (_established && !_closeNotified) {
+        _closeNotified = true;
+        mbedtls_ssl_close_notify(&_ssl);
+    }
+}
+
+bool WSTlsSession::IsEstablished() {
+    return _established;
+}
+
+bool WSTlsSession::IsResumed() {
+    return _resumed;
+}
+
+// Named like the Qt backend's protocols, e.g. "TLS 1.2"
+QString WSTlsSession::Protocol() {
+    return QString(mbedtls_ssl_get_version(&_ssl)).replace("TLSv", "TLS ");
+}
+
+QString WSTlsSession::LastError() {
+    return _lastError;
+}
+
+const char* WSTlsSession::PendingOutput() {
+    return _output.constData() + _outputOffset;
+}
+
+size_t WSTlsSession::PendingSize() {
+    return _output.size() - _outputOffset;
+}
+
+void WSTlsSession::Consume(size_t size) {
+    _outputOffset += (int)size;
+    if (_outputOffset == _output.size()) {
+        _output.clear();
+        _outputOffset = 0;
+    }
+}
+
+// Output is only buffered : writing never blocks
+int WSTlsSession::sendCallback(void* session, const unsigned char* buffer,
+    size_t length)
+{
+    WSTlsSession* tls = (WSTlsSession*)session;
+    tls->_output.append((const char*)buffer, (int)length);
+    return (int)length;
+}
+
+int WSTlsSession::receiveCallback(void* session, unsigned char* buffer,
+    size_t length)
+{
+    WSTlsSession* tls = (WSTlsSession*)session;
+    size_t available = tls->_input.size() - tls->_inputOffset;
+    if (available == 0)
+        return MBEDTLS_ERR_SSL_WANT_READ;
+
+    if (length > available)
+        length = available;
+    memcpy(buffer, tls->_input.constData() + tls->_inputOffset, length);
+    tls->_inputOffset += (int)length;
+    return (int)length;
+}
+
+void WSTlsSession::setError(int error) {
+    _lastError = errorString(error);
+}
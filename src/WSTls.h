@@ -0,0 +1,132 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSTLS_H
+#define WSTLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ssl_cache.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/x509_crt.h>
+
+// How long (in seconds) a client can resume its session, with a ticket
+// or from the session cache, and sessions kept in the cache
+#define TLS_SESSION_LIFETIME 86400
+#define TLS_SESSION_CACHE_SIZE 256
+
+class WSTlsSession;
+
+// Server certificate and settings shared by the TLS connections of the
+// epoll backend, with mbedTLS. Sessions are resumed from tickets
+// (RFC 5077), or from a session cache for clients without ticket
+// support : a reconnecting client skips the full handshake. Not
+// thread-safe : only used by the IO thread once loaded.
+class WSTlsContext {
+  public:
+    WSTlsContext();
+    ~WSTlsContext();
+
+    // Loads a PEM certificate (followed by its intermediates, if any) and
+    // its PEM private key
+    bool Load(const QString& certificatePath, const QString& keyPath,
+        QString& error);
+
+  private:
+    friend class WSTlsSession;
+
+    static int writeTicket(void* context, const mbedtls_ssl_session* session,
+        unsigned char* start, const unsigned char* end, size_t* length,
+        uint32_t* lifetime);
+    static int parseTicket(void* context, mbedtls_ssl_session* session,
+        unsigned char* buffer, size_t length);
+    static int getCachedSession(void* context, mbedtls_ssl_session* session);
+    static int setCachedSession(void* context,
+        const mbedtls_ssl_session* session);
+
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_x509_crt _chain;
+    mbedtls_pk_context _key;
+    mbedtls_ssl_config _config;
+    mbedtls_ssl_ticket_context _tickets;
+    mbedtls_ssl_cache_context _cache;
+
+    // Session whose handshake is running, told when it is resumed
+    WSTlsSession* _current;
+};
+
+// TLS layer of a connection. Works on memory buffers : the caller reads
+// and writes the socket, so that it stays non-blocking.
+class WSTlsSession {
+  public:
+    explicit WSTlsSession(WSTlsContext* context);
+    ~WSTlsSession();
+
+    bool Setup();
+
+    // Takes ciphertext read from the socket, and appends the data it
+    // decrypts to plaintext. Returns false when the connection must be
+    // closed : LastError() is empty if the peer closed it.
+    bool Receive(const char* data, size_t size, QByteArray& plaintext);
+
+    // Encrypts data, once established
+    bool Send(const char* data, size_t size);
+    void CloseNotify();
+
+    bool IsEstablished();
+    bool IsResumed();
+    QString Protocol();
+    QString LastError();
+
+    // Ciphertext to write to the socket
+    const char* PendingOutput();
+    size_t PendingSize();
+    void Consume(size_t size);
+
+  private:
+    friend class WSTlsContext;
+
+    static int sendCallback(void* session, const unsigned char* buffer,
+        size_t length);
+    static int receiveCallback(void* session, unsigned char* buffer,
+        size_t length);
+    void setError(int error);
+
+    WSTlsContext* _context;
+    mbedtls_ssl_context _ssl;
+    bool _established;
+    bool _resumed;
+    bool _closeNotified;
+    QString _lastError;
+
+    QByteArray _input;
+    int _inputOffset;
+    QByteArray _output;
+    int _outputOffset;
+};
+
+#endif // WSTLS_H
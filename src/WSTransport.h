@@ -0,0 +1,98 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSTRANSPORT_H
+#define WSTRANSPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <obs.hpp>
+
+enum WSEncoding {
+    EncodingJson = 0,
+    EncodingMsgPack = 1
+};
+
+struct WSTlsStats {
+    bool enabled;
+    uint64_t handshakes;
+    uint64_t resumed; // Handshakes resuming an earlier session
+    uint64_t handshakeErrors;
+    QString lastError;
+    QHash<QString, uint64_t> protocols;
+};
+
+// WebSocket server backend used by WSServer. Each connection is handed
+// over as a QObject living on the main thread, on which WSServer keeps
+// the client's properties. The transport owns these objects : they are
+// deleted later on, after clientDisconnected().
+class WSTransport : public QObject {
+  Q_OBJECT
+  public:
+    explicit WSTransport(QObject* parent = Q_NULLPTR) : QObject(parent) {}
+    virtual ~WSTransport() {}
+
+    virtual const char* Name() = 0;
+    virtual bool Listen(quint16 port, QString& error) = 0;
+    virtual void Close() = 0;
+
+    // 0 when not listening
+    virtual quint16 ServerPort() = 0;
+
+    // Queues a message. Returns the payload size, or -1 if the client is
+    // gone. Safe to call from any thread. messageType (request or event
+    // type) keys the compression statistics. Deferrable messages (events)
+    // may be held back, up to WriteBatchDelay, to be written along with
+    // the next ones.
+    virtual qint64 Send(QObject* client, const QByteArray& payload,
+        bool binary, const QByteArray& messageType,
+        bool deferrable = false) = 0;
+    virtual void Disconnect(QObject* client, quint16 closeCode,
+        const QString& reason) = 0;
+
+    // Drops the connection right away, along with its queued output,
+    // without a closing handshake. clientDisconnected() follows.
+    virtual void Abort(QObject* client) = 0;
+
+    // Sends a ping frame : pongReceived() is emitted when the client
+    // answers
+    virtual void Ping(QObject* client) = 0;
+
+    // Bytes queued for the client but not written to the socket yet
+    virtual uint64_t QueuedBytes(QObject* client) = 0;
+
+    virtual obs_data_t* GetStats() = 0;
+
+    // Applies to the next call to Listen(). With secure, loads the
+    // certificate and key set in Config, or sets error.
+    virtual bool SetSecure(bool secure, QString& error) = 0;
+    virtual bool IsSecure() = 0;
+    virtual WSTlsStats TlsStats() = 0;
+
+  signals:
+    void clientConnected(QObject* client, QString ip, quint16 port,
+        int encoding);
+    void messageReceived(QObject* client, QByteArray payload, bool binary);
+    void clientDisconnected(QObject* client);
+    void pongReceived(QObject* client);
+};
+
+#endif // WSTRANSPORT_H
@@ -0,0 +1,177 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <string.h>
+#include <util/platform.h>
+
+#include "WSWatchdog.h"
+#include "obs-websocket.h"
+
+// Interval between two probes, in ms
+#define WATCHDOG_PROBE_INTERVAL 100
+
+WSWatchdog* WSWatchdog::Instance = nullptr;
+std::atomic<const char*> WSWatchdog::currentActivity(nullptr);
+QThread* WSWatchdog::_mainThread = nullptr;
+QMutex WSWatchdog::_namesMutex;
+QHash<QByteArray, QByteArray> WSWatchdog::_names;
+
+WSWatchdog::WSWatchdog(QObject* parent)
+    : QThread(parent),
+      _probeSentAt(0),
+      _stopping(false),
+      _thresholdNs(0),
+      _probeCount(0),
+      _stallCount(0),
+      _totalLagNs(0),
+      _maxLagNs(0)
+{
+    // A QThread object lives in the thread that created it : onProbe()
+    // is queued to the main thread as long as this is created there
+    _mainThread = QThread::currentThread();
+
+    for (int i = 0; i < WATCHDOG_HISTOGRAM_BUCKETS; i++)
+        _histogram[i] = 0;
+}
+
+WSWatchdog::~WSWatchdog() {
+    Stop();
+}
+
+void WSWatchdog::Start(int thresholdMs) {
+    Stop();
+
+    if (thresholdMs < WATCHDOG_PROBE_INTERVAL)
+        thresholdMs = WATCHDOG_PROBE_INTERVAL;
+    _thresholdNs = (uint64_t)thresholdMs * 1000000;
+
+    _probeSentAt = 0;
+    _stopping = false;
+    start(QThread::HighPriority);
+}
+
+void WSWatchdog::Stop() {
+    if (!isRunning())
+        return;
+
+    _stopping = true;
+    wait();
+}
+
+obs_data_t* WSWatchdog::GetStats() {
+    OBSDataArrayAutoRelease histogram = obs_data_array_create();
+    uint64_t boundMs = 1;
+    for (int i = 0; i < WATCHDOG_HISTOGRAM_BUCKETS; i++) {
+        OBSDataAutoRelease bucket = obs_data_create();
+        if (i < WATCHDOG_HISTOGRAM_BUCKETS - 1)
+            obs_data_set_int(bucket, "below-ms", boundMs);
+        obs_data_set_int(bucket, "count", _histogram[i]);
+        obs_data_array_push_back(histogram, bucket);
+        boundMs <<= 1;
+    }
+
+    obs_data_t* stats = obs_data_create();
+    obs_data_set_bool(stats, "active", isRunning());
+    obs_data_set_int(stats, "threshold-ms", _thresholdNs / 1000000);
+    obs_data_set_int(stats, "probes", _probeCount);
+    obs_data_set_int(stats, "stalls", _stallCount);
+    obs_data_set_double(stats, "average-lag-ms", _probeCount ?
+        ((double)_totalLagNs / _probeCount) / 1000000.0 : 0.0);
+    obs_data_set_double(stats, "max-lag-ms", (double)_maxLagNs / 1000000.0);
+    obs_data_set_array(stats, "lag-histogram", histogram);
+    return stats;
+}
+
+const char* WSWatchdog::InternName(const char* name) {
+    if (!name)
+        return nullptr;
+
+    QByteArray key = QByteArray::fromRawData(name, (int)strlen(name));
+
+    QMutexLocker locker(&_namesMutex);
+    QHash<QByteArray, QByteArray>::const_iterator it = _names.constFind(key);
+    if (it == _names.constEnd())
+        it = _names.insert(QByteArray(name), QByteArray(name));
+
+    // Interned names are never removed, so their data stays valid
+    return it.value().constData();
+}
+
+bool WSWatchdog::IsMainThread() {
+    return _mainThread && (QThread::currentThread() == _mainThread);
+}
+
+void WSWatchdog::run() {
+    while (!_stopping) {
+        uint64_t now = os_gettime_ns();
+        uint64_t sentAt = _probeSentAt.load();
+
+        // Only one probe in flight : a stalled loop must not pile them up
+        if (sentAt == 0) {
+            _probeSentAt = now;
+            QMetaObject::invokeMethod(this, "onProbe", Qt::QueuedConnection,
+                Q_ARG(quint64, now));
+        }
+        else if ((now - sentAt) >= _thresholdNs) {
+            const char* activity = currentActivity.load();
+
+            QMutexLocker locker(&_stallMutex);
+            if (activity && _probeSentAt.load() == sentAt
+                && _stallActivities.size() < WATCHDOG_MAX_STALL_ACTIVITIES
+                && !_stallActivities.contains(activity))
+            {
+                _stallActivities.append(activity);
+            }
+        }
+
+        QThread::msleep(WATCHDOG_PROBE_INTERVAL);
+    }
+}
+
+void WSWatchdog::onProbe(quint64 sentAt) {
+    uint64_t lag = os_gettime_ns() - sentAt;
+
+    int bucket = 0;
+    uint64_t boundNs = 1000000;
+    while (bucket < WATCHDOG_HISTOGRAM_BUCKETS - 1 && lag >= boundNs) {
+        bucket++;
+        boundNs <<= 1;
+    }
+
+    _histogram[bucket]++;
+    _probeCount++;
+    _totalLagNs += lag;
+    if (lag > _maxLagNs)
+        _maxLagNs = lag;
+
+    QMutexLocker locker(&_stallMutex);
+    QStringList activities = _stallActivities;
+    _stallActivities.clear();
+    _probeSentAt = 0;
+    locker.unlock();
+
+    if (_thresholdNs > 0 && lag >= _thresholdNs) {
+        _stallCount++;
+        blog(LOG_WARNING, "main thread stalled for %llu ms (%s)",
+            (unsigned long long)(lag / 1000000),
+            activities.isEmpty() ? "outside obs-websocket"
+                : activities.join(", ").toUtf8().constData());
+
+        emit stallDetected(lag / 1000000, activities);
+    }
+}
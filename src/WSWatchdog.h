@@ -0,0 +1,106 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef WSWATCHDOG_H
+#define WSWATCHDOG_H
+
+#include <atomic>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+
+#include <obs.hpp>
+
+#define WATCHDOG_HISTOGRAM_BUCKETS 12
+#define WATCHDOG_MAX_STALL_ACTIVITIES 4
+
+// Measures the responsiveness of the main (UI) event loop : a probe is
+// queued on it at a fixed interval from a separate thread, and the
+// delay until it runs is recorded. While a probe is overdue, the
+// watchdog thread samples what obs-websocket is executing on the main
+// thread, as marked by WSActivityScope.
+class WSWatchdog : public QThread {
+  Q_OBJECT
+  public:
+    explicit WSWatchdog(QObject* parent = Q_NULLPTR);
+    ~WSWatchdog();
+    void Start(int thresholdMs);
+    void Stop();
+    obs_data_t* GetStats();
+
+    static const char* InternName(const char* name);
+    static bool IsMainThread();
+    static std::atomic<const char*> currentActivity;
+
+    static WSWatchdog* Instance;
+
+  signals:
+    void stallDetected(quint64 lagMs, QStringList activities);
+
+  protected:
+    void run() override;
+
+  private slots:
+    void onProbe(quint64 sentAt);
+
+  private:
+    std::atomic<uint64_t> _probeSentAt;
+    std::atomic<bool> _stopping;
+    uint64_t _thresholdNs;
+
+    QMutex _stallMutex;
+    QStringList _stallActivities;
+
+    // Main thread only
+    uint64_t _histogram[WATCHDOG_HISTOGRAM_BUCKETS];
+    uint64_t _probeCount;
+    uint64_t _stallCount;
+    uint64_t _totalLagNs;
+    uint64_t _maxLagNs;
+
+    static QThread* _mainThread;
+    static QMutex _namesMutex;
+    static QHash<QByteArray, QByteArray> _names;
+};
+
+// Marks what the main thread is executing, for stall reports.
+// Names must outlive the scope : use literals or WSWatchdog::InternName.
+class WSActivityScope {
+  public:
+    explicit WSActivityScope(const char* name)
+        : _tracked(WSWatchdog::IsMainThread()),
+          _previous(nullptr)
+    {
+        if (_tracked)
+            _previous = WSWatchdog::currentActivity.exchange(name);
+    }
+
+    ~WSActivityScope() {
+        if (_tracked)
+            WSWatchdog::currentActivity.store(_previous);
+    }
+
+  private:
+    bool _tracked;
+    const char* _previous;
+};
+
+#endif // WSWATCHDOG_H
@@ -17,17 +17,47 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 */
 
 #include <obs-frontend-api.h>
+#include <util/platform.h>
+#include <QHeaderView>
+#include <QPushButton>
 
 #include "../obs-websocket.h"
 #include "../Config.h"
+#include "../Utils.h"
 #include "../WSServer.h"
+#include "../WSEvents.h"
+#include "../WSDebugLog.h"
 #include "settings-dialog.h"
 
 #define CHANGE_ME "changeme"
 
+// Refresh interval of the diagnostics tab, in ms
+#define DIAGNOSTICS_REFRESH_INTERVAL 1000
+
+enum ClientsColumn {
+    ClientAddress,
+    ClientAuthenticated,
+    ClientUptime,
+    ClientMessagesIn,
+    ClientMessagesOut,
+    ClientQueuedBytes,
+    ClientLatency,
+    ClientKick
+};
+
+enum BroadcastsColumn {
+    BroadcastUpdateType,
+    BroadcastCount,
+    BroadcastTotalTime,
+    BroadcastAverageTime,
+    BroadcastTotalBytes
+};
+
 SettingsDialog::SettingsDialog(QWidget* parent) :
     QDialog(parent, Qt::Dialog),
-    ui(new Ui::SettingsDialog)
+    ui(new Ui::SettingsDialog),
+    _diagnosticsTimer(new QTimer(this)),
+    _previousRefresh(0)
 {
     ui->setupUi(this);
 
@@ -35,6 +65,13 @@ SettingsDialog::SettingsDialog(QWidget* parent) :
         this, &SettingsDialog::AuthCheckboxChanged);
     connect(ui->buttonBox, &QDialogButtonBox::accepted,
         this, &SettingsDialog::FormAccepted);
+    connect(_diagnosticsTimer, &QTimer::timeout,
+        this, &SettingsDialog::RefreshDiagnostics);
+
+    ui->clientsTable->horizontalHeader()->setSectionResizeMode(
+        ClientAddress, QHeaderView::Stretch);
+    ui->broadcastsTable->horizontalHeader()->setSectionResizeMode(
+        BroadcastUpdateType, QHeaderView::Stretch);
 
 
     AuthCheckboxChanged();
@@ -51,6 +88,16 @@ void SettingsDialog::showEvent(QShowEvent* event) {
 
     ui->authRequired->setChecked(conf->AuthRequired);
     ui->password->setText(CHANGE_ME);
+
+    // Diagnostics are only collected while the dialog is open
+    RefreshDiagnostics();
+    _diagnosticsTimer->start(DIAGNOSTICS_REFRESH_INTERVAL);
+}
+
+void SettingsDialog::hideEvent(QHideEvent* event) {
+    _diagnosticsTimer->stop();
+    _previousCounts.clear();
+    _previousRefresh = 0;
 }
 
 void SettingsDialog::ToggleShowHide() {
@@ -93,12 +140,106 @@ void SettingsDialog::FormAccepted() {
 
     conf->Save();
 
+    if (conf->DebugEnabled)
+        WSDebugLog::Current()->Start(conf->DebugMaxLength, conf->DebugSampling);
+    else
+        WSDebugLog::Current()->Stop();
+
     if (conf->ServerEnabled)
         WSServer::Instance->Start(conf->ServerPort);
     else
         WSServer::Instance->Stop();
 }
 
+void SettingsDialog::RefreshDiagnostics() {
+    uint64_t now = os_gettime_ns();
+    double elapsed = _previousRefresh ?
+        (double)(now - _previousRefresh) / 1000000000.0 : 0.0;
+    _previousRefresh = now;
+
+    QList<WSClientStats> clients = WSServer::Instance->clientStats();
+    QHash<quint32, MessageCounts> counts;
+
+    ui->clientsTable->setRowCount(clients.size());
+    for (int row = 0; row < clients.size(); row++) {
+        const WSClientStats& client = clients[row];
+
+        MessageCounts current = { client.messagesIn, client.messagesOut };
+        counts.insert(client.connectionId, current);
+
+        // Rates are computed between two refreshes
+        double inRate = 0.0;
+        double outRate = 0.0;
+        if (elapsed > 0.0 && _previousCounts.contains(client.connectionId)) {
+            MessageCounts previous = _previousCounts[client.connectionId];
+            inRate = (current.in - previous.in) / elapsed;
+            outRate = (current.out - previous.out) / elapsed;
+        }
+
+        const char* uptime = Utils::nsToTimestamp(client.uptime);
+
+        ui->clientsTable->setItem(row, ClientAddress,
+            new QTableWidgetItem(client.address));
+        ui->clientsTable->setItem(row, ClientAuthenticated,
+            new QTableWidgetItem(obs_module_text(client.authenticated ?
+                "OBSWebsocket.Diagnostics.Yes" : "OBSWebsocket.Diagnostics.No")));
+        ui->clientsTable->setItem(row, ClientUptime,
+            new QTableWidgetItem(uptime));
+        ui->clientsTable->setItem(row, ClientMessagesIn,
+            new QTableWidgetItem(QString::number(inRate, 'f', 1)));
+        ui->clientsTable->setItem(row, ClientMessagesOut,
+            new QTableWidgetItem(QString::number(outRate, 'f', 1)));
+        ui->clientsTable->setItem(row, ClientQueuedBytes,
+            new QTableWidgetItem(QString::number(client.queuedBytes)));
+        ui->clientsTable->setItem(row, ClientLatency,
+            new QTableWidgetItem(QString::number(
+                (double)client.p99Latency / 1000000.0, 'f', 2)));
+
+        bfree((void*)uptime);
+
+        // Keep the existing button when the row still shows the same
+        // client, so that a refresh never swallows a click
+        quint32 connectionId = client.connectionId;
+        QWidget* kickButton = ui->clientsTable->cellWidget(row, ClientKick);
+        if (!kickButton
+            || kickButton->property(PROP_CONNECTION_ID).toUInt() != connectionId)
+        {
+            QPushButton* button = new QPushButton(
+                obs_module_text("OBSWebsocket.Diagnostics.Kick"));
+            button->setProperty(PROP_CONNECTION_ID, connectionId);
+            connect(button, &QPushButton::clicked, [connectionId]() {
+                WSServer::Instance->kickClient(connectionId);
+            });
+            ui->clientsTable->setCellWidget(row, ClientKick, button);
+        }
+    }
+    _previousCounts = counts;
+
+    QHash<QString, WSBroadcastStats> broadcasts =
+        WSEvents::Instance->GetBroadcastStats();
+    QList<QString> updateTypes = broadcasts.keys();
+    updateTypes.sort();
+
+    ui->broadcastsTable->setRowCount(updateTypes.size());
+    for (int row = 0; row < updateTypes.size(); row++) {
+        const WSBroadcastStats& stats = broadcasts[updateTypes[row]];
+        double averageTime = stats.count ?
+            ((double)stats.totalTime / stats.count) / 1000.0 : 0.0;
+
+        ui->broadcastsTable->setItem(row, BroadcastUpdateType,
+            new QTableWidgetItem(updateTypes[row]));
+        ui->broadcastsTable->setItem(row, BroadcastCount,
+            new QTableWidgetItem(QString::number(stats.count)));
+        ui->broadcastsTable->setItem(row, BroadcastTotalTime,
+            new QTableWidgetItem(QString::number(
+                (double)stats.totalTime / 1000000.0, 'f', 2)));
+        ui->broadcastsTable->setItem(row, BroadcastAverageTime,
+            new QTableWidgetItem(QString::number(averageTime, 'f', 1)));
+        ui->broadcastsTable->setItem(row, BroadcastTotalBytes,
+            new QTableWidgetItem(QString::number(stats.totalBytes)));
+    }
+}
+
 SettingsDialog::~SettingsDialog() {
     delete ui;
 }
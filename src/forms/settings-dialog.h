@@ -20,6 +20,8 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #define SETTINGSDIALOG_H
 
 #include <QDialog>
+#include <QHash>
+#include <QTimer>
 
 #include "ui_settings-dialog.h"
 
@@ -31,14 +33,24 @@ public:
     explicit SettingsDialog(QWidget* parent = 0);
     ~SettingsDialog();
     void showEvent(QShowEvent* event);
+    void hideEvent(QHideEvent* event);
     void ToggleShowHide();
 
 private Q_SLOTS:
     void AuthCheckboxChanged();
     void FormAccepted();
+    void RefreshDiagnostics();
 
 private:
+    struct MessageCounts {
+        quint64 in;
+        quint64 out;
+    };
+
     Ui::SettingsDialog* ui;
+    QTimer* _diagnosticsTimer;
+    QHash<quint32, MessageCounts> _previousCounts;
+    quint64 _previousRefresh;
 };
 
 #endif // SETTINGSDIALOG_H
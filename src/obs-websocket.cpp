@@ -25,6 +25,9 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include "obs-websocket.h"
 #include "WSServer.h"
 #include "WSEvents.h"
+#include "WSDebugLog.h"
+#include "WSWatchdog.h"
+#include "WSEventRing.h"
 #include "Config.h"
 #include "forms/settings-dialog.h"
 
@@ -48,6 +51,21 @@ bool obs_module_load(void) {
     Config* config = Config::Current();
     config->Load();
 
+    if (config->DebugEnabled) {
+        WSDebugLog::Current()->Start(
+            config->DebugMaxLength, config->DebugSampling);
+    }
+
+    WSWatchdog::Instance = new WSWatchdog();
+    if (config->WatchdogEnabled)
+        WSWatchdog::Instance->Start(config->WatchdogThreshold);
+
+    WSEventRing::Instance = new WSEventRing();
+    if (config->EventRingEnabled) {
+        WSEventRing::Instance->Start(
+            config->EventRingName, config->EventRingSize);
+    }
+
     WSServer::Instance = new WSServer();
     WSEvents::Instance = new WSEvents(WSServer::Instance);
 
@@ -75,6 +93,11 @@ bool obs_module_load(void) {
 }
 
 void obs_module_unload() {
+    WSDebugLog::Current()->Stop();
+    if (WSWatchdog::Instance)
+        WSWatchdog::Instance->Stop();
+    if (WSEventRing::Instance)
+        WSEventRing::Instance->Stop();
     blog(LOG_INFO, "goodbye!");
 }
 
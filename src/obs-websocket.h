@@ -38,7 +38,7 @@ using OBSDataArrayAutoRelease =
 using OBSOutputAutoRelease =
 	OBSRef<obs_output_t*, ___output_dummy_addref, obs_output_release>;
 
-#define PROP_AUTHENTICATED "wsclient_authenticated"
+#define PROP_CONNECTION_ID "wsclient_connection_id"
 #define OBS_WEBSOCKET_VERSION "5.0.0"
 
 #define blog(level, msg, ...) blog(level, "[obs-websocket] " msg, ##__VA_ARGS__)
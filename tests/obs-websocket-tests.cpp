@@ -0,0 +1,137 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <util/platform.h>
+#include <QCoreApplication>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest/QtTest>
+#include <QtWebSockets/QWebSocket>
+
+#include "obs-websocket.h"
+#include "Config.h"
+#include "WSRules.h"
+#include "WSServer.h"
+
+// Not the benchmarks' port, so that both can run at once
+#define TEST_SERVER_PORT 44450
+
+class ServerTests : public QObject {
+  Q_OBJECT
+  private slots:
+    void init();
+    void cleanup();
+    void overLimitRequestsAreRefused();
+
+  private:
+    bool connectClient();
+
+    QWebSocket* _client;
+    QHash<QString, QJsonObject> _responses; // By message-id
+};
+
+void ServerTests::init() {
+    _client = nullptr;
+    _responses.clear();
+}
+
+void ServerTests::cleanup() {
+    if (_client) {
+        _client->close();
+        QTRY_COMPARE(_client->state(), QAbstractSocket::UnconnectedState);
+        delete _client;
+    }
+
+    delete WSServer::Instance;
+    WSServer::Instance = nullptr;
+}
+
+bool ServerTests::connectClient() {
+    _client = new QWebSocket();
+    connect(_client, &QWebSocket::textMessageReceived,
+        [this](const QString& message) {
+            QJsonObject response =
+                QJsonDocument::fromJson(message.toUtf8()).object();
+            _responses.insert(response["message-id"].toString(), response);
+        });
+
+    _client->open(QUrl(QString("ws://127.0.0.1:%1").arg(TEST_SERVER_PORT)));
+    QTest::qWaitFor([this]() {
+        return _client->state() == QAbstractSocket::ConnectedState;
+    }, 5000);
+    return _client->state() == QAbstractSocket::ConnectedState;
+}
+
+// Requests beyond the client's burst are answered with an error right
+// away, without running
+void ServerTests::overLimitRequestsAreRefused() {
+    Config* config = Config::Current();
+    config->RequestRate = 1;
+    config->RequestBurst = 2;
+
+    WSServer::Instance = new WSServer();
+    WSServer::Instance->Start(TEST_SERVER_PORT);
+    QVERIFY(connectClient());
+
+    // AddRule leaves a trace of each execution
+    const int requestCount = 5;
+    for (int i = 0; i < requestCount; i++) {
+        _client->sendTextMessage(QString(
+            "{\"request-type\":\"AddRule\",\"message-id\":\"%1\","
+            "\"event\":\"TestEvent\","
+            "\"actions\":[{\"request-type\":\"GetVersion\"}]}").arg(i));
+    }
+    QTRY_COMPARE(_responses.size(), requestCount);
+
+    for (int i = 0; i < requestCount; i++) {
+        QJsonObject response = _responses[QString::number(i)];
+        if (i < (int)config->RequestBurst) {
+            QCOMPARE(response["status"].toString(), QString("ok"));
+        }
+        else {
+            QCOMPARE(response["status"].toString(), QString("error"));
+            QCOMPARE(response["error"].toString(),
+                QString("request rate limit exceeded"));
+        }
+    }
+
+    OBSDataArrayAutoRelease rules = WSServer::Instance->rules()->List();
+    QCOMPARE((int)obs_data_array_count(rules), (int)config->RequestBurst);
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    if (!obs_startup("en-US", nullptr, nullptr)) {
+        fprintf(stderr, "failed to initialize libobs\n");
+        return 1;
+    }
+
+    // No frontend in this process: keep the server away from tray alerts
+    Config::Current()->AlertsEnabled = false;
+    Config::Current()->AuthRequired = false;
+
+    ServerTests tests;
+    int result = QTest::qExec(&tests, argc, argv);
+
+    obs_shutdown();
+    return result;
+}
+
+#include "obs-websocket-tests.moc"
@@ -0,0 +1,444 @@
+/*
+obs-websocket
+Copyright (C) 2016-2017	Stéphane Lepin <stephane.lepin@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Re-drives the requests recorded by the server's capture mode against a
+// live obs-websocket instance and compares the responses with the
+// recorded ones.
+
+#include <stdio.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QTimer>
+#include <QtWebSockets/QWebSocket>
+
+#include "WSCapture.h"
+
+#define AUTH_CHALLENGE_ID "obs-websocket-replay-challenge"
+#define AUTH_RESPONSE_ID "obs-websocket-replay-auth"
+
+struct ReplayOptions {
+    QUrl url;
+    double speed;
+    QString password;
+    bool strict;
+    int timeoutMs;
+};
+
+struct ReplayConnection {
+    quint32 id;
+    QWebSocket* socket;
+    bool ready;
+    bool closeWhenDrained;
+    QList<QByteArray> backlog;
+    QHash<QString, QString> pendingTypes;
+};
+
+class Replayer {
+  public:
+    explicit Replayer(const ReplayOptions& options);
+    ~Replayer();
+    bool Load(QString path);
+    void Start();
+
+  private:
+    void ScheduleNext();
+    void Dispatch(const CaptureRecord& record);
+    ReplayConnection* GetConnection(quint32 id);
+    void Send(ReplayConnection* conn, const QByteArray& frame);
+    void OnConnected(ReplayConnection* conn);
+    void OnMessage(ReplayConnection* conn, const QString& message);
+    void OnAuthMessage(ReplayConnection* conn, const QJsonObject& response);
+    void SetReady(ReplayConnection* conn);
+    void CloseIfDrained(ReplayConnection* conn);
+    bool IsDone();
+    void Finish();
+
+    ReplayOptions _options;
+    QVector<CaptureRecord> _records;
+    int _next;
+
+    // Recorded responses, by connection id and message-id
+    QHash<quint32, QHash<QString, QJsonObject>> _expected;
+    QHash<quint32, ReplayConnection*> _connections;
+
+    QElapsedTimer _clock;
+    QTimer _timer;
+    QTimer _graceTimer;
+
+    bool _finished;
+    int _sent;
+    int _matched;
+    int _mismatched;
+    int _unexpected;
+    int _events;
+};
+
+Replayer::Replayer(const ReplayOptions& options)
+    : _options(options),
+      _next(0),
+      _finished(false),
+      _sent(0),
+      _matched(0),
+      _mismatched(0),
+      _unexpected(0),
+      _events(0)
+{
+    _timer.setSingleShot(true);
+    QObject::connect(&_timer, &QTimer::timeout, [this]() {
+        ScheduleNext();
+    });
+
+    _graceTimer.setSingleShot(true);
+    QObject::connect(&_graceTimer, &QTimer::timeout, [this]() {
+        Finish();
+    });
+}
+
+Replayer::~Replayer() {
+    for (ReplayConnection* conn : _connections) {
+        delete conn->socket;
+        delete conn;
+    }
+}
+
+bool Replayer::Load(QString path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "cannot open %s: %s\n", path.toUtf8().constData(),
+            file.errorString().toUtf8().constData());
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint64 startTime = 0;
+    if (!CaptureRecord::readHeader(in, startTime)) {
+        fprintf(stderr, "%s is not an obs-websocket capture file\n",
+            path.toUtf8().constData());
+        return false;
+    }
+
+    CaptureRecord record;
+    while (!in.atEnd() && record.read(in)) {
+        if (record.type == CaptureRecord::Outbound) {
+            QJsonObject response =
+                QJsonDocument::fromJson(record.payload).object();
+            QString messageId = response.value("message-id").toString();
+            _expected[record.connectionId].insert(messageId, response);
+        }
+        else if (record.type != CaptureRecord::Broadcast) {
+            _records.append(record);
+        }
+    }
+
+    printf("loaded %d records from %s (captured %s)\n", _records.size(),
+        path.toUtf8().constData(),
+        QDateTime::fromMSecsSinceEpoch(startTime)
+            .toString(Qt::ISODate).toUtf8().constData());
+    return true;
+}
+
+void Replayer::Start() {
+    _clock.start();
+    ScheduleNext();
+}
+
+void Replayer::ScheduleNext() {
+    while (_next < _records.size()) {
+        const CaptureRecord& record = _records[_next];
+
+        if (_options.speed > 0.0) {
+            qint64 dueNs = qint64(record.timestamp / _options.speed);
+            qint64 remainingMs = (dueNs - _clock.nsecsElapsed()) / 1000000;
+            if (remainingMs > 0) {
+                _timer.start(int(remainingMs));
+                return;
+            }
+        }
+
+        Dispatch(record);
+        _next++;
+    }
+
+    if (IsDone())
+        Finish();
+    else
+        _graceTimer.start(_options.timeoutMs);
+}
+
+void Replayer::Dispatch(const CaptureRecord& record) {
+    ReplayConnection* conn = GetConnection(record.connectionId);
+
+    if (record.type == CaptureRecord::Inbound) {
+        QJsonObject request = QJsonDocument::fromJson(record.payload).object();
+        QString requestType = request.value("request-type").toString();
+
+        // A recorded handshake answers a challenge this instance never
+        // issued: authenticate with the given password instead
+        if (!_options.password.isEmpty()
+            && (requestType == "GetAuthRequired"
+                || requestType == "Authenticate"))
+        {
+            return;
+        }
+
+        QString messageId = request.value("message-id").toString();
+        conn->pendingTypes.insert(messageId, requestType);
+
+        if (conn->ready)
+            Send(conn, record.payload);
+        else
+            conn->backlog.append(record.payload);
+    }
+    else if (record.type == CaptureRecord::Disconnected) {
+        conn->closeWhenDrained = true;
+        CloseIfDrained(conn);
+    }
+}
+
+ReplayConnection* Replayer::GetConnection(quint32 id) {
+    ReplayConnection* conn = _connections.value(id);
+    if (conn)
+        return conn;
+
+    // Also covers connections that were already open when capture started
+    conn = new ReplayConnection();
+    conn->id = id;
+    conn->socket = new QWebSocket();
+    conn->ready = false;
+    conn->closeWhenDrained = false;
+    _connections.insert(id, conn);
+
+    QObject::connect(conn->socket, &QWebSocket::connected, [this, conn]() {
+        OnConnected(conn);
+    });
+    QObject::connect(conn->socket, &QWebSocket::textMessageReceived,
+        [this, conn](const QString& message) {
+            OnMessage(conn, message);
+        });
+
+    conn->socket->open(_options.url);
+    return conn;
+}
+
+void Replayer::Send(ReplayConnection* conn, const QByteArray& frame) {
+    conn->socket->sendTextMessage(QString::fromUtf8(frame));
+    _sent++;
+}
+
+void Replayer::OnConnected(ReplayConnection* conn) {
+    if (_options.password.isEmpty()) {
+        SetReady(conn);
+        return;
+    }
+
+    QJsonObject request;
+    request.insert("request-type", "GetAuthRequired");
+    request.insert("message-id", AUTH_CHALLENGE_ID);
+    conn->socket->sendTextMessage(
+        QJsonDocument(request).toJson(QJsonDocument::Compact));
+}
+
+void Replayer::OnMessage(ReplayConnection* conn, const QString& message) {
+    QJsonObject response = QJsonDocument::fromJson(message.toUtf8()).object();
+
+    if (response.contains("update-type")) {
+        _events++;
+        return;
+    }
+
+    QString messageId = response.value("message-id").toString();
+    if (messageId == AUTH_CHALLENGE_ID || messageId == AUTH_RESPONSE_ID) {
+        OnAuthMessage(conn, response);
+        return;
+    }
+
+    QString requestType = conn->pendingTypes.take(messageId);
+    QHash<QString, QJsonObject>& expected = _expected[conn->id];
+
+    if (!expected.contains(messageId)) {
+        _unexpected++;
+    }
+    else {
+        QJsonObject recorded = expected.take(messageId);
+
+        bool match = _options.strict ? (recorded == response)
+            : (recorded.value("status") == response.value("status")
+                && recorded.value("error") == response.value("error"));
+
+        if (match) {
+            _matched++;
+        }
+        else {
+            _mismatched++;
+            printf("mismatch on connection %u, %s (message-id %s):\n"
+                "  recorded: %s\n  replayed: %s\n",
+                conn->id, requestType.toUtf8().constData(),
+                messageId.toUtf8().constData(),
+                QJsonDocument(recorded).toJson(QJsonDocument::Compact)
+                    .left(512).constData(),
+                QJsonDocument(response).toJson(QJsonDocument::Compact)
+                    .left(512).constData());
+        }
+    }
+
+    CloseIfDrained(conn);
+
+    if (_next >= _records.size() && IsDone())
+        Finish();
+}
+
+void Replayer::OnAuthMessage(ReplayConnection* conn, const QJsonObject& response) {
+    if (response.value("message-id").toString() == AUTH_RESPONSE_ID) {
+        if (response.value("status").toString() != "ok") {
+            fprintf(stderr, "connection %u: authentication failed\n", conn->id);
+            QCoreApplication::exit(2);
+            return;
+        }
+
+        SetReady(conn);
+        return;
+    }
+
+    if (!response.value("authRequired").toBool()) {
+        SetReady(conn);
+        return;
+    }
+
+    // Same scheme as Config::GenerateSecret and Config::CheckAuth
+    QByteArray secret = QCryptographicHash::hash(
+        (_options.password + response.value("salt").toString()).toUtf8(),
+        QCryptographicHash::Sha256).toBase64();
+
+    QByteArray auth = QCryptographicHash::hash(
+        secret + response.value("challenge").toString().toUtf8(),
+        QCryptographicHash::Sha256).toBase64();
+
+    QJsonObject request;
+    request.insert("request-type", "Authenticate");
+    request.insert("message-id", AUTH_RESPONSE_ID);
+    request.insert("auth", QString::fromUtf8(auth));
+    conn->socket->sendTextMessage(
+        QJsonDocument(request).toJson(QJsonDocument::Compact));
+}
+
+void Replayer::SetReady(ReplayConnection* conn) {
+    conn->ready = true;
+
+    for (const QByteArray& frame : conn->backlog)
+        Send(conn, frame);
+    conn->backlog.clear();
+
+    CloseIfDrained(conn);
+}
+
+void Replayer::CloseIfDrained(ReplayConnection* conn) {
+    // Keep the connection open until every replayed request got its answer
+    if (conn->closeWhenDrained && conn->ready
+        && conn->backlog.isEmpty() && conn->pendingTypes.isEmpty())
+    {
+        conn->socket->close();
+    }
+}
+
+bool Replayer::IsDone() {
+    for (ReplayConnection* conn : _connections) {
+        if (!conn->backlog.isEmpty() || !conn->pendingTypes.isEmpty())
+            return false;
+    }
+    return true;
+}
+
+void Replayer::Finish() {
+    if (_finished)
+        return;
+
+    _finished = true;
+    _timer.stop();
+    _graceTimer.stop();
+
+    int missing = 0;
+    for (ReplayConnection* conn : _connections)
+        missing += conn->pendingTypes.size();
+
+    printf("replayed %d requests over %d connections in %.3f s\n",
+        _sent, _connections.size(), _clock.nsecsElapsed() / 1000000000.0);
+    printf("  %d matched, %d mismatched, %d without response, "
+        "%d not in capture, %d events received\n",
+        _matched, _mismatched, missing, _unexpected, _events);
+
+    QCoreApplication::exit((_mismatched > 0 || missing > 0) ? 1 : 0);
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("obs-websocket-replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Replays an obs-websocket traffic capture against a live instance");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Capture file (.owscap)");
+
+    QCommandLineOption urlOption("url",
+        "Server to replay against.", "url", "ws://localhost:4444");
+    QCommandLineOption speedOption("speed",
+        "Playback speed factor, 0 to send as fast as possible.",
+        "factor", "1.0");
+    QCommandLineOption passwordOption("password",
+        "Authenticate each connection with this password.", "password");
+    QCommandLineOption strictOption("strict",
+        "Compare whole responses instead of status and error only.");
+    QCommandLineOption timeoutOption("timeout",
+        "Time to wait for outstanding responses, in ms.", "ms", "5000");
+
+    parser.addOption(urlOption);
+    parser.addOption(speedOption);
+    parser.addOption(passwordOption);
+    parser.addOption(strictOption);
+    parser.addOption(timeoutOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    ReplayOptions options;
+    options.url = QUrl(parser.value(urlOption));
+    options.speed = parser.value(speedOption).toDouble();
+    options.password = parser.value(passwordOption);
+    options.strict = parser.isSet(strictOption);
+    options.timeoutMs = parser.value(timeoutOption).toInt();
+
+    Replayer replayer(options);
+    if (!replayer.Load(parser.positionalArguments().first()))
+        return 1;
+
+    QTimer::singleShot(0, [&replayer]() {
+        replayer.Start();
+    });
+    return app.exec();
+}